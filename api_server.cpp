@@ -0,0 +1,699 @@
+#include "api_server.h"
+#include "app_metrics.h"
+#include "promotions.h"
+#include "query_registry.h"
+#include <QDate>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThreadStorage>
+#include <QUrl>
+#include <QUrlQuery>
+#include <algorithm>
+
+namespace {
+
+const int maxRequestBytes = 64 * 1024;
+const int maxLimit = 200;
+
+struct ApiRequest {
+    QByteArray method;
+    QString path;
+    QUrlQuery query;
+    QHash<QByteArray, QByteArray> headers;     // lower case names
+    QByteArray body;
+    bool keepAlive = true;
+};
+
+// one read-only connection per pool thread, opened on its first request and
+// removed when the thread ends with the pool
+struct WorkerConnection {
+    QString name;
+    ~WorkerConnection() {
+        QSqlDatabase::database(name, false).close();
+        QSqlDatabase::removeDatabase(name);
+    }
+};
+
+QThreadStorage<WorkerConnection*> workerConnections;
+
+QSqlDatabase worker_database(const QString& path) {
+    if (!workerConnections.hasLocalData()) {
+        WorkerConnection* connection = new WorkerConnection;
+        connection->name = QString("api_%1").arg(quintptr(QThread::currentThreadId()));
+        workerConnections.setLocalData(connection);
+
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection->name);
+        db.setDatabaseName(path);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=2000");
+        if (!db.open()) qDebug() << "API connection failed:" << db.lastError();
+    }
+    return QSqlDatabase::database(workerConnections.localData()->name, false);
+}
+
+QByteArray status_text(int status) {
+    switch (status) {
+    case 200: return "200 OK";
+    case 400: return "400 Bad Request";
+    case 401: return "401 Unauthorized";
+    case 404: return "404 Not Found";
+    case 405: return "405 Method Not Allowed";
+    case 409: return "409 Conflict";
+    case 413: return "413 Payload Too Large";
+    case 503: return "503 Service Unavailable";
+    default: return "500 Internal Server Error";
+    }
+}
+
+QByteArray error_body(const QString& message) {
+    return QJsonDocument(QJsonObject{{"error", message}}).toJson(QJsonDocument::Compact);
+}
+
+}
+
+QString default_api_address() {
+    return qEnvironmentVariable("STOCKING_API");
+}
+
+CheckoutResult price_and_checkout(const QString& client, const QVector<ApiLine>& lines, QList<SaleLine>& sold) {
+    struct Requested {
+        CartLine cart;
+        SaleLine sale;
+    };
+    QVector<Requested> requested;
+
+    CheckoutResult result;
+    result.tx.outcome = TxOutcome::Aborted;
+    QSqlQuery query;
+    for (const ApiLine& line : lines) {
+        if (line.id > 0) {
+            query.prepare(registered_sql(Statement::ProductForSaleById));
+            query.addBindValue(line.id);
+        } else {
+            query.prepare(registered_sql(Statement::ProductForSaleByBarcode));
+            query.addBindValue(line.barcode);
+        }
+        if (!query.exec() || !query.next()) {
+            result.tx.message = QString("Unknown product %1").arg(line.id > 0 ? QString::number(line.id) : line.barcode);
+            return result;
+        }
+
+        // a product asked for twice is one line, as scanning it twice would be
+        const int id = query.value(0).toInt();
+        auto it = std::find_if(requested.begin(), requested.end(),
+                               [id](const Requested& r) { return r.cart.productId == id; });
+        if (it != requested.end()) {
+            it->cart.quantity += line.quantity;
+            continue;
+        }
+
+        Requested item;
+        item.cart.productId = id;
+        item.cart.categoryId = query.value(5).toInt();
+        item.cart.quantity = line.quantity;
+        item.cart.price = query.value(3).toDouble();
+        item.sale.name = query.value(1).toString();
+        item.sale.type = query.value(2).toString();
+        item.sale.price = item.cart.price;
+        item.sale.cost = query.value(4).toDouble();
+        requested.append(item);
+    }
+
+    // priced once the quantities are final, like reprice_line(); the engine is
+    // fresh so the register's current client is left alone
+    PromotionEngine promotions;
+    promotions.reload();
+    promotions.set_client(client);
+    QList<SaleLine> saleLines;
+    for (Requested& item : requested) {
+        LineDiscount discount = promotions.price_line(item.cart);
+        SaleLine& sale = item.sale;
+        sale.quantity = item.cart.quantity;
+        sale.discount = discount.amount;
+        sale.promotionId = discount.promotionId;
+        sale.subtotal = sale.quantity * sale.price - discount.amount;
+        sale.subexpense = sale.quantity * sale.cost;
+        saleLines << sale;
+    }
+
+    result = checkout_sale(client, saleLines);
+    if (result.ok()) sold = saleLines;
+    return result;
+}
+
+//=====================================================================================================================
+
+JsonStream::JsonStream(std::function<void(const QByteArray&)> sink, int chunkBytes)
+    : sink(std::move(sink))
+    , chunkBytes(chunkBytes)
+{
+    buffer.reserve(chunkBytes + 256);
+}
+
+void JsonStream::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (!first.isEmpty()) {
+        if (!first.last()) buffer += ',';
+        first.last() = false;
+    }
+}
+
+JsonStream& JsonStream::object() {
+    separate();
+    buffer += '{';
+    first.append(true);
+    closers += '}';
+    return *this;
+}
+
+JsonStream& JsonStream::array() {
+    separate();
+    buffer += '[';
+    first.append(true);
+    closers += ']';
+    return *this;
+}
+
+JsonStream& JsonStream::end() {
+    buffer += closers.back();
+    closers.chop(1);
+    first.removeLast();
+    flush_if_full();
+    return *this;
+}
+
+JsonStream& JsonStream::key(const QString& name) {
+    separate();
+    write_string(name);
+    buffer += ':';
+    afterKey = true;
+    return *this;
+}
+
+JsonStream& JsonStream::value(const QVariant& v) {
+    separate();
+    switch (v.userType()) {
+    case QMetaType::UnknownType:
+        buffer += "null";
+        break;
+    case QMetaType::Bool:
+        buffer += v.toBool() ? "true" : "false";
+        break;
+    case QMetaType::Int:
+    case QMetaType::LongLong:
+    case QMetaType::UInt:
+    case QMetaType::ULongLong:
+        buffer += QByteArray::number(v.toLongLong());
+        break;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        buffer += QByteArray::number(v.toDouble(), 'g', 15);
+        break;
+    default:
+        if (v.isNull()) buffer += "null";
+        else write_string(v.toString());
+    }
+    flush_if_full();
+    return *this;
+}
+
+void JsonStream::write_string(const QString& text) {
+    static const char hex[] = "0123456789abcdef";
+    buffer += '"';
+    for (char c : text.toUtf8()) {
+        switch (c) {
+        case '"': buffer += "\\\""; break;
+        case '\\': buffer += "\\\\"; break;
+        case '\n': buffer += "\\n"; break;
+        case '\r': buffer += "\\r"; break;
+        case '\t': buffer += "\\t"; break;
+        default:
+            if (uchar(c) < 0x20) {
+                buffer += "\\u00";
+                buffer += hex[uchar(c) >> 4];
+                buffer += hex[uchar(c) & 0xf];
+            } else {
+                buffer += c;
+            }
+        }
+    }
+    buffer += '"';
+}
+
+void JsonStream::flush_if_full() {
+    if (buffer.size() < chunkBytes) return;
+    sink(buffer);
+    buffer.clear();
+}
+
+void JsonStream::finish() {
+    if (!buffer.isEmpty()) sink(buffer);
+    buffer.clear();
+}
+
+//=====================================================================================================================
+
+namespace {
+
+using Handler = int (*)(QSqlDatabase& db, const QUrlQuery& query, JsonStream& out, QString& error);
+
+int query_limit(const QUrlQuery& query) {
+    const int limit = query.queryItemValue("limit").toInt();
+    return limit > 0 && limit <= maxLimit ? limit : 50;
+}
+
+void write_product(JsonStream& out, const QSqlQuery& row) {
+    out.object()
+        .field("id", row.value(0))
+        .field("name", row.value(1))
+        .field("type", row.value(2))
+        .field("quantity", row.value(3))
+        .field("price", row.value(4))
+        .field("barcode", row.value(5))
+        .end();
+}
+
+// a scanned code first, then names containing the text
+int search_products(QSqlDatabase& db, const QUrlQuery& query, JsonStream& out, QString& error) {
+    const QString text = query.queryItemValue("q", QUrl::FullyDecoded).trimmed();
+    QString pattern = text;
+    pattern.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+
+    QSqlQuery sql(db);
+    sql.setForwardOnly(true);
+    sql.prepare(registered_sql(Statement::ProductSearch));
+    sql.addBindValue(text);
+    sql.addBindValue("%" + pattern + "%");
+    sql.addBindValue(text);
+    sql.addBindValue(query_limit(query));
+    if (!sql.exec()) {
+        error = sql.lastError().text();
+        return 500;
+    }
+
+    out.object().key("products").array();
+    while (sql.next()) write_product(out, sql);
+    out.end().end();
+    return 200;
+}
+
+int stock_level(QSqlDatabase& db, const QUrlQuery& query, JsonStream& out, QString& error) {
+    QSqlQuery sql(db);
+    sql.setForwardOnly(true);
+    if (query.hasQueryItem("id")) {
+        sql.prepare(registered_sql(Statement::ProductRowById));
+        sql.addBindValue(query.queryItemValue("id").toInt());
+    } else if (query.hasQueryItem("barcode")) {
+        sql.prepare(registered_sql(Statement::ProductRowByBarcode));
+        sql.addBindValue(query.queryItemValue("barcode", QUrl::FullyDecoded));
+    } else {
+        error = "id or barcode is required";
+        return 400;
+    }
+    if (!sql.exec()) {
+        error = sql.lastError().text();
+        return 500;
+    }
+    if (!sql.next()) {
+        error = "no such product";
+        return 404;
+    }
+    write_product(out, sql);
+    return 200;
+}
+
+// both statements run before anything is written, so a failure can still be a 500
+int sales_summary(QSqlDatabase& db, const QUrlQuery& query, JsonStream& out, QString& error) {
+    const QDate today = QDate::currentDate();
+    QDate from = QDate::fromString(query.queryItemValue("from"), Qt::ISODate);
+    QDate to = QDate::fromString(query.queryItemValue("to"), Qt::ISODate);
+    if (!from.isValid()) from = today;
+    if (!to.isValid()) to = today;
+    if (to < from) {
+        error = "to is before from";
+        return 400;
+    }
+    const QString start = from.toString(Qt::ISODate);
+    const QString end = to.addDays(1).toString(Qt::ISODate);
+
+    QSqlQuery totals(db);
+    totals.setForwardOnly(true);
+    totals.prepare(registered_sql(Statement::SalesTotals));
+    totals.addBindValue(start);
+    totals.addBindValue(end);
+
+    QSqlQuery products(db);
+    products.setForwardOnly(true);
+    products.prepare(registered_sql(Statement::BestSellers));
+    products.addBindValue(start);
+    products.addBindValue(end);
+    products.addBindValue(query_limit(query));
+
+    if (!totals.exec() || !totals.next()) {
+        error = totals.lastError().text();
+        return 500;
+    }
+    if (!products.exec()) {
+        error = products.lastError().text();
+        return 500;
+    }
+
+    const double revenue = totals.value(1).toDouble();
+    const double expenses = totals.value(2).toDouble();
+    out.object()
+        .field("from", start)
+        .field("to", to.toString(Qt::ISODate))
+        .field("transactions", totals.value(0))
+        .field("revenue", revenue)
+        .field("expenses", expenses)
+        .field("profit", revenue - expenses)
+        .key("products")
+        .array();
+    while (products.next()) {
+        out.object()
+            .field("name", products.value(0))
+            .field("units", products.value(1))
+            .field("revenue", products.value(2))
+            .end();
+    }
+    out.end().end();
+    return 200;
+}
+
+}
+
+// Lives on the server thread with the QTcpServer and its sockets: reads and
+// parses requests, hands them on, and writes the responses back. One request
+// at a time per connection; the next one waits in its buffer.
+class ApiListener : public QObject
+{
+public:
+    ApiListener(const QString& dbPath, QThreadPool* workers, QObject* checkoutContext, ApiCheckoutFn checkout)
+        : dbPath(dbPath)
+        , workers(workers)
+        , checkoutContext(checkoutContext)
+        , checkout(std::move(checkout))
+        , token(qgetenv("STOCKING_API_TOKEN"))
+    {
+    }
+
+    bool listen(const QHostAddress& host, quint16 port);
+
+private:
+    struct Connection {
+        QByteArray buffer;
+        bool busy = false;
+        bool keepAlive = true;
+        bool headersSent = false;
+        QString route;
+        QElapsedTimer timer;
+    };
+
+    void accept();
+    void next(QTcpSocket* socket);
+    void dispatch(QTcpSocket* socket, const ApiRequest& request);
+    void run_query(QPointer<QTcpSocket> target, Handler handler, const QUrlQuery& query);
+    void start_checkout(QPointer<QTcpSocket> target, const QByteArray& body);
+    void send(QPointer<QTcpSocket> target, int status, const QByteArray& data, bool last);
+    void write(QTcpSocket* socket, int status, const QByteArray& data, bool last);
+
+    QString dbPath;
+    QThreadPool* workers;
+    QPointer<QObject> checkoutContext;
+    ApiCheckoutFn checkout;
+    QByteArray token;
+    QTcpServer* server = nullptr;
+    QHash<QTcpSocket*, Connection> connections;
+};
+
+bool ApiListener::listen(const QHostAddress& host, quint16 port) {
+    server = new QTcpServer(this);
+    connect(server, &QTcpServer::newConnection, this, [this]() { accept(); });
+    if (!server->listen(host, port)) {
+        qDebug() << "API server cannot listen on" << host.toString() << port << server->errorString();
+        return false;
+    }
+    qDebug() << "API server listening on" << host.toString() << server->serverPort();
+    return true;
+}
+
+void ApiListener::accept() {
+    while (QTcpSocket* socket = server->nextPendingConnection()) {
+        connections.insert(socket, Connection());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            auto it = connections.find(socket);
+            if (it == connections.end()) return;
+            it->buffer += socket->readAll();
+            next(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+// takes the next complete request off the connection's buffer, if there is one
+void ApiListener::next(QTcpSocket* socket) {
+    auto it = connections.find(socket);
+    if (it == connections.end() || it->busy) return;
+    Connection& connection = *it;
+
+    const int headerEnd = connection.buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0) {
+        if (connection.buffer.size() > maxRequestBytes) {
+            connection.busy = true;
+            connection.keepAlive = false;
+            connection.route = "oversized request";
+            connection.timer.start();
+            write(socket, 413, error_body("request too large"), true);
+        }
+        return;
+    }
+
+    const QList<QByteArray> lines = connection.buffer.left(headerEnd).split('\n');
+    const QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+    ApiRequest request;
+    request.method = requestLine.value(0);
+    const QUrl url(QString::fromLatin1(requestLine.value(1)));
+    request.path = url.path();
+    request.query = QUrlQuery(url);
+    for (int i = 1; i < lines.size(); ++i) {
+        const int colon = lines[i].indexOf(':');
+        if (colon > 0) request.headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon + 1).trimmed());
+    }
+    const QByteArray connectionHeader = request.headers.value("connection").toLower();
+    request.keepAlive = requestLine.value(2) == "HTTP/1.1" ? connectionHeader != "close" : connectionHeader == "keep-alive";
+
+    const int length = request.headers.value("content-length", "0").toInt();
+    connection.busy = true;
+    connection.keepAlive = request.keepAlive;
+    connection.route = QString::fromLatin1(request.method) + " " + request.path;
+    connection.timer.start();
+    if (length < 0 || length > maxRequestBytes) {
+        connection.keepAlive = false;
+        write(socket, 413, error_body("request too large"), true);
+        return;
+    }
+    if (connection.buffer.size() < headerEnd + 4 + length) {
+        connection.busy = false;    // the body is still coming
+        return;
+    }
+    request.body = connection.buffer.mid(headerEnd + 4, length);
+    connection.buffer.remove(0, headerEnd + 4 + length);
+
+    dispatch(socket, request);
+}
+
+void ApiListener::dispatch(QTcpSocket* socket, const ApiRequest& request) {
+    if (!token.isEmpty() && request.headers.value("authorization") != "Bearer " + token) {
+        write(socket, 401, error_body("missing or wrong token"), true);
+        return;
+    }
+
+    QPointer<QTcpSocket> target(socket);
+    if (request.path == "/api/checkout") {
+        if (request.method != "POST") write(socket, 405, error_body("use POST"), true);
+        else start_checkout(target, request.body);
+        return;
+    }
+
+    Handler handler = nullptr;
+    if (request.path == "/api/products") handler = search_products;
+    else if (request.path == "/api/stock") handler = stock_level;
+    else if (request.path == "/api/summary") handler = sales_summary;
+    if (!handler) {
+        write(socket, 404, error_body("no such route"), true);
+        return;
+    }
+    if (request.method != "GET") {
+        write(socket, 405, error_body("use GET"), true);
+        return;
+    }
+    run_query(target, handler, request.query);
+}
+
+// on a pool thread with its own connection; chunks go back to this thread as they fill
+void ApiListener::run_query(QPointer<QTcpSocket> target, Handler handler, const QUrlQuery& query) {
+    workers->start([this, target, handler, query]() {
+        QSqlDatabase db = worker_database(dbPath);
+        if (!db.isOpen()) {
+            send(target, 503, error_body("database unavailable"), true);
+            return;
+        }
+        JsonStream out([this, target](const QByteArray& chunk) { send(target, 200, chunk, false); });
+        QString error;
+        const int status = handler(db, query, out, error);
+        if (status != 200) {
+            send(target, status, error_body(error), true);
+            return;
+        }
+        out.finish();
+        send(target, 200, QByteArray(), true);
+    });
+}
+
+// parsed here, committed on the register's thread, answered from here again
+void ApiListener::start_checkout(QPointer<QTcpSocket> target, const QByteArray& body) {
+    QJsonParseError parseError;
+    const QJsonObject object = QJsonDocument::fromJson(body, &parseError).object();
+    QVector<ApiLine> lines;
+    bool valid = parseError.error == QJsonParseError::NoError;
+    for (const QJsonValue& value : object["lines"].toArray()) {
+        const QJsonObject item = value.toObject();
+        ApiLine line;
+        line.id = item["id"].toInt();
+        line.barcode = item["barcode"].toString();
+        line.quantity = item["quantity"].toInt(1);
+        if (line.quantity < 1 || (line.id <= 0 && line.barcode.isEmpty())) valid = false;
+        lines << line;
+    }
+    if (!valid || lines.isEmpty() || lines.size() > maxLimit) {
+        write(target, 400, error_body("expected {\"client\": ..., \"lines\": [{\"id\" or \"barcode\", \"quantity\"}]}"), true);
+        return;
+    }
+    if (!checkoutContext) {
+        write(target, 503, error_body("checkouts are not accepted"), true);
+        return;
+    }
+
+    const QString client = object["client"].toString();
+    QPointer<ApiListener> self(this);
+    ApiCheckoutFn fn = checkout;
+    QMetaObject::invokeMethod(checkoutContext, [self, target, fn, client, lines]() {
+        const CheckoutResult result = fn(client, lines);
+        if (!self) return;
+        if (result.ok()) {
+            const QJsonObject receipt{{"transaction", result.transactionId},
+                                      {"total", result.total},
+                                      {"date", result.date}};
+            self->send(target, 200, QJsonDocument(receipt).toJson(QJsonDocument::Compact), true);
+            return;
+        }
+        const int status = result.tx.outcome == TxOutcome::Aborted ? 409
+                           : result.tx.outcome == TxOutcome::Busy  ? 503
+                                                                   : 500;
+        self->send(target, status, error_body(result.tx.message), true);
+    }, Qt::QueuedConnection);
+}
+
+// from any thread
+void ApiListener::send(QPointer<QTcpSocket> target, int status, const QByteArray& data, bool last) {
+    QMetaObject::invokeMethod(this, [this, target, status, data, last]() {
+        if (target) write(target, status, data, last);
+    }, Qt::QueuedConnection);
+}
+
+// chunked, so rows can go out before the query has finished
+void ApiListener::write(QTcpSocket* socket, int status, const QByteArray& data, bool last) {
+    auto it = connections.find(socket);
+    if (it == connections.end()) return;
+    Connection& connection = *it;
+
+    if (!connection.headersSent) {
+        socket->write("HTTP/1.1 " + status_text(status) + "\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Transfer-Encoding: chunked\r\n"
+                      + QByteArray(connection.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n"));
+        connection.headersSent = true;
+    }
+    if (!data.isEmpty()) {
+        socket->write(QByteArray::number(data.size(), 16) + "\r\n");
+        socket->write(data);
+        socket->write("\r\n");
+    }
+    if (!last) return;
+
+    socket->write("0\r\n\r\n");
+    record_timing("api " + connection.route, connection.timer.elapsed());
+    connection.busy = false;
+    connection.headersSent = false;
+    if (!connection.keepAlive) {
+        connection.buffer.clear();
+        socket->disconnectFromHost();
+        return;
+    }
+    next(socket);
+}
+
+//=====================================================================================================================
+
+ApiServer::ApiServer(const QString& dbPath, QObject* checkoutContext, ApiCheckoutFn checkout, QObject* parent)
+    : QObject(parent)
+{
+    const int count = qEnvironmentVariableIntValue("STOCKING_API_WORKERS");
+    workers.setMaxThreadCount(count > 0 ? count : 4);
+    workers.setExpiryTimeout(-1);   // the threads, and with them their connections, stay
+
+    listener = new ApiListener(dbPath, &workers, checkoutContext, std::move(checkout));
+    listener->moveToThread(&thread);
+    connect(&thread, &QThread::finished, listener, &QObject::deleteLater);
+    thread.setObjectName("api");
+    thread.start();
+}
+
+// queries still running finish first: they post into the listener
+ApiServer::~ApiServer() {
+    workers.waitForDone();
+    thread.quit();
+    thread.wait();
+}
+
+bool ApiServer::start(const QString& address) {
+    const int colon = address.lastIndexOf(':');
+    const QString hostText = colon > 0 ? address.left(colon) : QString("127.0.0.1");
+    const QHostAddress host = hostText == "localhost" ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(hostText);
+    bool validPort = false;
+    const quint16 port = address.mid(colon + 1).toUShort(&validPort);
+    if (host.isNull() || !validPort) {
+        startError = "invalid address " + address;
+        qDebug() << "Invalid API address" << address;
+        return false;
+    }
+    if (!host.isLoopback() && qEnvironmentVariable("STOCKING_API_TOKEN").isEmpty()) {
+        startError = hostText + " is reachable from the network, set STOCKING_API_TOKEN to serve on it";
+        qDebug() << "API server refused to start:" << startError;
+        return false;
+    }
+
+    bool listening = false;
+    ApiListener* target = listener;
+    QMetaObject::invokeMethod(listener, [&listening, target, host, port]() {
+        listening = target->listen(host, port);
+    }, Qt::BlockingQueuedConnection);
+    if (!listening) startError = "could not listen on " + address;
+    return listening;
+}
@@ -0,0 +1,91 @@
+#ifndef API_SERVER_H
+#define API_SERVER_H
+
+#include "checkout.h"
+#include <QByteArray>
+#include <QObject>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <functional>
+
+// Local HTTP/JSON service for tablets and price checkers. STOCKING_API is the
+// address to listen on, "127.0.0.1:8765" for this machine only or a LAN
+// address / "0.0.0.0:8765" for the shop; unset, there is no server.
+//   GET  /api/products?q=<text>&limit=<n>      catalog search, barcode or name
+//   GET  /api/stock?id=<id>  /api/stock?barcode=<code>
+//   GET  /api/summary?from=yyyy-MM-dd&to=yyyy-MM-dd    totals and best sellers
+//   POST /api/checkout  {"client": "...", "lines": [{"id": 1 | "barcode": "...", "quantity": 2}]}
+// Sockets are handled on a thread of their own and requests by a pool of
+// STOCKING_API_WORKERS threads (4), each with a read-only connection that
+// stays open, so lookups never run on the register's thread. Rows are written
+// out as chunked json while they are read. Checkouts are the exception: they
+// are queued to the thread that owns `checkoutContext` (the register's) and
+// run there one at a time, between the cashier's own sales.
+// With STOCKING_API_TOKEN set every request needs "Authorization: Bearer <token>".
+// Without it the server only starts on a loopback address: anyone who can
+// reach it could check out and take stock down.
+
+struct ApiLine {
+    int id = 0;
+    QString barcode;
+    int quantity = 0;
+};
+
+using ApiCheckoutFn = std::function<CheckoutResult(const QString& client, const QVector<ApiLine>& lines)>;
+
+QString default_api_address();
+
+// prices lines from the products table and promotions like the cart does, then
+// checkout_sale(); on the default connection. `sold` gets what was committed.
+CheckoutResult price_and_checkout(const QString& client, const QVector<ApiLine>& lines, QList<SaleLine>& sold);
+
+// Compact json written straight into chunks of about chunkBytes, handed to
+// `sink` as they fill, instead of building a document first.
+class JsonStream
+{
+public:
+    explicit JsonStream(std::function<void(const QByteArray&)> sink, int chunkBytes = 16 * 1024);
+
+    JsonStream& object();
+    JsonStream& array();
+    JsonStream& end();
+    JsonStream& key(const QString& name);
+    JsonStream& value(const QVariant& value);
+    JsonStream& field(const QString& name, const QVariant& v) { return key(name).value(v); }
+    void finish();      // flushes what is left
+
+private:
+    void separate();
+    void write_string(const QString& text);
+    void flush_if_full();
+
+    std::function<void(const QByteArray&)> sink;
+    int chunkBytes;
+    QByteArray buffer;
+    QVector<bool> first;        // per open object/array: nothing written in it yet
+    QByteArray closers;         // '}' or ']' per open object/array
+    bool afterKey = false;
+};
+
+class ApiListener;
+
+class ApiServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    ApiServer(const QString& dbPath, QObject* checkoutContext, ApiCheckoutFn checkout, QObject* parent = nullptr);
+    ~ApiServer();
+
+    bool start(const QString& address);     // "host:port"; blocks until listening or failed
+    QString error() const { return startError; }
+
+private:
+    QThread thread;
+    QThreadPool workers;
+    ApiListener* listener;
+    QString startError;
+};
+
+#endif // API_SERVER_H
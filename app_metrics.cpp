@@ -0,0 +1,72 @@
+#include "app_metrics.h"
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+namespace {
+
+struct TimingStat {
+    quint64 count = 0;
+    qint64 totalMs = 0;
+    qint64 maxMs = 0;
+};
+
+QMutex mutex;
+QElapsedTimer processClock;
+QList<QPair<QString, qint64>> stages;
+QMap<QString, TimingStat> timings;
+
+}
+
+void start_clock() {
+    processClock.start();
+}
+
+qint64 ms_since_start() {
+    return processClock.isValid() ? processClock.elapsed() : 0;
+}
+
+void startup_mark(const QString& stage) {
+    qint64 at = ms_since_start();
+    QMutexLocker lock(&mutex);
+    stages.append({stage, at});
+}
+
+QString startup_report() {
+    QMutexLocker lock(&mutex);
+    QString report = "Startup:\n";
+    qint64 previous = 0;
+    for (const auto& stage : stages) {
+        report += QString("  %1 ms (+%2)  %3\n")
+                      .arg(stage.second, 6)
+                      .arg(stage.second - previous, 5)
+                      .arg(stage.first);
+        previous = stage.second;
+    }
+    return report;
+}
+
+void record_timing(const QString& name, qint64 ms) {
+    QMutexLocker lock(&mutex);
+    TimingStat& stat = timings[name];
+    stat.count++;
+    stat.totalMs += ms;
+    stat.maxMs = qMax(stat.maxMs, ms);
+}
+
+QString timings_report() {
+    QMutexLocker lock(&mutex);
+    QString report = "Timings (count / avg ms / max ms):\n";
+    for (auto it = timings.constBegin(); it != timings.constEnd(); ++it) {
+        const TimingStat& stat = it.value();
+        report += QString("  %1  %2 / %3 / %4\n")
+                      .arg(it.key(), -32)
+                      .arg(stat.count)
+                      .arg(double(stat.totalMs) / qMax<quint64>(stat.count, 1), 0, 'f', 1)
+                      .arg(stat.maxMs);
+    }
+    return report;
+}
@@ -0,0 +1,18 @@
+#ifndef APP_METRICS_H
+#define APP_METRICS_H
+
+#include <QString>
+
+// Process-wide timings shown in the diagnostics window (F12).
+// Startup stages are measured from start_clock(), called first thing in main().
+
+void start_clock();
+qint64 ms_since_start();
+void startup_mark(const QString& stage);
+QString startup_report();
+
+// count / total / max per named operation
+void record_timing(const QString& name, qint64 ms);
+QString timings_report();
+
+#endif // APP_METRICS_H
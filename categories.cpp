@@ -0,0 +1,94 @@
+#include "categories.h"
+#include "query_registry.h"
+#include <QDebug>
+#include <QSqlError>
+#include <QStringList>
+
+bool create_categories(QSqlQuery& query) {
+    const QStringList statements = {
+        R"(CREATE TABLE IF NOT EXISTS categories (
+               id INTEGER PRIMARY KEY,
+               name TEXT NOT NULL UNIQUE COLLATE NOCASE,
+               product_count INTEGER NOT NULL DEFAULT 0
+           ))",
+        "CREATE INDEX IF NOT EXISTS idx_products_category ON products(category_id)",
+
+        R"(CREATE TRIGGER IF NOT EXISTS products_category_insert AFTER INSERT ON products
+           BEGIN
+               UPDATE categories SET product_count = product_count + 1 WHERE id = NEW.category_id;
+           END)",
+        R"(CREATE TRIGGER IF NOT EXISTS products_category_delete AFTER DELETE ON products
+           BEGIN
+               UPDATE categories SET product_count = product_count - 1 WHERE id = OLD.category_id;
+           END)",
+        R"(CREATE TRIGGER IF NOT EXISTS products_category_update AFTER UPDATE OF category_id ON products
+           WHEN OLD.category_id IS NOT NEW.category_id
+           BEGIN
+               UPDATE categories SET product_count = product_count - 1 WHERE id = OLD.category_id;
+               UPDATE categories SET product_count = product_count + 1 WHERE id = NEW.category_id;
+           END)",
+
+        // products from before categories existed; the triggers above count them in
+        "INSERT OR IGNORE INTO categories (name) SELECT DISTINCT item_type FROM products WHERE category_id IS NULL",
+        R"(UPDATE products SET category_id = (SELECT id FROM categories WHERE name = products.item_type)
+           WHERE category_id IS NULL)"
+    };
+
+    for (const QString& sql : statements) {
+        if (!query.exec(sql)) return false;
+    }
+    return true;
+}
+
+int category_id(QSqlQuery& query, const QString& name) {
+    query.prepare(registered_sql(Statement::CategoryInsert));
+    query.addBindValue(name.trimmed());
+    if (!query.exec()) return -1;
+
+    query.prepare(registered_sql(Statement::CategoryByName));
+    query.addBindValue(name.trimmed());
+    return query.exec() && query.next() ? query.value(0).toInt() : -1;
+}
+
+QVector<Category> load_categories() {
+    QVector<Category> categories;
+    QSqlQuery query;
+    if (!query.exec(registered_sql(Statement::CategoriesInUse))) {
+        qDebug() << "Loading categories failed:" << query.lastError();
+        return categories;
+    }
+    while (query.next()) {
+        Category category;
+        category.id = query.value(0).toInt();
+        category.name = query.value(1).toString();
+        category.productCount = query.value(2).toInt();
+        categories.append(category);
+    }
+    return categories;
+}
+
+QVector<ProductSales> category_sales(const QDate& from, const QDate& to) {
+    QVector<ProductSales> result;
+
+    QSqlQuery query;
+    query.prepare(registered_sql(Statement::CategorySales));
+    query.addBindValue(from.toString("yyyy-MM-dd") + " 00:00:00");
+    query.addBindValue(to.addDays(1).toString("yyyy-MM-dd") + " 00:00:00");
+    if (!query.exec()) {
+        qDebug() << "Category sales query failed:" << query.lastError();
+        return result;
+    }
+
+    const double days = qMax<qint64>(1, from.daysTo(to) + 1);
+    while (query.next()) {
+        ProductSales sales;
+        sales.name = query.value(0).toString();
+        sales.rank = result.size() + 1;
+        sales.units = query.value(1).toLongLong();
+        sales.revenue = query.value(2).toDouble();
+        sales.cost = query.value(3).toDouble();
+        sales.perDay = sales.units / days;
+        result.append(sales);
+    }
+    return result;
+}
@@ -0,0 +1,32 @@
+#ifndef CATEGORIES_H
+#define CATEGORIES_H
+
+#include "sales_analytics.h"
+#include <QDate>
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+
+struct Category {
+    int id = 0;
+    QString name;
+    int productCount = 0;
+};
+
+// Product types as a dictionary: categories(id, name NOCASE UNIQUE,
+// product_count) and products.category_id with an index, so filtering by
+// category is an index lookup. product_count is kept by triggers on
+// products, so the facet counts never need a GROUP BY over the catalog.
+// item_type stays on products as the text the user typed.
+bool create_categories(QSqlQuery& query);
+
+// id of the category, created on first use; call inside the write transaction
+// that stores the product. -1 on error.
+int category_id(QSqlQuery& query, const QString& name);
+
+QVector<Category> load_categories();    // by name, with counts
+
+// units / revenue / cost per category over [from, to] (inclusive days)
+QVector<ProductSales> category_sales(const QDate& from, const QDate& to);
+
+#endif // CATEGORIES_H
@@ -0,0 +1,174 @@
+#include "checkout.h"
+#include "query_registry.h"
+#include "replication.h"
+#include "stock_journal.h"
+#include "store_db.h"
+#include "transaction_search.h"
+#include <QDebug>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+CheckoutResult checkout_sale(const QString& clientName, const QList<SaleLine>& lines) {
+    CheckoutResult result;
+
+    QJsonArray items;
+    QStringList itemNames;
+    for (const SaleLine& line : lines) {
+        itemNames << line.name;
+        result.total += line.subtotal;
+        result.totalExpense += line.subexpense;
+
+        QJsonObject itemObj;
+        itemObj["name"] = line.name;
+        itemObj["quantity"] = line.quantity;
+        itemObj["price"] = line.price;
+        itemObj["cost"] = line.cost;
+        itemObj["subtotal"] = line.subtotal;
+        itemObj["subexpense"] = line.subexpense;
+        if (line.discount > 0) {
+            itemObj["discount"] = line.discount;
+            itemObj["promotion_id"] = line.promotionId;
+        }
+        items.append(itemObj);
+    }
+    result.details = QString::fromUtf8(QJsonDocument(items).toJson(QJsonDocument::Compact));
+    // same format as sqlite's CURRENT_TIMESTAMP, so old and new rows sort together
+    QString date = QDateTime::currentDateTimeUtc().toString("yyyy-MM-dd HH:mm:ss");
+    result.date = date;
+
+    result.tx = run_write_transaction([&](QSqlQuery& query, QString& message) {
+        query.prepare(registered_sql(Statement::SaleInsert));
+        query.addBindValue(clientName);
+        query.addBindValue(result.details);
+        query.addBindValue(result.total);
+        query.addBindValue(result.totalExpense);
+        query.addBindValue(date);
+        if (!query.exec()) return TxStatus::Error;
+
+        result.transactionId = query.lastInsertId().toInt();
+
+        for (const SaleLine& line : lines) {
+            // check and decrement in one statement, no read-then-write window
+            query.prepare(registered_sql(Statement::SaleDecrementStock));
+            query.addBindValue(line.quantity);
+            query.addBindValue(line.name);
+            query.addBindValue(line.quantity);
+            if (!query.exec()) return TxStatus::Error;
+
+            if (query.numRowsAffected() == 0) {
+                query.prepare(registered_sql(Statement::SaleStockLeft));
+                query.addBindValue(line.name);
+                if (!query.exec()) return TxStatus::Error;
+                if (!query.next()) {
+                    message = QString("%1 is no longer in the catalog.").arg(line.name);
+                } else {
+                    message = QString("%1 has only %2 left.").arg(line.name).arg(query.value(0).toInt());
+                }
+                return TxStatus::Abort;
+            }
+
+            if (!record_stock_change(query, line.name, -line.quantity, StockReason::Sale, result.transactionId))
+                return TxStatus::Error;
+
+            query.prepare(registered_sql(Statement::SaleItemInsert));
+            query.addBindValue(result.transactionId);
+            query.addBindValue(line.name);
+            query.addBindValue(line.name);
+            query.addBindValue(line.quantity);
+            query.addBindValue(line.price);
+            query.addBindValue(line.cost);
+            query.addBindValue(line.subtotal);
+            query.addBindValue(line.subexpense);
+            query.addBindValue(line.discount);
+            query.addBindValue(line.promotionId > 0 ? QVariant(line.promotionId) : QVariant());
+            if (!query.exec()) return TxStatus::Error;
+        }
+
+        if (!index_transaction(query, result.transactionId, clientName, itemNames)) return TxStatus::Error;
+
+        QJsonObject sale;
+        sale["transaction_id"] = result.transactionId;
+        sale["name"] = clientName;
+        sale["details"] = result.details;
+        sale["total"] = result.total;
+        sale["total_expense"] = result.totalExpense;
+        sale["date"] = date;
+        return append_change(query, "sale", sale) ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    return result;
+}
+
+bool create_sale_items(QSqlQuery& query) {
+    bool created = query.exec(R"(
+        CREATE TABLE IF NOT EXISTS transaction_items (
+            transaction_id INTEGER NOT NULL,
+            product_id INTEGER,
+            name TEXT NOT NULL,
+            quantity INTEGER NOT NULL,
+            price REAL NOT NULL,
+            cost REAL NOT NULL,
+            subtotal REAL NOT NULL,
+            subexpense REAL NOT NULL,
+            discount REAL NOT NULL DEFAULT 0,
+            promotion_id INTEGER
+        )
+    )")
+    && query.exec("CREATE INDEX IF NOT EXISTS idx_transaction_items_transaction ON transaction_items(transaction_id)")
+    && query.exec("CREATE INDEX IF NOT EXISTS idx_transaction_items_name ON transaction_items(name COLLATE NOCASE, transaction_id)");
+    if (!created) return false;
+
+    // tables from before promotions
+    if (!has_column("transaction_items", "discount")
+        && !(query.exec("ALTER TABLE transaction_items ADD COLUMN discount REAL NOT NULL DEFAULT 0")
+             && query.exec("ALTER TABLE transaction_items ADD COLUMN promotion_id INTEGER"))) {
+        return false;
+    }
+
+    // everything up to the current last sale predates the table and needs a backfill;
+    // OR IGNORE keeps the first boundary when another register got here first
+    return query.exec("INSERT OR IGNORE INTO app_meta (key, value) "
+                      "SELECT 'sale_items_backfill_until', COALESCE(MAX(id), 0) FROM transactions")
+        && query.exec("INSERT OR IGNORE INTO app_meta (key, value) VALUES ('sale_items_backfilled', 0)");
+}
+
+bool sale_items_backfill_pending() {
+    return get_meta("sale_items_backfilled", 0).toLongLong() < get_meta("sale_items_backfill_until", 0).toLongLong();
+}
+
+bool backfill_sale_items(int transactionsPerChunk) {
+    qint64 until = get_meta("sale_items_backfill_until", 0).toLongLong();
+    qint64 done = get_meta("sale_items_backfilled", 0).toLongLong();
+    if (done >= until) return true;
+
+    qint64 upTo = qMin(done + transactionsPerChunk, until);
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+        query.prepare(R"(
+            INSERT INTO transaction_items
+                (transaction_id, product_id, name, quantity, price, cost, subtotal, subexpense)
+            SELECT t.id, p.id,
+                   json_extract(j.value, '$.name'),
+                   COALESCE(json_extract(j.value, '$.quantity'), 0),
+                   COALESCE(json_extract(j.value, '$.price'), 0),
+                   COALESCE(json_extract(j.value, '$.cost'), 0),
+                   COALESCE(json_extract(j.value, '$.subtotal'), 0),
+                   COALESCE(json_extract(j.value, '$.subexpense'), 0)
+            FROM transactions t
+            JOIN json_each(CASE WHEN json_valid(t.details) THEN t.details ELSE '[]' END) j
+            LEFT JOIN products p ON p.name = json_extract(j.value, '$.name')
+            WHERE t.id > ? AND t.id <= ? AND json_extract(j.value, '$.name') IS NOT NULL
+        )");
+        query.addBindValue(done);
+        query.addBindValue(upTo);
+        if (!query.exec()) return TxStatus::Error;
+        return set_meta(query, "sale_items_backfilled", upTo) ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Sale items backfill failed:" << tx.message;
+        return true; // don't spin on a broken chunk, the next start retries it
+    }
+    return upTo >= until;
+}
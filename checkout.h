@@ -0,0 +1,44 @@
+#ifndef CHECKOUT_H
+#define CHECKOUT_H
+
+#include "db_concurrency.h"
+#include <QList>
+#include <QString>
+
+struct SaleLine {
+    QString name;
+    QString type;
+    int quantity = 0;
+    double price = 0;
+    double cost = 0;
+    double subtotal = 0;    // after discount
+    double subexpense = 0;
+    double discount = 0;
+    int promotionId = 0;
+};
+
+struct CheckoutResult {
+    TxResult tx;
+    int transactionId = -1;
+    double total = 0;
+    double totalExpense = 0;
+    QString details; // json stored in transactions.details
+    QString date;    // UTC, as stored
+
+    bool ok() const { return tx.outcome == TxOutcome::Committed; }
+};
+
+// Decrements stock and records the sale in one immediate write transaction.
+// Everything that does not need the lock (json, totals) is prepared before
+// the transaction starts so the critical section is only the sql itself.
+CheckoutResult checkout_sale(const QString& clientName, const QList<SaleLine>& lines);
+
+// transaction_items holds one row per sold line so history search and
+// reports can use indexes instead of parsing transactions.details.
+// Rows written before the table existed are copied over from the json by
+// backfill_sale_items() in small chunks; it returns true once done.
+bool create_sale_items(QSqlQuery& query);
+bool backfill_sale_items(int transactionsPerChunk = 2000);
+bool sale_items_backfill_pending();
+
+#endif // CHECKOUT_H
@@ -0,0 +1,640 @@
+#include "cli_tools.h"
+#include "store_db.h"
+#include "checkout.h"
+#include "replication.h"
+#include "stock_journal.h"
+#include "transaction_search.h"
+#include "db_backup.h"
+#include "product_repository.h"
+#include "multi_store.h"
+#include "schema_migrations.h"
+#include "inventory_valuation.h"
+#include "session_replay.h"
+#include "api_server.h"
+#include "query_registry.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace {
+
+QTextStream& out() {
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+const char* stressItem = "Stress Item";
+
+// one register process: sells one unit per checkout and prints its metrics as json
+int stress_worker(const QStringList& args) {
+    if (args.size() < 5) {
+        out() << "usage: --stress-worker <db> <register> <sales>" << Qt::endl;
+        return 2;
+    }
+    QString dbPath = args[2];
+    set_register_id("stress-" + args[3]);
+    int sales = args[4].toInt();
+
+    if (!start_db(dbPath)) return 1;
+
+    SaleLine line;
+    line.name = stressItem;
+    line.type = "stress";
+    line.quantity = 1;
+    line.price = 10;
+    line.cost = 6;
+    line.subtotal = 10;
+    line.subexpense = 6;
+
+    for (int i = 0; i < sales; ++i) {
+        checkout_sale(register_id(), {line});
+    }
+
+    const RegisterMetrics& m = register_metrics();
+    QJsonObject report;
+    report["register"] = m.registerId;
+    report["commits"] = double(m.commits);
+    report["aborts"] = double(m.aborts);
+    report["failures"] = double(m.failures);
+    report["busyRetries"] = double(m.busyRetries);
+    report["busyGiveUps"] = double(m.busyGiveUps);
+    report["lockWaitMs"] = double(m.lockWaitMs);
+    out() << QJsonDocument(report).toJson(QJsonDocument::Compact) << Qt::endl;
+
+    close_db();
+    return 0;
+}
+
+// Runs 1, 2, 4 ... N register processes against one fresh database. Stock is
+// seeded one unit short per register so every run also has to refuse oversells.
+// Exit code is non zero when the final stock or the ledger don't add up.
+int stress_registers(const QStringList& args) {
+    int maxRegisters = args.size() > 2 ? args[2].toInt() : 8;
+    int sales = args.size() > 3 ? args[3].toInt() : 200;
+    bool allOk = true;
+
+    out() << "registers  sales/s  commits  aborts  gave-up  busy-retries  lock-wait-ms  stock  result" << Qt::endl;
+
+    for (int registers = 1; registers <= maxRegisters; registers *= 2) {
+        QTemporaryDir dir;
+        QString dbPath = dir.filePath("store.db");
+        int seeded = registers * sales - registers;
+
+        start_db(dbPath);
+        {
+            QSqlQuery seed;
+            seed.prepare("INSERT INTO products (name, item_type, quantity, price, bought) VALUES (?, ?, ?, ?, ?)");
+            seed.addBindValue(stressItem);
+            seed.addBindValue("stress");
+            seed.addBindValue(seeded);
+            seed.addBindValue(10);
+            seed.addBindValue(6);
+            seed.exec();
+        }
+        close_db();
+
+        QElapsedTimer timer;
+        timer.start();
+
+        std::vector<std::unique_ptr<QProcess>> workers;
+        for (int r = 0; r < registers; ++r) {
+            auto worker = std::make_unique<QProcess>();
+            worker->start(QCoreApplication::applicationFilePath(),
+                          {"--stress-worker", dbPath, QString::number(r), QString::number(sales)});
+            workers.push_back(std::move(worker));
+        }
+
+        double commits = 0, aborts = 0, giveUps = 0, retries = 0, lockWait = 0;
+        for (auto& worker : workers) {
+            worker->waitForFinished(-1);
+            QJsonObject report = QJsonDocument::fromJson(worker->readAllStandardOutput().trimmed()).object();
+            commits += report["commits"].toDouble();
+            aborts += report["aborts"].toDouble();
+            giveUps += report["busyGiveUps"].toDouble();
+            retries += report["busyRetries"].toDouble();
+            lockWait += report["lockWaitMs"].toDouble();
+        }
+        qint64 elapsed = qMax<qint64>(timer.elapsed(), 1);
+
+        start_db(dbPath);
+        int stock = -1;
+        int ledger = -1;
+        {
+            QSqlQuery check;
+            check.prepare("SELECT quantity FROM products WHERE name = ?");
+            check.addBindValue(stressItem);
+            if (check.exec() && check.next()) stock = check.value(0).toInt();
+            if (check.exec("SELECT COUNT(*) FROM transactions") && check.next()) ledger = check.value(0).toInt();
+        }
+        close_db();
+
+        // every committed sale took exactly one unit and wrote exactly one ledger row
+        bool ok = stock >= 0
+                  && stock == seeded - int(commits)
+                  && ledger == int(commits)
+                  && commits + aborts + giveUps == registers * sales;
+        allOk = allOk && ok;
+
+        out() << QString("%1  %2  %3  %4  %5  %6  %7  %8  %9")
+                     .arg(registers, 9)
+                     .arg(commits * 1000.0 / elapsed, 7, 'f', 1)
+                     .arg(commits, 7, 'f', 0)
+                     .arg(aborts, 6, 'f', 0)
+                     .arg(giveUps, 7, 'f', 0)
+                     .arg(retries, 12, 'f', 0)
+                     .arg(lockWait, 12, 'f', 0)
+                     .arg(stock, 5)
+                     .arg(ok ? QString("ok") : QString("MISMATCH"))
+              << Qt::endl;
+    }
+
+    return allOk ? 0 : 1;
+}
+
+// stand-in back office: applies register batches into its own database
+int run_aggregator(const QStringList& args) {
+    QString dbPath = args.size() > 2 ? args[2] : QString("backoffice.db");
+    QString serverName = args.size() > 3 ? args[3] : default_sync_server();
+
+    if (!start_db(dbPath)) return 1;
+
+    SyncAggregator aggregator;
+    if (!aggregator.listen(serverName)) return 1;
+
+    return QCoreApplication::exec();
+}
+
+// prints the stock level of every product as it was at the given local date/time
+int stock_at(const QStringList& args) {
+    if (args.size() < 4) {
+        out() << "usage: --stock-at <db> <yyyy-MM-dd[ HH:mm:ss]>" << Qt::endl;
+        return 2;
+    }
+    QDateTime when = QDateTime::fromString(args[3], "yyyy-MM-dd HH:mm:ss");
+    if (!when.isValid()) when = QDateTime(QDate::fromString(args[3], "yyyy-MM-dd").addDays(1), QTime(0, 0));
+    if (!when.isValid()) {
+        out() << "invalid date " << args[3] << Qt::endl;
+        return 2;
+    }
+
+    if (!start_db(args[2])) return 1;
+
+    QHash<int, QString> names;
+    QSqlQuery query("SELECT id, name FROM products");
+    while (query.next()) names.insert(query.value(0).toInt(), query.value(1).toString());
+
+    QHash<int, int> levels = stock_levels_at(when);
+    QList<int> ids = levels.keys();
+    std::sort(ids.begin(), ids.end());
+    for (int id : ids) {
+        out() << QString("%1  %2  %3")
+                     .arg(id, 6)
+                     .arg(names.value(id, "(deleted)"), -32)
+                     .arg(levels.value(id), 6)
+              << Qt::endl;
+    }
+
+    close_db();
+    return 0;
+}
+
+// drops the full-text index and rebuilds it from the transactions table
+int rebuild_search(const QStringList& args) {
+    if (args.size() < 3) {
+        out() << "usage: --rebuild-search <db>" << Qt::endl;
+        return 2;
+    }
+    if (!start_db(args[2])) return 1;
+    if (!reset_transaction_search()) {
+        out() << "full-text search is not available in this sqlite build" << Qt::endl;
+        close_db();
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while (!index_pending_transactions(20000)) {
+        out() << "indexed up to " << get_meta("search_indexed").toLongLong() << Qt::endl;
+    }
+    out() << "search index rebuilt in " << timer.elapsed() << " ms" << Qt::endl;
+
+    close_db();
+    return 0;
+}
+
+// online backup of a database that registers may be using right now
+int backup(const QStringList& args) {
+    QString dbPath = args.value(2, "store.db");
+    QString dir = args.value(3, default_backup_dir());
+
+    BackupResult result = backup_database(dbPath, dir);
+    if (!result.ok) {
+        out() << "backup failed: " << result.message << Qt::endl;
+        return 1;
+    }
+    out() << result.file << "  " << result.bytes << " -> " << result.compressedBytes << " bytes in "
+          << result.elapsedMs << " ms" << Qt::endl;
+    return 0;
+}
+
+int restore(const QStringList& args) {
+    if (args.size() < 3) {
+        out() << "usage: --restore-backup <backup file> [db]   (close every register first)" << Qt::endl;
+        return 2;
+    }
+    QString dbPath = args.value(3, "store.db");
+    QString error = restore_backup(args[2], dbPath);
+    if (!error.isEmpty()) {
+        out() << "restore failed: " << error << Qt::endl;
+        return 1;
+    }
+    out() << "restored " << dbPath << " from " << args[2] << ", previous file kept as "
+          << dbPath << ".before-restore" << Qt::endl;
+    return 0;
+}
+
+// supplier price lists: name,type,quantity,price,bought[,barcode] per line, no
+// quoting. Existing names are updated, the whole file is one transaction.
+int import_products(const QStringList& args) {
+    if (args.size() < 3) {
+        out() << "usage: --import-products <csv file> [db]" << Qt::endl;
+        return 2;
+    }
+    QFile file(args[2]);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        out() << "cannot read " << args[2] << ": " << file.errorString() << Qt::endl;
+        return 1;
+    }
+
+    QVector<ProductRecord> products;
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        ++lineNumber;
+        QStringList fields = QString::fromUtf8(file.readLine()).trimmed().split(',');
+        if (fields.size() < 5) continue;
+
+        bool quantityOk = false, priceOk = false, boughtOk = false;
+        ProductRecord product;
+        product.name = fields[0].trimmed();
+        product.type = fields[1].trimmed();
+        product.quantity = fields[2].trimmed().toInt(&quantityOk);
+        product.price = fields[3].trimmed().toDouble(&priceOk);
+        product.bought = fields[4].trimmed().toDouble(&boughtOk);
+        product.barcode = fields.value(5).trimmed();
+        if (!quantityOk || !priceOk || !boughtOk || product.name.isEmpty() || product.type.isEmpty()) {
+            if (lineNumber > 1) out() << "skipping line " << lineNumber << Qt::endl;   // line 1 may be a header
+            continue;
+        }
+        products.append(product);
+    }
+
+    if (!start_db(args.value(3, "store.db"))) return 1;
+    TxResult tx;
+    {
+        ProductRepository repository;
+        tx = repository.upsert_batch(products);
+        repository.release();
+    }
+    close_db();
+
+    if (tx.outcome != TxOutcome::Committed) {
+        out() << "import failed, nothing was written: " << tx.message << Qt::endl;
+        return 1;
+    }
+    out() << products.size() << " products written in one commit, " << tx.elapsedMs << " ms" << Qt::endl;
+    return 0;
+}
+
+// consolidated period report over this store and the STOCKING_STORES shops
+int stores_report(const QStringList& args) {
+    QDate from = QDate::fromString(args.value(2), "yyyy-MM-dd");
+    QDate to = QDate::fromString(args.value(3), "yyyy-MM-dd");
+    if (!from.isValid() || !to.isValid()) {
+        out() << "usage: --stores-report <from yyyy-MM-dd> <to yyyy-MM-dd> [csv file] [db]" << Qt::endl;
+        return 2;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    FederatedReporting reporting;
+    QFuture<StoreSummary> future = reporting.run(registered_stores(args.value(5, "store.db")), from, to);
+    FederatedReport report = FederatedReporting::merge(future.results(), from, to);
+
+    int failed = 0;
+    QVector<StoreSummary> rows = report.stores;
+    rows.append(report.combined);
+    for (const StoreSummary& store : rows) {
+        if (!store.error.isEmpty()) ++failed;
+        out() << QString("%1  %2 sales  %3 units  %4 revenue  %5 profit  %6")
+                     .arg(store.store, -20)
+                     .arg(store.transactions, 7)
+                     .arg(store.units, 8)
+                     .arg(store.revenue, 12, 'f', 2)
+                     .arg(store.revenue - store.cost, 12, 'f', 2)
+                     .arg(store.error.isEmpty() ? QString("%1 ms").arg(store.elapsedMs) : store.error)
+              << Qt::endl;
+    }
+    out() << report.stores.size() << " stores in " << timer.elapsed() << " ms" << Qt::endl;
+
+    if (args.size() > 4 && !args[4].isEmpty()) {
+        QString error;
+        if (!export_federated_csv(report, args[4], error)) {
+            out() << "export failed: " << error << Qt::endl;
+            return 1;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
+
+// migrations, then every deferred step right away instead of in the background
+int migrate(const QStringList& args) {
+    QString dbPath = args.value(2, "store.db");
+    if (!start_db(dbPath)) {
+        out() << "migration failed, see the log" << Qt::endl;
+        return 1;
+    }
+
+    QElapsedTimer copyTimer;
+    copyTimer.start();
+    while (!copy_typed_transactions(20000)) {}
+    out() << "table copies done in " << copyTimer.elapsed() << " ms" << Qt::endl;
+
+    int failed = 0;
+    for (const QString& name : pending_index_builds()) {
+        qint64 elapsedMs = 0;
+        QString message;
+        if (build_index(dbPath, name, elapsedMs, message)) {
+            out() << "built " << name << " in " << elapsedMs << " ms" << Qt::endl;
+        } else {
+            out() << "building " << name << " failed: " << message << Qt::endl;
+            ++failed;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while (!backfill_sale_items(20000)) {}
+    while (!index_pending_transactions(20000)) {}
+    out() << "backfills done in " << timer.elapsed() << " ms" << Qt::endl;
+
+    out() << migrations_report();
+    close_db();
+    return failed > 0 ? 1 : 0;
+}
+
+
+// the running valuation, its daily closes, and a full scan to check it against
+int stock_value(const QStringList& args) {
+    if (!start_db(args.value(2, "store.db"))) {
+        out() << "cannot open database" << Qt::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Valuation valuation = current_valuation();
+    qint64 runningMs = timer.restart();
+    Valuation scanned = scanned_valuation();
+    qint64 scanMs = timer.elapsed();
+
+    for (const CategoryValuation& category : valuation.categories) {
+        out() << QString("%1  %2 units  %3 cost  %4 retail")
+                     .arg(category.category, -20)
+                     .arg(category.units, 8)
+                     .arg(category.cost, 14, 'f', 2)
+                     .arg(category.retail, 14, 'f', 2)
+              << Qt::endl;
+    }
+    out() << QString("%1  %2 units  %3 cost  %4 retail")
+                 .arg("Total", -20)
+                 .arg(valuation.units, 8)
+                 .arg(valuation.cost, 14, 'f', 2)
+                 .arg(valuation.retail, 14, 'f', 2)
+          << Qt::endl;
+    out() << "running sums read in " << runningMs << " ms, full scan " << scanMs << " ms" << Qt::endl;
+
+    for (const ValuationSnapshot& snapshot : valuation_history(14)) {
+        out() << snapshot.day.toString("yyyy-MM-dd") << "  closed at "
+              << QString::number(snapshot.cost, 'f', 2) << " cost, "
+              << QString::number(snapshot.retail, 'f', 2) << " retail" << Qt::endl;
+    }
+    close_db();
+
+    bool drifted = valuation.units != scanned.units
+                   || qAbs(valuation.cost - scanned.cost) > 0.01
+                   || qAbs(valuation.retail - scanned.retail) > 0.01;
+    if (drifted) {
+        out() << "running sums differ from the scan: " << scanned.units << " units, "
+              << QString::number(scanned.cost, 'f', 2) << " cost, "
+              << QString::number(scanned.retail, 'f', 2) << " retail" << Qt::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+// a recorded register session against a copy of a database, with latency percentiles per operation
+int replay(const QStringList& args) {
+    if (args.size() < 3) {
+        out() << "usage: --replay <session log> [db] [--paced]" << Qt::endl;
+        return 2;
+    }
+    const bool paced = args.contains("--paced");
+    QStringList positional = args.mid(2);
+    positional.removeAll("--paced");
+
+    ReplayReport report = replay_session(positional.value(0), positional.value(1, "store.db"), paced);
+    out() << replay_report_text(report);
+    return report.error.isEmpty() ? 0 : 1;
+}
+
+
+// the API without a window; checkouts run on the main thread, as they would on the register's
+int api_server(const QStringList& args) {
+    if (!start_db(args.value(2, "store.db"))) {
+        out() << "cannot open database" << Qt::endl;
+        return 1;
+    }
+    const QString address = args.value(3, default_api_address().isEmpty() ? QString("127.0.0.1:8765")
+                                                                          : default_api_address());
+    ApiServer server(QSqlDatabase::database().databaseName(), QCoreApplication::instance(),
+                     [](const QString& client, const QVector<ApiLine>& lines) {
+        QList<SaleLine> sold;
+        return price_and_checkout(client, lines, sold);
+    });
+    if (!server.start(address)) return 1;
+    out() << "serving on " << address << Qt::endl;
+
+    const int code = QCoreApplication::exec();
+    close_db();
+    return code;
+}
+
+struct BenchConnection {
+    QVector<double> latencies;
+    int errors = 0;
+};
+
+// one keep-alive client sending the same request back to back
+BenchConnection bench_connection(const QString& host, quint16 port, const QByteArray& request, qint64 durationMs) {
+    BenchConnection result;
+    QTcpSocket socket;
+    QElapsedTimer clock;
+    clock.start();
+    while (clock.elapsed() < durationMs) {
+        if (socket.state() != QAbstractSocket::ConnectedState) {
+            socket.abort();
+            socket.connectToHost(host, port);
+            if (!socket.waitForConnected(2000)) {
+                ++result.errors;
+                QThread::msleep(100);
+                continue;
+            }
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        socket.write(request);
+        QByteArray response;
+        bool complete = false;
+        while (!complete && socket.waitForReadyRead(5000)) {
+            response += socket.readAll();
+            complete = response.endsWith("0\r\n\r\n");     // last chunk
+        }
+        if (!complete || !response.startsWith("HTTP/1.1 200")) {
+            ++result.errors;
+            socket.abort();
+            continue;
+        }
+        result.latencies.append(timer.nsecsElapsed() / 1e6);
+    }
+    return result;
+}
+
+// load for a running --api-server (or register with STOCKING_API): requests/s and latency percentiles
+int api_bench(const QStringList& args) {
+    const QString address = args.value(2, "127.0.0.1:8765");
+    const int seconds = qMax(1, args.value(3, "10").toInt());
+    const int connections = qMax(1, args.value(4, "8").toInt());
+    const QString path = args.value(5, "/api/products?q=a&limit=50");
+
+    const int colon = address.lastIndexOf(':');
+    const QString host = colon > 0 ? address.left(colon) : QString("127.0.0.1");
+    const quint16 port = address.mid(colon + 1).toUShort();
+    QByteArray request = "GET " + path.toUtf8() + " HTTP/1.1\r\nHost: " + address.toUtf8() + "\r\n";
+    const QByteArray token = qgetenv("STOCKING_API_TOKEN");
+    if (!token.isEmpty()) request += "Authorization: Bearer " + token + "\r\n";
+    request += "\r\n";
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(connections);
+    QVector<QFuture<BenchConnection>> clients;
+    for (int i = 0; i < connections; ++i) {
+        clients.append(QtConcurrent::run(&pool, [host, port, request, seconds]() {
+            return bench_connection(host, port, request, seconds * 1000);
+        }));
+    }
+
+    QVector<double> latencies;
+    int errors = 0;
+    for (QFuture<BenchConnection>& client : clients) {
+        const BenchConnection result = client.result();
+        latencies += result.latencies;
+        errors += result.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    // nearest rank
+    auto percentile = [&latencies](double p) {
+        if (latencies.isEmpty()) return 0.0;
+        const int rank = int(std::ceil(p * latencies.size()));
+        return latencies[qBound(0, rank - 1, latencies.size() - 1)];
+    };
+    out() << path << " on " << address << ", " << connections << " connections, " << seconds << " s" << Qt::endl;
+    out() << QString("%1 requests  %2 req/s  %3 errors").arg(latencies.size())
+                 .arg(double(latencies.size()) / seconds, 0, 'f', 1).arg(errors) << Qt::endl;
+    out() << QString("p50 %1 ms  p90 %2 ms  p99 %3 ms  max %4 ms")
+                 .arg(percentile(0.50), 0, 'f', 3)
+                 .arg(percentile(0.90), 0, 'f', 3)
+                 .arg(percentile(0.99), 0, 'f', 3)
+                 .arg(latencies.isEmpty() ? 0.0 : latencies.last(), 0, 'f', 3) << Qt::endl;
+    return latencies.isEmpty() || errors > 0 ? 1 : 0;
+}
+
+
+// every registered statement explained against a generated store; non zero when one scans or sorts undeclared
+int check_plans(const QStringList& args) {
+    const bool verbose = args.contains("--verbose");
+    QStringList positional = args.mid(2);
+    positional.removeAll("--verbose");
+    const int products = positional.value(0, "20000").toInt();
+    const int sales = positional.value(1, "100000").toInt();
+
+    PlanReport report = check_query_plans(products, sales);
+    out() << plan_report_text(report, verbose);
+    return report.error.isEmpty() && report.failures == 0 ? 0 : 1;
+}
+
+}
+
+bool is_cli_tool(int argc, char* argv[]) {
+    return argc > 1 && QString(argv[1]).startsWith("--");
+}
+
+bool cli_tool_needs_gui(int argc, char* argv[]) {
+    return argc > 1 && QString(argv[1]) == "--replay";
+}
+
+int run_cli_tool(const QStringList& args) {
+    const QString tool = args.value(1);
+
+    if (tool == "--stress-registers") return stress_registers(args);
+    if (tool == "--stress-worker") return stress_worker(args);
+    if (tool == "--aggregator") return run_aggregator(args);
+    if (tool == "--stock-at") return stock_at(args);
+    if (tool == "--rebuild-search") return rebuild_search(args);
+    if (tool == "--backup") return backup(args);
+    if (tool == "--restore-backup") return restore(args);
+    if (tool == "--import-products") return import_products(args);
+    if (tool == "--stores-report") return stores_report(args);
+    if (tool == "--migrate") return migrate(args);
+    if (tool == "--stock-value") return stock_value(args);
+    if (tool == "--replay") return replay(args);
+    if (tool == "--api-server") return api_server(args);
+    if (tool == "--api-bench") return api_bench(args);
+    if (tool == "--check-plans") return check_plans(args);
+
+    out() << "unknown option " << tool << Qt::endl
+          << "options:" << Qt::endl
+          << "  --stress-registers [max registers] [sales per register]" << Qt::endl
+          << "  --aggregator [db] [server name]" << Qt::endl
+          << "  --stock-at <db> <yyyy-MM-dd[ HH:mm:ss]>" << Qt::endl
+          << "  --rebuild-search <db>" << Qt::endl
+          << "  --backup [db] [backup dir]" << Qt::endl
+          << "  --restore-backup <backup file> [db]" << Qt::endl
+          << "  --import-products <csv file> [db]" << Qt::endl
+          << "  --stores-report <from> <to> [csv file] [db]" << Qt::endl
+          << "  --migrate [db]" << Qt::endl
+          << "  --stock-value [db]" << Qt::endl
+          << "  --replay <session log> [db] [--paced]" << Qt::endl
+          << "  --api-server [db] [host:port]" << Qt::endl
+          << "  --api-bench [host:port] [seconds] [connections] [path]" << Qt::endl
+          << "  --check-plans [products] [sales] [--verbose]" << Qt::endl;
+    return 2;
+}
@@ -0,0 +1,14 @@
+#ifndef CLI_TOOLS_H
+#define CLI_TOOLS_H
+
+#include <QStringList>
+
+// Headless modes of the executable (stress runs, stand-in processes, ...).
+// They run under a QCoreApplication, before any window is created; the ones
+// that render invoices need a QApplication (QT_QPA_PLATFORM=offscreen works).
+
+bool is_cli_tool(int argc, char* argv[]);
+bool cli_tool_needs_gui(int argc, char* argv[]);
+int run_cli_tool(const QStringList& args);
+
+#endif // CLI_TOOLS_H
@@ -0,0 +1,248 @@
+#include "db_backup.h"
+#include "app_metrics.h"
+#include <QDateTime>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentRun>
+#include <atomic>
+#include <functional>
+
+namespace {
+
+const QByteArray magic = "STKBAK1";
+const qint64 blockSize = 1 << 20;
+const QString backupPattern = "store-*.sqlite.qz";
+
+std::atomic<int> running{0};
+
+// connections are per thread, so every caller gets its own name
+QString connection_name(const QString& purpose) {
+    return QString("%1_%2").arg(purpose).arg(quintptr(QThread::currentThreadId()));
+}
+
+bool run_on(const QString& path, const QString& purpose, const std::function<bool(QSqlQuery&)>& work, QString& message) {
+    const QString name = connection_name(purpose);
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+        db.setDatabaseName(path);
+        if (!db.open()) {
+            message = db.lastError().text();
+        } else {
+            QSqlQuery query(db);
+            query.exec("PRAGMA busy_timeout = 5000");
+            ok = work(query);
+            if (!ok && message.isEmpty()) message = query.lastError().text();
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(name);
+    return ok;
+}
+
+bool integrity_ok(const QString& path, QString& message) {
+    return run_on(path, "backup_check", [&message](QSqlQuery& query) {
+        if (!query.exec("PRAGMA integrity_check") || !query.next()) return false;
+        QString result = query.value(0).toString();
+        if (result != "ok") message = "integrity check: " + result;
+        return result == "ok";
+    }, message);
+}
+
+bool compress_file(const QString& from, const QString& to, qint64& written, QString& message) {
+    QFile in(from);
+    QSaveFile out(to);
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly)) {
+        message = "cannot open " + (in.isOpen() ? to : from);
+        return false;
+    }
+
+    QDataStream stream(&out);
+    stream.writeRawData(magic.constData(), magic.size());
+    while (!in.atEnd()) {
+        stream << qCompress(in.read(blockSize), 6);
+    }
+    stream << QByteArray();     // end marker
+
+    if (stream.status() != QDataStream::Ok || !out.commit()) {
+        message = "cannot write " + to;
+        return false;
+    }
+    written = QFileInfo(to).size();
+    return true;
+}
+
+bool decompress_file(const QString& from, const QString& to, QString& message) {
+    QFile in(from);
+    QFile out(to);
+    if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        message = "cannot open " + (in.isOpen() ? to : from);
+        return false;
+    }
+    if (in.read(magic.size()) != magic) {
+        message = from + " is not a store backup";
+        return false;
+    }
+
+    QDataStream stream(&in);
+    forever {
+        QByteArray block;
+        stream >> block;
+        if (stream.status() != QDataStream::Ok) {
+            message = from + " is truncated";
+            return false;
+        }
+        if (block.isEmpty()) return true;
+
+        QByteArray data = qUncompress(block);
+        if (data.isEmpty() || out.write(data) != data.size()) {
+            message = from + " is corrupt";
+            return false;
+        }
+    }
+}
+
+void rotate(const QString& backupDir, int keep) {
+    QDir dir(backupDir);
+    // names carry a sortable utc stamp, newest first
+    QStringList backups = dir.entryList({backupPattern}, QDir::Files, QDir::Name | QDir::Reversed);
+    for (int i = keep; i < backups.size(); ++i) {
+        dir.remove(backups[i]);
+    }
+}
+
+}
+
+QString default_backup_dir() {
+    QString dir = qEnvironmentVariable("STOCKING_BACKUP_DIR");
+    return dir.isEmpty() ? QStringLiteral("backups") : dir;
+}
+
+bool backup_in_progress() {
+    return running.load() > 0;
+}
+
+BackupResult backup_database(const QString& dbPath, const QString& backupDir, int keep) {
+    struct Running {
+        Running() { ++running; }
+        ~Running() { --running; }
+    } guard;
+
+    BackupResult result;
+    QElapsedTimer total;
+    total.start();
+
+    if (!QDir().mkpath(backupDir)) {
+        result.message = "cannot create " + backupDir;
+        return result;
+    }
+
+    QString stamp = QDateTime::currentDateTimeUtc().toString("yyyyMMdd-HHmmss");
+    QString copy = QDir(backupDir).filePath(QString("store-%1.sqlite.tmp").arg(stamp));
+    result.file = QDir(backupDir).filePath(QString("store-%1.sqlite.qz").arg(stamp));
+    QFile::remove(copy);
+
+    QElapsedTimer step;
+    step.start();
+    bool copied = run_on(dbPath, "backup", [&copy](QSqlQuery& query) {
+        query.prepare("VACUUM INTO ?");
+        query.addBindValue(copy);
+        return query.exec();
+    }, result.message);
+    record_timing("backup copy", step.elapsed());
+
+    if (copied) {
+        result.bytes = QFileInfo(copy).size();
+        step.restart();
+        copied = integrity_ok(copy, result.message);
+        record_timing("backup verify", step.elapsed());
+    }
+    if (copied) {
+        step.restart();
+        result.ok = compress_file(copy, result.file, result.compressedBytes, result.message);
+        record_timing("backup compress", step.elapsed());
+    }
+    QFile::remove(copy);
+
+    if (result.ok) rotate(backupDir, keep);
+
+    result.elapsedMs = total.elapsed();
+    record_timing(result.ok ? "backup" : "backup failed", result.elapsedMs);
+    return result;
+}
+
+QString restore_backup(const QString& backupFile, const QString& dbPath) {
+    QString message;
+    QString restored = dbPath + ".restore";
+
+    if (!decompress_file(backupFile, restored, message) || !integrity_ok(restored, message)) {
+        QFile::remove(restored);
+        return message;
+    }
+
+    QString previous = dbPath + ".before-restore";
+    QFile::remove(previous);
+    if (QFile::exists(dbPath) && !QFile::rename(dbPath, previous)) {
+        QFile::remove(restored);
+        return "cannot move " + dbPath + " aside, is a register still running?";
+    }
+    // the old WAL belongs to the old file and must not be replayed into the backup
+    QFile::remove(dbPath + "-wal");
+    QFile::remove(dbPath + "-shm");
+
+    if (!QFile::rename(restored, dbPath)) {
+        QFile::rename(previous, dbPath);
+        return "cannot move the restored database into place";
+    }
+    return QString();
+}
+
+//=====================================================================================================================
+
+BackupScheduler::BackupScheduler(const QString& dbPath, const QString& backupDir, int intervalHours, QObject* parent)
+    : QObject(parent)
+    , dbPath(dbPath)
+    , backupDir(backupDir)
+    , intervalHours(qMax(1, intervalHours))
+    , timer(new QTimer(this))
+{
+    timer->setInterval(this->intervalHours * 3600 * 1000);
+    connect(timer, &QTimer::timeout, this, &BackupScheduler::run_now);
+    connect(&watcher, &QFutureWatcher<BackupResult>::finished, this, [this]() {
+        BackupResult result = watcher.result();
+        if (result.ok) {
+            qDebug() << "Backup written:" << result.file << result.elapsedMs << "ms"
+                     << result.bytes << "->" << result.compressedBytes << "bytes";
+        } else {
+            qDebug() << "Backup failed:" << result.message;
+        }
+        emit finished(result);
+    });
+}
+
+void BackupScheduler::start() {
+    timer->start();
+
+    QStringList backups = QDir(backupDir).entryList({backupPattern}, QDir::Files, QDir::Name | QDir::Reversed);
+    QDateTime newest = backups.isEmpty() ? QDateTime()
+                                         : QFileInfo(QDir(backupDir).filePath(backups.first())).lastModified();
+    if (!newest.isValid() || newest.secsTo(QDateTime::currentDateTime()) > intervalHours * 3600) {
+        run_now();
+    }
+}
+
+void BackupScheduler::run_now() {
+    if (watcher.isRunning()) return;
+    QString path = dbPath, dir = backupDir;
+    watcher.setFuture(QtConcurrent::run([path, dir]() { return backup_database(path, dir); }));
+}
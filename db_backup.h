@@ -0,0 +1,58 @@
+#ifndef DB_BACKUP_H
+#define DB_BACKUP_H
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QString>
+
+class QTimer;
+
+struct BackupResult {
+    bool ok = false;
+    QString file;
+    QString message;
+    qint64 elapsedMs = 0;
+    qint64 bytes = 0;               // uncompressed database copy
+    qint64 compressedBytes = 0;
+};
+
+// Online backups of the store database. The copy is made with VACUUM INTO on
+// a separate connection: in WAL mode that is a single read transaction, so
+// registers keep committing while it runs. The copy is integrity checked,
+// then written as zlib compressed blocks (store-<utc stamp>.sqlite.qz) and
+// only the newest `keep` backups are kept.
+
+QString default_backup_dir();       // STOCKING_BACKUP_DIR or ./backups
+bool backup_in_progress();
+
+// blocking, safe to call from any thread
+BackupResult backup_database(const QString& dbPath, const QString& backupDir, int keep = 10);
+
+// replaces dbPath with the backup; only with every register closed.
+// The current file is kept as <dbPath>.before-restore. Returns an error or "".
+QString restore_backup(const QString& backupFile, const QString& dbPath);
+
+// Runs backup_database() on the thread pool every `intervalHours`, and right
+// away on start() when the newest backup is older than that.
+class BackupScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    BackupScheduler(const QString& dbPath, const QString& backupDir, int intervalHours, QObject* parent = nullptr);
+
+    void start();
+    void run_now();
+
+signals:
+    void finished(const BackupResult& result);
+
+private:
+    QString dbPath;
+    QString backupDir;
+    int intervalHours;
+    QTimer* timer;
+    QFutureWatcher<BackupResult> watcher;
+};
+
+#endif // DB_BACKUP_H
@@ -0,0 +1,185 @@
+#include "db_concurrency.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QSysInfo>
+#include <QThread>
+
+namespace {
+
+QMutex metricsMutex;
+RegisterMetrics metrics;
+
+// milliseconds sqlite itself waits on a locked database before returning BUSY
+const int busyTimeoutMs = 200;
+
+// the window does not repaint while a write on the GUI thread waits
+const int guiMaxAttempts = 2;
+const int guiMaxWaitMs = 500;
+
+// the error a body handed back through tx_failed_on(), per attempt
+thread_local QSqlError bodyError;
+
+bool on_gui_thread() {
+    QCoreApplication* app = QCoreApplication::instance();
+    return app && app->inherits("QGuiApplication") && QThread::currentThread() == app->thread();
+}
+
+int backoff_delay(const RetryPolicy& policy, int attempt) {
+    // exponential backoff with full jitter, so registers that collided once
+    // don't keep colliding in lockstep
+    int ceiling = policy.baseDelayMs << qMin(attempt, 10);
+    ceiling = qMin(ceiling, policy.maxDelayMs);
+    return 1 + QRandomGenerator::global()->bounded(qMax(ceiling, 1));
+}
+
+}
+
+void configure_connection(QSqlDatabase db) {
+    QSqlQuery query(db);
+    // WAL lets readers (history, item list) keep going while a register commits
+    if (!query.exec("PRAGMA journal_mode = WAL")) {
+        qDebug() << "Could not enable WAL:" << query.lastError();
+    }
+    query.exec("PRAGMA synchronous = NORMAL");
+    query.exec(QString("PRAGMA busy_timeout = %1").arg(busyTimeoutMs));
+}
+
+bool is_busy_error(const QSqlError& error) {
+    if (error.type() == QSqlError::NoError) return false;
+
+    // primary result codes, the extended ones (eg. SQLITE_BUSY_SNAPSHOT) share the low byte
+    bool ok;
+    int code = error.nativeErrorCode().toInt(&ok);
+    if (ok) {
+        code &= 0xff;
+        return code == 5 /* SQLITE_BUSY */ || code == 6 /* SQLITE_LOCKED */;
+    }
+    return error.databaseText().contains("locked", Qt::CaseInsensitive);
+}
+
+TxStatus tx_failed_on(const QSqlQuery& statement) {
+    bodyError = statement.lastError();
+    return TxStatus::Error;
+}
+
+TxResult run_write_transaction(const TxBody& body, const RetryPolicy& requested, QSqlDatabase db) {
+    TxResult result;
+    QElapsedTimer total;
+    total.start();
+
+    RetryPolicy policy = requested;
+    if (policy.capOnGuiThread && on_gui_thread()) {
+        policy.maxAttempts = qMin(policy.maxAttempts, guiMaxAttempts);
+        policy.maxWaitMs = qMin(policy.maxWaitMs, guiMaxWaitMs);
+    }
+
+    QSqlQuery control(db);
+    QSqlQuery query(db);
+
+    for (int attempt = 0; attempt < policy.maxAttempts; ++attempt) {
+        result.attempts = attempt + 1;
+        bool busy = false;
+
+        if (!control.exec("BEGIN IMMEDIATE")) {
+            busy = is_busy_error(control.lastError());
+            if (!busy) {
+                result.outcome = TxOutcome::Failed;
+                result.message = control.lastError().text();
+                break;
+            }
+        } else {
+            QString message;
+            bodyError = QSqlError();
+            TxStatus status = body(query, message);
+
+            if (status == TxStatus::Ok) {
+                if (control.exec("COMMIT")) {
+                    result.outcome = TxOutcome::Committed;
+                    result.message = message;
+                    break;
+                }
+                busy = is_busy_error(control.lastError());
+                if (!busy) result.message = control.lastError().text();
+            } else if (status == TxStatus::Abort) {
+                control.exec("ROLLBACK");
+                result.outcome = TxOutcome::Aborted;
+                result.message = message;
+                break;
+            } else {
+                QSqlError error = bodyError.type() != QSqlError::NoError ? bodyError : query.lastError();
+                busy = is_busy_error(error);
+                result.message = message.isEmpty() ? error.text() : message;
+            }
+
+            control.exec("ROLLBACK");
+            if (!busy) {
+                result.outcome = TxOutcome::Failed;
+                break;
+            }
+        }
+
+        // lost the race for the write lock, back off and try again while
+        // there is time left; otherwise Busy goes back to the caller
+        result.outcome = TxOutcome::Busy;
+        result.message = "The database is busy, another register is writing.";
+        if (attempt + 1 >= policy.maxAttempts) break;
+        int delay = backoff_delay(policy, attempt);
+        if (total.elapsed() + delay + busyTimeoutMs > policy.maxWaitMs) break;
+        {
+            QMutexLocker lock(&metricsMutex);
+            metrics.busyRetries++;
+            metrics.lockWaitMs += delay;
+        }
+        QThread::msleep(delay);
+    }
+
+    result.elapsedMs = total.elapsed();
+
+    QMutexLocker lock(&metricsMutex);
+    switch (result.outcome) {
+    case TxOutcome::Committed: metrics.commits++; break;
+    case TxOutcome::Aborted: metrics.aborts++; break;
+    case TxOutcome::Busy: metrics.busyGiveUps++; break;
+    case TxOutcome::Failed: metrics.failures++; break;
+    }
+    metrics.longestTxMs = qMax(metrics.longestTxMs, result.elapsedMs);
+
+    return result;
+}
+
+QString register_id() {
+    QMutexLocker lock(&metricsMutex);
+    if (metrics.registerId.isEmpty()) {
+        QString id = qEnvironmentVariable("STOCKING_REGISTER_ID");
+        metrics.registerId = id.isEmpty() ? QSysInfo::machineHostName() : id;
+    }
+    return metrics.registerId;
+}
+
+void set_register_id(const QString& id) {
+    QMutexLocker lock(&metricsMutex);
+    metrics.registerId = id;
+}
+
+const RegisterMetrics& register_metrics() {
+    return metrics;
+}
+
+QString register_metrics_report() {
+    QString id = register_id();
+    QMutexLocker lock(&metricsMutex);
+    return QString("register %1: %2 commits, %3 aborts, %4 failures, %5 busy retries, "
+                   "%6 gave up, %7 ms lock wait, longest tx %8 ms")
+        .arg(id)
+        .arg(metrics.commits)
+        .arg(metrics.aborts)
+        .arg(metrics.failures)
+        .arg(metrics.busyRetries)
+        .arg(metrics.busyGiveUps)
+        .arg(metrics.lockWaitMs)
+        .arg(metrics.longestTxMs);
+}
@@ -0,0 +1,72 @@
+#ifndef DB_CONCURRENCY_H
+#define DB_CONCURRENCY_H
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+#include <functional>
+
+// Several registers may share one store.db. Every write goes through
+// run_write_transaction() so it takes the write lock up front (BEGIN IMMEDIATE)
+// and retries with backoff instead of failing on SQLITE_BUSY. On the GUI
+// thread it gives up sooner and returns Busy, the cashier retries.
+
+struct RetryPolicy {
+    int maxAttempts = 8;
+    int baseDelayMs = 4;
+    int maxDelayMs = 250;
+    int maxWaitMs = 2000;       // the whole transaction, sqlite's own busy waits included
+    bool capOnGuiThread = true; // false for startup work nobody could retry, eg. migrations
+};
+
+enum class TxStatus {
+    Ok,      // body finished, commit
+    Abort,   // business rule failed (eg. not enough stock), rollback and stop
+    Error    // sql error, retried if it was a lock conflict
+};
+
+enum class TxOutcome {
+    Committed,
+    Aborted,
+    Busy,
+    Failed
+};
+
+struct TxResult {
+    TxOutcome outcome = TxOutcome::Failed;
+    QString message;
+    int attempts = 0;
+    qint64 elapsedMs = 0;
+};
+
+struct RegisterMetrics {
+    QString registerId;
+    quint64 commits = 0;
+    quint64 aborts = 0;
+    quint64 failures = 0;
+    quint64 busyRetries = 0;     // attempts that hit SQLITE_BUSY / LOCKED
+    quint64 busyGiveUps = 0;     // transactions that ran out of attempts
+    qint64 lockWaitMs = 0;       // time spent sleeping between attempts
+    qint64 longestTxMs = 0;
+};
+
+using TxBody = std::function<TxStatus(QSqlQuery& query, QString& message)>;
+
+void configure_connection(QSqlDatabase db);
+bool is_busy_error(const QSqlError& error);
+
+// a body that fails on a statement of its own rather than `query` returns
+// through this, so a lock on that statement is retried like one on `query`
+TxStatus tx_failed_on(const QSqlQuery& statement);
+
+TxResult run_write_transaction(const TxBody& body,
+                               const RetryPolicy& policy = RetryPolicy(),
+                               QSqlDatabase db = QSqlDatabase::database());
+
+QString register_id();
+void set_register_id(const QString& id);
+const RegisterMetrics& register_metrics();
+QString register_metrics_report();
+
+#endif // DB_CONCURRENCY_H
@@ -0,0 +1,389 @@
+#include "history_model.h"
+#include "memory_budget.h"
+#include "transaction_search.h"
+#include <QDate>
+#include <QDebug>
+#include <QRegularExpression>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTimer>
+#include <cmath>
+
+namespace {
+
+const int pageSize = 200;
+const int debounceMs = 200;
+
+// each of these has an index (index_builds() in schema_migrations.cpp, built
+// by BackgroundMigrations), ORDER BY <expr>, id walks it
+QString sort_expression(int column) {
+    switch (column) {
+    case HistoryModel::IdColumn: return "id";
+    case HistoryModel::NameColumn: return "name COLLATE NOCASE";
+    case HistoryModel::TotalColumn: return "total";
+    case HistoryModel::ExpenseColumn: return "total_expense";
+    case HistoryModel::ProfitColumn: return "(total - total_expense)";
+    default: return "date";
+    }
+}
+
+// a bound below every value of the column, so the first values after the NULL keys are a seek
+QString lowest_value(int column) {
+    return column == HistoryModel::NameColumn || column == HistoryModel::DateColumn ? "''" : "-9e999";
+}
+
+// LIKE 'x%' can use a NOCASE index as long as the pattern has no wildcards before the end
+QString like_prefix(QString text) {
+    text.remove('%');
+    text.remove('_');
+    return text + '%';
+}
+
+bool unfiltered(const HistoryQuery& query) {
+    return query.text.isEmpty() && query.client.isEmpty() && query.product.isEmpty() && query.idMin <= 0
+        && query.idMax == std::numeric_limits<qint64>::max() && !std::isfinite(query.amountMin)
+        && !std::isfinite(query.amountMax) && query.dateFrom.isEmpty() && query.dateTo.isEmpty();
+}
+
+// "2024", "2024-03" or "2024-03-05" -> [start, end) as sqlite timestamps
+bool date_bounds(const QString& text, QString& start, QString& end) {
+    QDate from, to;
+    if ((from = QDate::fromString(text, "yyyy-MM-dd")).isValid()) {
+        to = from.addDays(1);
+    } else if ((from = QDate::fromString(text, "yyyy-MM")).isValid()) {
+        to = from.addMonths(1);
+    } else if ((from = QDate::fromString(text, "yyyy")).isValid()) {
+        to = from.addYears(1);
+    } else {
+        return false;
+    }
+    start = from.toString("yyyy-MM-dd") + " 00:00:00";
+    end = to.toString("yyyy-MM-dd") + " 00:00:00";
+    return true;
+}
+
+}
+
+HistoryQuery HistoryQuery::parse(const QString& text) {
+    static const QRegularExpression spaceRe("\\s+");
+
+    HistoryQuery query;
+    QStringList words;
+    QStringList clientWords;
+
+    for (const QString& token : text.split(spaceRe, Qt::SkipEmptyParts)) {
+        QString lower = token.toLower();
+
+        if (lower.startsWith("client:")) {
+            clientWords << token.mid(7);
+        } else if (lower.startsWith("product:")) {
+            query.product = token.mid(8);
+        } else if (lower.startsWith("id:")) {
+            QStringList range = token.mid(3).split('-');
+            if (!range.value(0).isEmpty()) query.idMin = range.value(0).toLongLong();
+            if (range.size() == 1) query.idMax = query.idMin;
+            else if (!range.value(1).isEmpty()) query.idMax = range.value(1).toLongLong();
+        } else if (lower.startsWith("amount:")) {
+            QStringList range = token.mid(7).split('-');
+            if (!range.value(0).isEmpty()) query.amountMin = range.value(0).toDouble();
+            if (range.size() == 1) query.amountMax = query.amountMin;
+            else if (!range.value(1).isEmpty()) query.amountMax = range.value(1).toDouble();
+        } else if (lower.startsWith("date:")) {
+            QStringList range = token.mid(5).split("..");
+            QString start, end;
+            if (date_bounds(range.value(0), start, end)) {
+                query.dateFrom = start;
+                query.dateTo = end;
+            }
+            if (range.size() > 1 && date_bounds(range.value(1), start, end)) {
+                query.dateTo = end;
+            }
+        } else {
+            words << token;
+        }
+    }
+
+    query.text = words.join(' ');
+    query.client = clientWords.join(' ');
+    return query;
+}
+
+//=====================================================================================================================
+
+HistoryModel::HistoryModel(QObject* parent)
+    : QAbstractTableModel(parent)
+    , debounce(new QTimer(this))
+{
+    debounce->setSingleShot(true);
+    debounce->setInterval(debounceMs);
+    connect(debounce, &QTimer::timeout, this, [this]() { set_query(HistoryQuery::parse(pendingText)); });
+}
+
+int HistoryModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int HistoryModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant HistoryModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+
+    const Row& row = rows[index.row()];
+    switch (index.column()) {
+    case IdColumn: return QString("%1").arg(row.id, 8, 10, QChar('0'));
+    case NameColumn: return row.name;
+    case DateColumn: return row.date;
+    case TotalColumn: return QString::number(row.total, 'f', 2);
+    case ExpenseColumn: return QString::number(row.expense, 'f', 2);
+    case ProfitColumn: return QString::number(row.total - row.expense, 'f', 2);
+    }
+    return QVariant();
+}
+
+QVariant HistoryModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    static const QStringList labels = {"ID", "Name", "Time", "Total Sold", "Total Expenss", "Net Profit"};
+    return labels.value(section);
+}
+
+bool HistoryModel::canFetchMore(const QModelIndex& parent) const {
+    return !parent.isValid() && !exhausted;
+}
+
+void HistoryModel::fetchMore(const QModelIndex& parent) {
+    if (parent.isValid() || exhausted) return;
+
+    HistoryPage next = next_page();
+    QVector<Row> page;
+    page.reserve(pageSize);
+    bool ok = load_page(next, page);
+    if (ok && page.size() < pageSize && next.other_range_follows()) {
+        next.crossNulls = true;
+        next.limit = pageSize - page.size();
+        ok = load_page(next, page);
+    }
+    if (!ok) {
+        exhausted = true;
+        return;
+    }
+    exhausted = page.size() < pageSize;
+    if (page.isEmpty()) return;
+
+    beginInsertRows(QModelIndex(), rows.size(), rows.size() + page.size() - 1);
+    rows += page;
+    endInsertRows();
+}
+
+HistoryPage HistoryModel::next_page() const {
+    HistoryPage page;
+    page.query = query;
+    page.sortColumn = sortColumn;
+    page.order = sortOrder;
+    page.ranked = ranked();
+    page.offset = rows.size();
+    page.limit = pageSize;
+    if (!rows.isEmpty()) {
+        page.hasCursor = true;
+        page.cursorKey = rows.last().sortKey;
+        page.cursorId = rows.last().id;
+    }
+    return page;
+}
+
+bool HistoryModel::load_page(const HistoryPage& page, QVector<Row>& into) const {
+    QVariantList binds;
+    QSqlQuery sql;
+    sql.setForwardOnly(true);
+    sql.prepare(page.sql(binds));
+    for (const QVariant& value : binds) sql.addBindValue(value);
+
+    if (!sql.exec()) {
+        qDebug() << "History page query failed:" << sql.lastError();
+        return false;
+    }
+    while (sql.next()) {
+        Row row;
+        row.id = sql.value(0).toInt();
+        row.name = sql.value(1).toString();
+        row.date = sql.value(2).toString();
+        row.total = sql.value(3).toDouble();
+        row.expense = sql.value(4).toDouble();
+        row.sortKey = sql.value(5);
+        into.append(row);
+    }
+    return true;
+}
+
+void HistoryModel::sort(int column, Qt::SortOrder order) {
+    if (column == sortColumn && order == sortOrder && !rankByRelevance && !rows.isEmpty()) return;
+    sortColumn = column;
+    sortOrder = order;
+    rankByRelevance = false;
+    reload();
+}
+
+void HistoryModel::set_query_text(const QString& text) {
+    pendingText = text;
+    debounce->start();
+}
+
+void HistoryModel::set_query(const HistoryQuery& next) {
+    if (next.text != query.text) rankByRelevance = true;
+    query = next;
+    reload();
+}
+
+void HistoryModel::reload() {
+    beginResetModel();
+    rows.clear();
+    rows.squeeze();
+    exhausted = false;
+    endResetModel();
+    fetchMore(QModelIndex());
+}
+
+void HistoryModel::sale_added(int id, const QString& client, const QString& date, double total, double expense) {
+    const bool newestFirst = sortOrder == Qt::DescendingOrder && (sortColumn == DateColumn || sortColumn == IdColumn);
+    if (!newestFirst || !unfiltered(query)) {
+        reload();
+        return;
+    }
+
+    Row row;
+    row.id = id;
+    row.name = client;
+    row.date = date;
+    row.total = total;
+    row.expense = expense;
+    row.sortKey = sortColumn == IdColumn ? QVariant(id) : QVariant(date);
+    beginInsertRows(QModelIndex(), 0, 0);
+    rows.prepend(row);
+    endInsertRows();
+}
+
+qint64 HistoryModel::footprint() const {
+    qint64 bytes = qint64(rows.capacity()) * sizeof(Row);
+    for (const Row& row : rows) bytes += string_bytes(row.name) + string_bytes(row.date);
+    return bytes;
+}
+
+qint64 HistoryModel::trim(qint64 bytes) {
+    if (rows.size() <= pageSize) return 0;
+    const qint64 before = footprint();
+    const qint64 perRow = before / rows.size();
+    const int keep = int(qMax<qint64>(pageSize, rows.size() - bytes / qMax<qint64>(perRow, 1) - 1));
+
+    // the keyset cursor is the last row kept, so the next fetchMore() continues from there
+    beginRemoveRows(QModelIndex(), keep, rows.size() - 1);
+    rows.resize(keep);
+    rows.squeeze();
+    exhausted = false;
+    endRemoveRows();
+    return before - footprint();
+}
+
+int HistoryModel::transaction_id(int row) const {
+    return row >= 0 && row < rows.size() ? rows[row].id : -1;
+}
+
+bool HistoryModel::ranked() const {
+    return rankByRelevance && !query.text.isEmpty() && transaction_search_available();
+}
+
+QString HistoryPage::sql(QVariantList& binds) const {
+    QStringList where;
+
+    if (!query.text.isEmpty()) {
+        if (!transaction_search_available()) {
+            where << "name LIKE ?";
+            binds << like_prefix(query.text);
+        } else if (ranked) {
+            where << "transactions_fts MATCH ?";
+            binds << fts_match_expression(query.text);
+        } else {
+            where << "id IN (SELECT rowid FROM transactions_fts WHERE transactions_fts MATCH ?)";
+            binds << fts_match_expression(query.text);
+        }
+    }
+    if (!query.client.isEmpty()) {
+        where << "name LIKE ?";
+        binds << like_prefix(query.client);
+    }
+    if (!query.product.isEmpty()) {
+        where << "id IN (SELECT transaction_id FROM transaction_items WHERE name LIKE ?)";
+        binds << like_prefix(query.product);
+    }
+    if (query.idMin > 0) {
+        where << "id >= ?";
+        binds << query.idMin;
+    }
+    if (query.idMax < std::numeric_limits<qint64>::max()) {
+        where << "id <= ?";
+        binds << query.idMax;
+    }
+    if (std::isfinite(query.amountMin)) {
+        where << "total >= ?";
+        binds << query.amountMin;
+    }
+    if (std::isfinite(query.amountMax)) {
+        where << "total <= ?";
+        binds << query.amountMax;
+    }
+    if (!query.dateFrom.isEmpty()) {
+        where << "date >= ?";
+        binds << query.dateFrom;
+    }
+    if (!query.dateTo.isEmpty()) {
+        where << "date < ?";
+        binds << query.dateTo;
+    }
+
+    if (ranked) {
+        // bm25 rank has no index to seek on, so relevance pages use OFFSET
+        return QString("SELECT id, name, date, total, total_expense, NULL "
+                       "FROM transactions_fts JOIN transactions ON transactions.id = transactions_fts.rowid %1 "
+                       "ORDER BY transactions_fts.rank LIMIT %2 OFFSET %3")
+            .arg(where.isEmpty() ? QString() : "WHERE " + where.join(" AND "))
+            .arg(limit)
+            .arg(offset);
+    }
+
+    // keyset cursor: continue right after the last row already loaded
+    const QString expr = sort_expression(sortColumn);
+    const bool descending = order == Qt::DescendingOrder;
+    const QString before = descending ? "<" : ">";
+    bool nullRange = false;
+    if (hasCursor && sortColumn == HistoryModel::IdColumn) {
+        where << "id " + before + " ?";
+        binds << cursorId;
+    } else if (hasCursor && crossNulls) {
+        // sqlite sorts NULL lowest: the NULL keys come last in DESC, first in ASC
+        nullRange = descending;
+        where << (descending ? expr + " IS NULL" : QString("%1 >= %2").arg(expr, lowest_value(sortColumn)));
+    } else if (hasCursor && cursorKey.isNull()) {
+        nullRange = true;
+        where << QString("%1 IS NULL AND id %2 ?").arg(expr, before);
+        binds << cursorId;
+    } else if (hasCursor) {
+        // spelled out: (expr, id) < (?, ?) is no seek on the name and profit indexes
+        where << QString("%1 %2= ? AND (%1 %2 ? OR id %2 ?)").arg(expr, before);
+        binds << cursorKey << cursorKey << cursorId;
+    }
+
+    const QString direction = descending ? "DESC" : "ASC";
+    return QString("SELECT id, name, date, total, total_expense, %1 FROM transactions %2 ORDER BY %3 LIMIT %4")
+        .arg(expr, where.isEmpty() ? QString() : "WHERE " + where.join(" AND "),
+             nullRange ? "id " + direction : QString("%1 %2, id %2").arg(expr, direction))
+        .arg(limit);
+}
+
+bool HistoryPage::other_range_follows() const {
+    // values end before the NULL keys descending, the NULL keys before the values ascending
+    return !ranked && hasCursor && !crossNulls && sortColumn != HistoryModel::IdColumn
+        && (order == Qt::DescendingOrder) != cursorKey.isNull();
+}
@@ -0,0 +1,114 @@
+#ifndef HISTORY_MODEL_H
+#define HISTORY_MODEL_H
+
+#include <QAbstractTableModel>
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+#include <limits>
+
+class QTimer;
+struct HistoryPage;
+
+// What the history search bar asks for. Bare words are a full-text prefix
+// search over client and item names (a client name prefix without fts5).
+//   client:ali  product:velvet  id:150  id:100-200  amount:50-500  amount:100-
+//   date:2024-03  date:2024-03-05  date:2024-01-01..2024-03-31
+struct HistoryQuery {
+    QString text;
+    QString client;
+    QString product;
+    qint64 idMin = 0;
+    qint64 idMax = std::numeric_limits<qint64>::max();
+    double amountMin = -std::numeric_limits<double>::infinity();
+    double amountMax = std::numeric_limits<double>::infinity();
+    QString dateFrom;   // inclusive, sqlite timestamp text
+    QString dateTo;     // exclusive
+
+    static HistoryQuery parse(const QString& text);
+};
+
+// Transaction ledger view that never holds more than what was scrolled to.
+// Filters and ORDER BY run in sqlite against indexes, rows arrive a page at a
+// time through fetchMore() using keyset pagination on (sort column, id), and
+// the details json stays in the database until a row is opened.
+// A full-text query is ordered by relevance until a column header is clicked.
+class HistoryModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { IdColumn, NameColumn, DateColumn, TotalColumn, ExpenseColumn, ProfitColumn, ColumnCount };
+
+    explicit HistoryModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    void set_query_text(const QString& text);   // debounced, for textChanged
+    void set_query(const HistoryQuery& query);
+    void reload();
+    // a sale committed here: prepended when the view lists the newest sales
+    // first and unfiltered, otherwise the first page is re-read
+    void sale_added(int id, const QString& client, const QString& date, double total, double expense);
+
+    int transaction_id(int row) const;
+
+    qint64 footprint() const;
+    // drops scrolled-in rows from the end, never the first page; they page back in on scrolling
+    qint64 trim(qint64 bytes);
+
+private:
+    struct Row {
+        int id;
+        QString name;
+        QString date;
+        double total;
+        double expense;
+        QVariant sortKey;   // value of the ORDER BY expression, for the keyset cursor
+    };
+
+    HistoryPage next_page() const;
+    bool load_page(const HistoryPage& page, QVector<Row>& into) const;
+    bool ranked() const;
+
+    QVector<Row> rows;
+    bool exhausted = false;
+    int sortColumn = DateColumn;
+    Qt::SortOrder sortOrder = Qt::DescendingOrder;
+    bool rankByRelevance = true;
+    HistoryQuery query;
+    QString pendingText;
+    QTimer* debounce;
+};
+
+// One page as HistoryModel::fetchMore() runs it, composed from the filters,
+// the sort and the keyset cursor; check_query_plans() explains the same
+// compositions. NULL keys are a range of their own (after every value
+// descending, before them ascending) walked in id order, so each side of
+// the cursor is a single index seek; crossNulls starts the other range once
+// the cursor's is used up.
+struct HistoryPage {
+    HistoryQuery query;
+    int sortColumn = HistoryModel::DateColumn;
+    Qt::SortOrder order = Qt::DescendingOrder;
+    bool ranked = false;        // bm25 relevance, paged with OFFSET
+    int offset = 0;
+    bool hasCursor = false;     // the last row loaded
+    QVariant cursorKey;
+    int cursorId = 0;
+    bool crossNulls = false;
+    int limit = 200;
+
+    QString sql(QVariantList& binds) const;
+    // a short page ended only the cursor's range, the other one may still have rows
+    bool other_range_follows() const;
+};
+
+#endif // HISTORY_MODEL_H
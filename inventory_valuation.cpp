@@ -0,0 +1,146 @@
+#include "inventory_valuation.h"
+#include "query_registry.h"
+#include "db_concurrency.h"
+#include <QDebug>
+#include <QSqlError>
+#include <QStringList>
+
+bool create_inventory_valuation(QSqlQuery& query) {
+    // category 0 holds products without a category
+    const QStringList statements = {
+        R"(CREATE TABLE IF NOT EXISTS stock_valuation (
+               category_id INTEGER PRIMARY KEY,
+               units INTEGER NOT NULL DEFAULT 0,
+               cost_value REAL NOT NULL DEFAULT 0,
+               retail_value REAL NOT NULL DEFAULT 0
+           ))",
+        R"(CREATE TABLE IF NOT EXISTS valuation_snapshots (
+               day TEXT NOT NULL,
+               category_id INTEGER NOT NULL,
+               units INTEGER NOT NULL,
+               cost_value REAL NOT NULL,
+               retail_value REAL NOT NULL,
+               PRIMARY KEY (day, category_id)
+           ) WITHOUT ROWID)",
+
+        R"(CREATE TRIGGER IF NOT EXISTS products_valuation_insert AFTER INSERT ON products
+           BEGIN
+               INSERT OR IGNORE INTO stock_valuation (category_id) VALUES (COALESCE(NEW.category_id, 0));
+               UPDATE stock_valuation
+               SET units = units + NEW.quantity,
+                   cost_value = cost_value + NEW.quantity * NEW.bought,
+                   retail_value = retail_value + NEW.quantity * NEW.price
+               WHERE category_id = COALESCE(NEW.category_id, 0);
+           END)",
+        R"(CREATE TRIGGER IF NOT EXISTS products_valuation_delete AFTER DELETE ON products
+           BEGIN
+               UPDATE stock_valuation
+               SET units = units - OLD.quantity,
+                   cost_value = cost_value - OLD.quantity * OLD.bought,
+                   retail_value = retail_value - OLD.quantity * OLD.price
+               WHERE category_id = COALESCE(OLD.category_id, 0);
+           END)",
+        R"(CREATE TRIGGER IF NOT EXISTS products_valuation_update
+           AFTER UPDATE OF quantity, price, bought, category_id ON products
+           BEGIN
+               UPDATE stock_valuation
+               SET units = units - OLD.quantity,
+                   cost_value = cost_value - OLD.quantity * OLD.bought,
+                   retail_value = retail_value - OLD.quantity * OLD.price
+               WHERE category_id = COALESCE(OLD.category_id, 0);
+               INSERT OR IGNORE INTO stock_valuation (category_id) VALUES (COALESCE(NEW.category_id, 0));
+               UPDATE stock_valuation
+               SET units = units + NEW.quantity,
+                   cost_value = cost_value + NEW.quantity * NEW.bought,
+                   retail_value = retail_value + NEW.quantity * NEW.price
+               WHERE category_id = COALESCE(NEW.category_id, 0);
+           END)",
+
+        // the one full scan, when the sums are first set up
+        "DELETE FROM stock_valuation",
+        R"(INSERT INTO stock_valuation (category_id, units, cost_value, retail_value)
+           SELECT COALESCE(category_id, 0), SUM(quantity), SUM(quantity * bought), SUM(quantity * price)
+           FROM products GROUP BY 1)"
+    };
+
+    for (const QString& sql : statements) {
+        if (!query.exec(sql)) return false;
+    }
+    return true;
+}
+
+namespace {
+
+// rows of (category id, name, units, cost, retail)
+Valuation load_valuation(const QString& sql) {
+    Valuation valuation;
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    if (!query.exec(sql)) {
+        qDebug() << "Loading stock valuation failed:" << query.lastError();
+        return valuation;
+    }
+
+    while (query.next()) {
+        CategoryValuation category;
+        category.categoryId = query.value(0).toInt();
+        category.category = query.value(1).toString();
+        category.units = query.value(2).toLongLong();
+        category.cost = query.value(3).toDouble();
+        category.retail = query.value(4).toDouble();
+        valuation.units += category.units;
+        valuation.cost += category.cost;
+        valuation.retail += category.retail;
+        valuation.categories.append(category);
+    }
+    return valuation;
+}
+
+}
+
+Valuation current_valuation() {
+    return load_valuation(registered_sql(Statement::ValuationCurrent));
+}
+
+Valuation scanned_valuation() {
+    return load_valuation(registered_sql(Statement::ValuationScanned));
+}
+
+bool snapshot_valuation(const QDate& day) {
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+        query.prepare(registered_sql(Statement::ValuationSnapshotClear));
+        query.addBindValue(day.toString(Qt::ISODate));
+        if (!query.exec()) return TxStatus::Error;
+
+        query.prepare(registered_sql(Statement::ValuationSnapshotInsert));
+        query.addBindValue(day.toString(Qt::ISODate));
+        return query.exec() ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Valuation snapshot failed:" << tx.message;
+        return false;
+    }
+    return true;
+}
+
+QVector<ValuationSnapshot> valuation_history(int days) {
+    QVector<ValuationSnapshot> history;
+    QSqlQuery query;
+    query.prepare(registered_sql(Statement::ValuationHistory));
+    query.addBindValue(QDate::currentDate().addDays(-days).toString(Qt::ISODate));
+    if (!query.exec()) {
+        qDebug() << "Loading valuation history failed:" << query.lastError();
+        return history;
+    }
+
+    while (query.next()) {
+        ValuationSnapshot snapshot;
+        snapshot.day = QDate::fromString(query.value(0).toString(), Qt::ISODate);
+        snapshot.units = query.value(1).toLongLong();
+        snapshot.cost = query.value(2).toDouble();
+        snapshot.retail = query.value(3).toDouble();
+        history.append(snapshot);
+    }
+    return history;
+}
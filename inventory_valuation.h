@@ -0,0 +1,47 @@
+#ifndef INVENTORY_VALUATION_H
+#define INVENTORY_VALUATION_H
+
+#include <QDate>
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+
+// Value of the stock on hand, per category, kept as running sums in
+// stock_valuation by triggers on products: every insert, edit, delete and
+// checkout adds its delta, whichever register or code path made it, so
+// reading the totals never scans the catalog.
+// valuation_snapshots keeps the closing values of each day.
+
+struct CategoryValuation {
+    int categoryId = 0;
+    QString category;
+    qint64 units = 0;
+    double cost = 0;        // quantity * bought
+    double retail = 0;      // quantity * price
+};
+
+struct Valuation {
+    qint64 units = 0;
+    double cost = 0;
+    double retail = 0;
+    QVector<CategoryValuation> categories;     // highest cost value first
+};
+
+struct ValuationSnapshot {
+    QDate day;
+    qint64 units = 0;
+    double cost = 0;
+    double retail = 0;
+};
+
+bool create_inventory_valuation(QSqlQuery& query);
+
+Valuation current_valuation();
+// the same figures from a full scan of products, to check the running sums
+Valuation scanned_valuation();
+
+// stores the current sums as `day`'s closing values (replacing an earlier one)
+bool snapshot_valuation(const QDate& day);
+QVector<ValuationSnapshot> valuation_history(int days = 30);   // newest first
+
+#endif // INVENTORY_VALUATION_H
@@ -0,0 +1,133 @@
+#include "invoice_cache.h"
+#include "app_metrics.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QPageLayout>
+#include <QPageSize>
+#include <QPrinter>
+#include <QTextDocument>
+
+namespace {
+
+// bump when render_invoice_pdf() lays pages out differently; the html
+// already covers template and content changes
+const char* const renderVersion = "a4-300dpi-m10-doc20-v1";
+
+qint64 default_max_bytes() {
+    int megabytes = qEnvironmentVariableIntValue("STOCKING_INVOICE_CACHE_MB");
+    return (megabytes > 0 ? megabytes : 200) * qint64(1024 * 1024);
+}
+
+}
+
+QString default_invoice_cache_dir() {
+    return qEnvironmentVariable("STOCKING_INVOICE_CACHE", "invoice_cache");
+}
+
+bool render_invoice_pdf(const QString& html, const QString& path) {
+    QPrinter printer(QPrinter::HighResolution);
+    printer.setOutputFormat(QPrinter::PdfFormat);
+    printer.setResolution(300);
+    printer.setOutputFileName(path);
+
+    QPageLayout layout(QPageSize(QPageSize::A4),
+                       QPageLayout::Portrait,
+                       QMarginsF(10, 10, 10, 10));
+    printer.setPageLayout(layout);
+
+    QTextDocument doc;
+    doc.setDefaultStyleSheet(
+        "table{width:100%;border-collapse:collapse;}"
+        );
+
+    // Feed HTML
+    doc.setHtml(html);
+
+    // Force width in points (A4 = 595 x 842 points @ 72dpi)
+    doc.setPageSize(QSizeF(595, 842));  // width x height in points
+
+    // Add a little padding inside
+    doc.setDocumentMargin(20.0);
+
+    // Print to PDF
+    doc.print(&printer);
+    return QFileInfo(path).size() > 0;
+}
+
+//=====================================================================================================================
+
+InvoiceCache::InvoiceCache()
+    : InvoiceCache(default_invoice_cache_dir(), default_max_bytes())
+{
+}
+
+InvoiceCache::InvoiceCache(const QString& dir, qint64 maxBytes)
+    : dir(dir)
+    , maxBytes(maxBytes)
+{
+}
+
+QString InvoiceCache::key(const QString& html) {
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(QByteArray(renderVersion));
+    hash.addData(QByteArray(1, '\0'));
+    hash.addData(html.toUtf8());
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString InvoiceCache::pdf_for(const QString& html) {
+    if (!scanned) scan();
+
+    const QString path = QDir(dir).filePath(key(html) + ".pdf");
+    QFile cached(path);
+    if (cached.exists() && cached.open(QIODevice::ReadWrite)) {
+        // eviction goes by modification time, so a hit counts as a use
+        cached.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        ++hitCount;
+        return path;
+    }
+    ++missCount;
+
+    if (!QDir().mkpath(dir)) {
+        qDebug() << "Cannot create invoice cache" << dir;
+        return QString();
+    }
+
+    // rendered next to the final name and renamed, so a crash never leaves a half pdf under a valid key
+    QElapsedTimer timer;
+    timer.start();
+    const QString partial = path + ".part";
+    QFile::remove(partial);
+    if (!render_invoice_pdf(html, partial) || !QFile::rename(partial, path)) {
+        qDebug() << "Rendering invoice" << path << "failed";
+        QFile::remove(partial);
+        return QString();
+    }
+    record_timing("invoice pdf render", timer.elapsed());
+
+    totalBytes += QFileInfo(path).size();
+    if (totalBytes > maxBytes) evict();
+    return path;
+}
+
+void InvoiceCache::scan() {
+    scanned = true;
+    totalBytes = 0;
+    const QFileInfoList files = QDir(dir).entryInfoList({"*.pdf"}, QDir::Files);
+    for (const QFileInfo& file : files) totalBytes += file.size();
+}
+
+void InvoiceCache::evict() {
+    // oldest first
+    const QFileInfoList files = QDir(dir).entryInfoList({"*.pdf"}, QDir::Files, QDir::Time | QDir::Reversed);
+    // down to 90% so the next few renders don't evict again
+    for (const QFileInfo& file : files) {
+        if (totalBytes <= maxBytes * 9 / 10) break;
+        if (QFile::remove(file.absoluteFilePath())) totalBytes -= file.size();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef INVOICE_CACHE_H
+#define INVOICE_CACHE_H
+
+#include <QJsonArray>
+#include <QString>
+
+// Rendered invoice PDFs on disk, named by the SHA-256 of what went into them:
+// the invoice html (which already holds the sale, the company and client
+// details and the template itself) plus the page and resolution settings.
+// A reprint with the same inputs is a file copy; editing the template or the
+// company details changes the key, so stale files are never served, they
+// just age out. The directory is kept under maxBytes, least recently used
+// files first.
+//   STOCKING_INVOICE_CACHE      directory, ./invoice_cache by default
+//   STOCKING_INVOICE_CACHE_MB   size bound, 200 by default
+
+QString default_invoice_cache_dir();
+
+// A4, 300 dpi, the layout the invoices always had
+bool render_invoice_pdf(const QString& html, const QString& path);
+
+// the invoice template filled in (stoking_p.cpp)
+QString generateInvoice(const QJsonArray& items, const QString& transactionTime,
+                        const QString& transactionNumber,
+                        const QString& companyName = "Atelier Princesse",
+                        const QString& companyAddress = "123 Rue Example, 31007 oran",
+                        const QString& clientName = "Client Name",
+                        const QString& clientAddress = "Client Address");
+
+class InvoiceCache
+{
+public:
+    InvoiceCache();
+    InvoiceCache(const QString& dir, qint64 maxBytes);
+
+    // path of the cached pdf for this html, rendered first on a miss; "" on failure
+    QString pdf_for(const QString& html);
+
+    static QString key(const QString& html);
+    qint64 size_bytes() const { return totalBytes; }
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+
+private:
+    void scan();
+    void evict();
+
+    QString dir;
+    qint64 maxBytes;
+    qint64 totalBytes = 0;
+    bool scanned = false;
+    int hitCount = 0;
+    int missCount = 0;
+};
+
+#endif // INVOICE_CACHE_H
@@ -1,11 +1,25 @@
 #include "stoking_p.h"
+#include "cli_tools.h"
+#include "app_metrics.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    start_clock();
+
+    if (cli_tool_needs_gui(argc, argv)) {
+        QApplication a(argc, argv);
+        return run_cli_tool(a.arguments());
+    }
+    if (is_cli_tool(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        return run_cli_tool(a.arguments());
+    }
+
     QApplication a(argc, argv);
     stoking_p w;
     w.show();
+    startup_mark("window shown");
     return a.exec();
 }
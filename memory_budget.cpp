@@ -0,0 +1,176 @@
+#include "memory_budget.h"
+#include "app_metrics.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QObject>
+#include <QVector>
+#include <algorithm>
+
+namespace {
+
+struct Cache {
+    FootprintFn footprint;
+    TrimFn trim;
+    quint64 lastUse = 0;
+    quint64 trims = 0;
+    qint64 bytesFreed = 0;
+};
+
+struct ObjectCount {
+    quint64 created = 0;
+    quint64 alive = 0;
+};
+
+QMutex mutex;
+QMap<QString, Cache> caches;
+QMap<QString, ObjectCount> objects;
+quint64 useClock = 0;
+quint64 enforcements = 0;
+
+qint64 read_ceiling() {
+    int megabytes = qEnvironmentVariableIntValue("STOCKING_MEMORY_MB");
+    return megabytes > 0 ? megabytes * qint64(1024 * 1024) : 0;
+}
+
+// VmRSS from /proc where there is one, -1 elsewhere
+qint64 resident_bytes() {
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) return -1;
+    for (const QByteArray& line : status.readAll().split('\n')) {
+        if (line.startsWith("VmRSS:")) return line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+    }
+    return -1;
+}
+
+// the callbacks run without the lock: a trim can emit signals that end up in touch_cache()
+QMap<QString, Cache> snapshot() {
+    QMutexLocker lock(&mutex);
+    return caches;
+}
+
+QString megabytes(qint64 bytes) {
+    return QString::number(double(bytes) / (1024 * 1024), 'f', 2) + " MB";
+}
+
+}
+
+qint64 memory_ceiling() {
+    static const qint64 ceiling = read_ceiling();
+    return ceiling;
+}
+
+bool low_memory_mode() {
+    return memory_ceiling() > 0;
+}
+
+void register_cache(const QString& name, FootprintFn footprint, TrimFn trim) {
+    QMutexLocker lock(&mutex);
+    Cache& cache = caches[name];
+    cache.footprint = std::move(footprint);
+    cache.trim = std::move(trim);
+    cache.lastUse = ++useClock;
+}
+
+void unregister_cache(const QString& name) {
+    QMutexLocker lock(&mutex);
+    caches.remove(name);
+}
+
+void touch_cache(const QString& name) {
+    QMutexLocker lock(&mutex);
+    auto it = caches.find(name);
+    if (it != caches.end()) it->lastUse = ++useClock;
+}
+
+qint64 accounted_bytes() {
+    qint64 total = 0;
+    for (const Cache& cache : snapshot()) total += cache.footprint();
+    return total;
+}
+
+// on the GUI thread, like the caches it trims
+void enforce_memory_budget() {
+    const qint64 ceiling = memory_ceiling();
+    if (ceiling <= 0) return;
+
+    QElapsedTimer timer;
+    timer.start();
+    const QMap<QString, Cache> current = snapshot();
+    qint64 total = 0;
+    QVector<QString> order;
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+        total += it->footprint();
+        if (it->trim) order.append(it.key());
+    }
+    if (total <= ceiling) return;
+
+    // least recently used first; down to 90% so the next few inserts don't trim again
+    std::sort(order.begin(), order.end(), [&current](const QString& a, const QString& b) {
+        return current[a].lastUse < current[b].lastUse;
+    });
+    const qint64 target = ceiling * 9 / 10;
+    for (const QString& name : order) {
+        if (total <= target) break;
+        qint64 freed = current[name].trim(total - target);
+        total -= freed;
+
+        QMutexLocker lock(&mutex);
+        auto it = caches.find(name);
+        if (it == caches.end()) continue;
+        ++it->trims;
+        it->bytesFreed += freed;
+    }
+    {
+        QMutexLocker lock(&mutex);
+        ++enforcements;
+    }
+    if (total > ceiling) qDebug() << "Memory budget:" << megabytes(total) << "still over" << megabytes(ceiling);
+    record_timing("memory budget trim", timer.elapsed());
+}
+
+void track_object(QObject* object, const char* kind) {
+    const QString name = QString::fromLatin1(kind);
+    {
+        QMutexLocker lock(&mutex);
+        ObjectCount& count = objects[name];
+        ++count.created;
+        ++count.alive;
+    }
+    QObject::connect(object, &QObject::destroyed, [name]() {
+        QMutexLocker lock(&mutex);
+        --objects[name].alive;
+    });
+}
+
+QString memory_report() {
+    const qint64 ceiling = memory_ceiling();
+    const qint64 resident = resident_bytes();
+    QString report = QString("Memory (ceiling %1, resident %2):\n")
+                         .arg(ceiling > 0 ? megabytes(ceiling) : QString("none"),
+                              resident >= 0 ? megabytes(resident) : QString("n/a"));
+
+    const QMap<QString, Cache> current = snapshot();
+    qint64 total = 0;
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+        const qint64 bytes = it->footprint();
+        total += bytes;
+        report += QString("  %1  %2  %3\n")
+                      .arg(it.key(), -32)
+                      .arg(megabytes(bytes), 10)
+                      .arg(it->trim ? QString("trimmed %1x, %2 freed").arg(it->trims).arg(megabytes(it->bytesFreed))
+                                    : QString("not trimmable"));
+    }
+
+    QMutexLocker lock(&mutex);
+    report += QString("  %1  %2  %3 budget trims\n").arg("total", -32).arg(megabytes(total), 10).arg(enforcements);
+
+    report += "Objects (created / alive):\n";
+    for (auto it = objects.constBegin(); it != objects.constEnd(); ++it) {
+        report += QString("  %1  %2 / %3\n").arg(it.key(), -32).arg(it->created).arg(it->alive);
+    }
+    return report;
+}
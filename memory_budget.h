@@ -0,0 +1,38 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <QString>
+#include <functional>
+
+class QObject;
+
+// Memory accounting for what a register keeps in memory (diagnostics, F12).
+// Every cache and model registers how to measure itself and, when it can give
+// memory back, how to trim. With STOCKING_MEMORY_MB set (low-memory mode, for
+// the old 2 GB registers) enforce_memory_budget() trims the least recently
+// used caches first until the total is under that ceiling; without it the
+// footprints are only reported.
+
+using FootprintFn = std::function<qint64()>;
+using TrimFn = std::function<qint64(qint64 bytes)>;     // frees about `bytes`, returns what it freed
+
+qint64 memory_ceiling();            // 0 = no ceiling
+bool low_memory_mode();
+
+void register_cache(const QString& name, FootprintFn footprint, TrimFn trim = TrimFn());
+void unregister_cache(const QString& name);
+void touch_cache(const QString& name);      // used now: trimmed last
+qint64 accounted_bytes();
+void enforce_memory_budget();
+
+// created / alive per kind of object, so a leak shows as a live count that only grows
+void track_object(QObject* object, const char* kind);
+
+QString memory_report();
+
+// rough heap size of a string, for the footprints
+inline qint64 string_bytes(const QString& text) {
+    return qint64(sizeof(QString)) + text.capacity() * 2;
+}
+
+#endif // MEMORY_BUDGET_H
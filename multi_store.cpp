@@ -0,0 +1,237 @@
+#include "multi_store.h"
+#include "memory_budget.h"
+#include "query_registry.h"
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentMap>
+#include <algorithm>
+
+namespace {
+
+const int maxCacheEntries = 256;
+
+// changes whenever anything is committed: WAL appends, checkpoints, vacuum
+QString fingerprint(const QString& path) {
+    QString print;
+    for (const QString& file : {path, path + "-wal"}) {
+        QFileInfo info(file);
+        if (!info.exists()) continue;
+        print += QString("%1:%2;").arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+    }
+    return print;
+}
+
+QString csv_field(const QString& text) {
+    if (!text.contains(',') && !text.contains('"') && !text.contains('\n')) return text;
+    return '"' + QString(text).replace('"', "\"\"") + '"';
+}
+
+void rank(QVector<ProductSales>& products, qint64 days) {
+    std::sort(products.begin(), products.end(), [](const ProductSales& a, const ProductSales& b) {
+        return a.revenue > b.revenue;
+    });
+    for (int i = 0; i < products.size(); ++i) {
+        products[i].rank = i + 1;
+        products[i].perDay = products[i].units / double(qMax<qint64>(1, days));
+    }
+}
+
+}
+
+QVector<StoreSource> registered_stores(const QString& localDb) {
+    QVector<StoreSource> stores;
+    stores.append({qEnvironmentVariable("STOCKING_STORE_NAME", "This store"), localDb});
+
+    const QStringList entries = qEnvironmentVariable("STOCKING_STORES").split(';', Qt::SkipEmptyParts);
+    for (const QString& entry : entries) {
+        StoreSource store;
+        int equals = entry.indexOf('=');
+        store.path = (equals < 0 ? entry : entry.mid(equals + 1)).trimmed();
+        store.name = equals < 0 ? QFileInfo(store.path).absoluteDir().dirName() : entry.left(equals).trimmed();
+        if (store.path.isEmpty()) continue;
+        if (QFileInfo(store.path).absoluteFilePath() == QFileInfo(stores.first().path).absoluteFilePath()) continue;
+        stores.append(store);
+    }
+    return stores;
+}
+
+QFuture<StoreSummary> FederatedReporting::run(const QVector<StoreSource>& stores, const QDate& from, const QDate& to) {
+    return QtConcurrent::mapped(stores, [this, from, to](const StoreSource& store) {
+        return summarize(store, from, to);
+    });
+}
+
+StoreSummary FederatedReporting::summarize(const StoreSource& store, const QDate& from, const QDate& to) {
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString key = QString("%1|%2|%3").arg(QFileInfo(store.path).absoluteFilePath(), from.toString(Qt::ISODate),
+                                                 to.toString(Qt::ISODate));
+    const QString print = fingerprint(store.path);
+    {
+        QMutexLocker locker(&mutex);
+        auto it = cache.constFind(key);
+        if (it != cache.constEnd() && it->fingerprint == print) {
+            StoreSummary summary = it->summary;
+            summary.store = store.name;
+            summary.cached = true;
+            summary.elapsedMs = timer.elapsed();
+            return summary;
+        }
+    }
+
+    StoreSummary summary;
+    summary.store = store.name;
+    if (print.isEmpty()) {
+        summary.error = "no database at " + store.path;
+        return summary;
+    }
+
+    const QString fromText = from.toString("yyyy-MM-dd") + " 00:00:00";
+    const QString toText = to.addDays(1).toString("yyyy-MM-dd") + " 00:00:00";
+    const QString name = QString("federated_%1").arg(quintptr(QThread::currentThreadId()));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+        db.setDatabaseName(store.path);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=5000");
+        if (!db.open()) {
+            summary.error = db.lastError().text();
+        } else {
+            QSqlQuery query(db);
+            query.setForwardOnly(true);
+            query.prepare(registered_sql(Statement::SalesTotals));
+            query.addBindValue(fromText);
+            query.addBindValue(toText);
+            if (query.exec() && query.next()) {
+                summary.transactions = query.value(0).toLongLong();
+                summary.revenue = query.value(1).toDouble();
+                summary.cost = query.value(2).toDouble();
+            } else {
+                summary.error = query.lastError().text();
+            }
+
+            // line items of sales from before transaction_items existed are only
+            // there once that store's register has run its backfill
+            query.prepare(registered_sql(Statement::StoreProductSales));
+            query.addBindValue(fromText);
+            query.addBindValue(toText);
+            if (summary.error.isEmpty() && query.exec()) {
+                while (query.next()) {
+                    ProductSales sales;
+                    sales.name = query.value(0).toString();
+                    sales.units = query.value(1).toLongLong();
+                    sales.revenue = query.value(2).toDouble();
+                    sales.cost = query.value(3).toDouble();
+                    summary.units += sales.units;
+                    summary.products.append(sales);
+                }
+            } else if (summary.error.isEmpty()) {
+                summary.error = query.lastError().text();
+            }
+            rank(summary.products, from.daysTo(to) + 1);
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(name);
+    summary.elapsedMs = timer.elapsed();
+
+    if (summary.error.isEmpty()) {
+        QMutexLocker locker(&mutex);
+        if (cache.size() >= maxCacheEntries) cache.clear();
+        cache.insert(key, {print, summary});
+    }
+    return summary;
+}
+
+qint64 FederatedReporting::footprint() const {
+    QMutexLocker locker(&mutex);
+    qint64 bytes = 0;
+    for (auto it = cache.constBegin(); it != cache.constEnd(); ++it) {
+        bytes += string_bytes(it.key()) + string_bytes(it->fingerprint) + sizeof(CacheEntry);
+        for (const ProductSales& sales : it->summary.products) bytes += sizeof(ProductSales) + string_bytes(sales.name);
+    }
+    return bytes;
+}
+
+qint64 FederatedReporting::trim() {
+    const qint64 before = footprint();
+    QMutexLocker locker(&mutex);
+    cache.clear();
+    cache.squeeze();
+    return before;
+}
+
+FederatedReport FederatedReporting::merge(const QList<StoreSummary>& parts, const QDate& from, const QDate& to) {
+    FederatedReport report;
+    report.combined.store = "All stores";
+
+    QHash<QString, int> index;
+    for (const StoreSummary& part : parts) {
+        report.stores.append(part);
+        report.combined.transactions += part.transactions;
+        report.combined.units += part.units;
+        report.combined.revenue += part.revenue;
+        report.combined.cost += part.cost;
+        report.combined.elapsedMs = qMax(report.combined.elapsedMs, part.elapsedMs);
+
+        for (const ProductSales& sales : part.products) {
+            auto it = index.constFind(sales.name);
+            if (it == index.constEnd()) {
+                index.insert(sales.name, report.combined.products.size());
+                report.combined.products.append(sales);
+                continue;
+            }
+            ProductSales& merged = report.combined.products[it.value()];
+            merged.units += sales.units;
+            merged.revenue += sales.revenue;
+            merged.cost += sales.cost;
+        }
+    }
+    rank(report.combined.products, from.daysTo(to) + 1);
+    return report;
+}
+
+bool export_federated_csv(const FederatedReport& report, const QString& file, QString& error) {
+    QSaveFile out(file);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        error = out.errorString();
+        return false;
+    }
+
+    QTextStream stream(&out);
+    stream << "store,transactions,units,revenue,cost,profit,status\n";
+    QVector<StoreSummary> rows = report.stores;
+    rows.append(report.combined);
+    for (const StoreSummary& store : rows) {
+        stream << csv_field(store.store) << ',' << store.transactions << ',' << store.units << ','
+               << QString::number(store.revenue, 'f', 2) << ',' << QString::number(store.cost, 'f', 2) << ','
+               << QString::number(store.revenue - store.cost, 'f', 2) << ','
+               << csv_field(store.error.isEmpty() ? "ok" : store.error) << '\n';
+    }
+
+    stream << "\nstore,rank,product,units,units_per_day,revenue,cost,margin_percent\n";
+    for (const StoreSummary& store : rows) {
+        for (const ProductSales& sales : store.products) {
+            stream << csv_field(store.store) << ',' << sales.rank << ',' << csv_field(sales.name) << ','
+                   << sales.units << ',' << QString::number(sales.perDay, 'f', 2) << ','
+                   << QString::number(sales.revenue, 'f', 2) << ',' << QString::number(sales.cost, 'f', 2) << ','
+                   << QString::number(sales.margin(), 'f', 1) << '\n';
+        }
+    }
+
+    stream.flush();
+    if (stream.status() != QTextStream::Ok || !out.commit()) {
+        error = "cannot write " + file;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef MULTI_STORE_H
+#define MULTI_STORE_H
+
+#include "sales_analytics.h"
+#include <QDate>
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+struct StoreSource {
+    QString name;
+    QString path;
+};
+
+// This store (STOCKING_STORE_NAME, localDb) followed by the shops listed in
+// STOCKING_STORES, separated by ';': "Oran=/srv/oran/store.db;Alger=..."
+// A bare path is named after its directory.
+QVector<StoreSource> registered_stores(const QString& localDb);
+
+struct StoreSummary {
+    QString store;
+    qint64 transactions = 0;
+    qint64 units = 0;
+    double revenue = 0;
+    double cost = 0;
+    QVector<ProductSales> products;     // best seller (revenue) first
+    QString error;                      // the store could not be read
+    bool cached = false;
+    qint64 elapsedMs = 0;
+};
+
+struct FederatedReport {
+    QVector<StoreSummary> stores;
+    StoreSummary combined;              // products merged by name
+};
+
+// Period reports over several store databases. Every store is read by its own
+// worker on the thread pool, on its own read-only connection, and its partial
+// summary is cached until the database file (or its WAL) changes, so a report
+// only reads the shops that sold something since the last one.
+class FederatedReporting
+{
+public:
+    // from and to are inclusive days; results come in store order
+    QFuture<StoreSummary> run(const QVector<StoreSource>& stores, const QDate& from, const QDate& to);
+    static FederatedReport merge(const QList<StoreSummary>& parts, const QDate& from, const QDate& to);
+
+    qint64 footprint() const;
+    qint64 trim();      // drops the cached summaries
+
+private:
+    StoreSummary summarize(const StoreSource& store, const QDate& from, const QDate& to);
+
+    struct CacheEntry {
+        QString fingerprint;
+        StoreSummary summary;
+    };
+
+    mutable QMutex mutex;
+    QHash<QString, CacheEntry> cache;   // path|from|to
+};
+
+// one section per store and one for the merged products
+bool export_federated_csv(const FederatedReport& report, const QString& file, QString& error);
+
+#endif // MULTI_STORE_H
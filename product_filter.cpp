@@ -0,0 +1,297 @@
+#include "product_filter.h"
+#include <QCollator>
+#include <QRegularExpression>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentMap>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// below this a single pass is faster than handing chunks to the thread pool
+const int parallelThreshold = 20000;
+const int chunkSize = 8192;
+const int debounceMs = 150;
+
+enum Column { IdColumn, NameColumn, TypeColumn, QuantityColumn, PriceColumn, BoughtColumn, BarcodeColumn };
+
+void apply_bound(const QString& op, double value, double& min, double& max) {
+    const double inf = std::numeric_limits<double>::infinity();
+    if (op == "<") max = std::nextafter(value, -inf);
+    else if (op == "<=") max = value;
+    else if (op == ">") min = std::nextafter(value, inf);
+    else if (op == ">=") min = value;
+    else { min = value; max = value; }
+}
+
+QCollator& collator() {
+    static QCollator instance = []() {
+        QCollator c;
+        c.setCaseSensitivity(Qt::CaseInsensitive);
+        c.setNumericMode(true);
+        return c;
+    }();
+    return instance;
+}
+
+}
+
+ProductFilter ProductFilter::parse(const QString& text) {
+    static const QRegularExpression spaceRe("\\s+");
+    static const QRegularExpression rangeRe("^(qty|quantity|price|bought|cost)(<=|>=|<|>|=)(\\d+(?:\\.\\d+)?)$");
+
+    ProductFilter filter;
+    const QStringList tokens = text.toLower().split(spaceRe, Qt::SkipEmptyParts);
+
+    for (const QString& token : tokens) {
+        QRegularExpressionMatch range = rangeRe.match(token);
+        if (range.hasMatch()) {
+            QString field = range.captured(1);
+            double value = range.captured(3).toDouble();
+            if (field == "qty" || field == "quantity") apply_bound(range.captured(2), value, filter.qtyMin, filter.qtyMax);
+            else if (field == "price") apply_bound(range.captured(2), value, filter.priceMin, filter.priceMax);
+            else apply_bound(range.captured(2), value, filter.boughtMin, filter.boughtMax);
+            filter.numeric = true;
+        } else if (token.startsWith("type:")) {
+            if (token.size() > 5) filter.types << token.mid(5);
+        } else if (token.startsWith("name:")) {
+            if (token.size() > 5) filter.names << token.mid(5);
+        } else if (token.startsWith("code:")) {
+            if (token.size() > 5) filter.codes << token.mid(5);
+        } else {
+            filter.words << token;
+        }
+    }
+    return filter;
+}
+
+namespace {
+
+// every term of `before` is contained in some term of `after`
+bool covers(const QStringList& after, const QStringList& before, bool prefix) {
+    for (const QString& old : before) {
+        bool found = false;
+        for (const QString& term : after) {
+            if (prefix ? term.startsWith(old) : term.contains(old)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+}
+
+// true when every row this filter accepts was also accepted by `previous`,
+// so only the rows still shown need checking (typing more of a word)
+bool ProductFilter::narrows(const ProductFilter& previous) const {
+    if (previous.isEmpty() || previous.numeric) return false;
+    return covers(words, previous.words, false)
+           && covers(names, previous.names, false)
+           && covers(types, previous.types, false)
+           && covers(codes, previous.codes, true);
+}
+
+bool ProductFilter::isEmpty() const {
+    return words.isEmpty() && names.isEmpty() && types.isEmpty() && codes.isEmpty() && !numeric;
+}
+
+//=====================================================================================================================
+
+ProductFilterModel::ProductFilterModel(QObject* parent)
+    : QSortFilterProxyModel(parent)
+    , debounce(new QTimer(this))
+{
+    debounce->setSingleShot(true);
+    debounce->setInterval(debounceMs);
+    connect(debounce, &QTimer::timeout, this, [this]() { apply_query(pendingQuery); });
+}
+
+void ProductFilterModel::setSourceModel(QAbstractItemModel* model) {
+    if (sourceModel()) disconnect(sourceModel(), nullptr, this, nullptr);
+
+    // connected before the base class, so the keys are current by the time it
+    // asks filterAcceptsRow about new or changed rows
+    if (model) {
+        connect(model, &QAbstractItemModel::modelReset, this, &ProductFilterModel::rebuild_keys);
+        connect(model, &QAbstractItemModel::layoutChanged, this, &ProductFilterModel::rebuild_keys);
+        connect(model, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex&, int first, int last) {
+            std::vector<RowKeys> added;
+            std::vector<QCollatorSortKey> addedNames;
+            std::vector<QCollatorSortKey> addedTypes;
+            std::vector<char> addedAccepted;
+            for (int row = first; row <= last; ++row) {
+                RowKeys keys = read_keys(row);
+                addedNames.push_back(collator().sortKey(keys.name));
+                addedTypes.push_back(collator().sortKey(keys.type));
+                addedAccepted.push_back(matches(keys));
+                added.push_back(std::move(keys));
+            }
+            rows.insert(rows.begin() + first, added.begin(), added.end());
+            nameKeys.insert(nameKeys.begin() + first, addedNames.begin(), addedNames.end());
+            typeKeys.insert(typeKeys.begin() + first, addedTypes.begin(), addedTypes.end());
+            accepted.insert(accepted.begin() + first, addedAccepted.begin(), addedAccepted.end());
+        });
+        connect(model, &QAbstractItemModel::rowsRemoved, this, [this](const QModelIndex&, int first, int last) {
+            rows.erase(rows.begin() + first, rows.begin() + last + 1);
+            nameKeys.erase(nameKeys.begin() + first, nameKeys.begin() + last + 1);
+            typeKeys.erase(typeKeys.begin() + first, typeKeys.begin() + last + 1);
+            accepted.erase(accepted.begin() + first, accepted.begin() + last + 1);
+        });
+        connect(model, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+            for (int row = topLeft.row(); row <= bottomRight.row() && row < int(rows.size()); ++row) {
+                rows[row] = read_keys(row);
+                nameKeys[row] = collator().sortKey(rows[row].name);
+                typeKeys[row] = collator().sortKey(rows[row].type);
+                accepted[row] = matches(rows[row]);
+            }
+        });
+    }
+
+    QSortFilterProxyModel::setSourceModel(model);
+    rebuild_keys();
+    invalidateFilter();
+
+    // filtering and sorting need the whole catalog, not the first page sql
+    // fetched, after every select() too; connected after the base class so
+    // it has taken the reset in before the remaining rows are inserted
+    if (model) {
+        connect(model, &QAbstractItemModel::modelReset, this, &ProductFilterModel::fetch_all);
+        fetch_all();
+    }
+}
+
+void ProductFilterModel::fetch_all() {
+    QAbstractItemModel* model = sourceModel();
+    while (model && model->canFetchMore(QModelIndex())) model->fetchMore(QModelIndex());
+}
+
+void ProductFilterModel::set_query(const QString& text) {
+    pendingQuery = text;
+    debounce->start();
+}
+
+void ProductFilterModel::apply_query(const QString& text) {
+    debounce->stop();
+    if (text == lastQuery) return;
+
+    ProductFilter next = ProductFilter::parse(text);
+    bool narrowing = next.narrows(filter);
+
+    filter = next;
+    lastQuery = text;
+    refilter(narrowing);
+}
+
+// text fields are lower cased once here; the collator ignores case anyway
+ProductFilterModel::RowKeys ProductFilterModel::read_keys(int row) const {
+    QAbstractItemModel* source = sourceModel();
+    RowKeys keys;
+    keys.id = source->index(row, IdColumn).data().toInt();
+    keys.name = source->index(row, NameColumn).data().toString().toLower();
+    keys.type = source->index(row, TypeColumn).data().toString().toLower();
+    keys.code = source->index(row, BarcodeColumn).data().toString().toLower();
+    keys.quantity = source->index(row, QuantityColumn).data().toDouble();
+    keys.price = source->index(row, PriceColumn).data().toDouble();
+    keys.bought = source->index(row, BoughtColumn).data().toDouble();
+    return keys;
+}
+
+void ProductFilterModel::rebuild_keys() {
+    rows.clear();
+    nameKeys.clear();
+    typeKeys.clear();
+
+    QAbstractItemModel* source = sourceModel();
+    if (!source) {
+        accepted.clear();
+        return;
+    }
+
+    int count = source->rowCount();
+    rows.reserve(count);
+    nameKeys.reserve(count);
+    typeKeys.reserve(count);
+
+    for (int row = 0; row < count; ++row) {
+        RowKeys keys = read_keys(row);
+        nameKeys.push_back(collator().sortKey(keys.name));
+        typeKeys.push_back(collator().sortKey(keys.type));
+        rows.push_back(std::move(keys));
+    }
+
+    // the base class rebuilds its mapping from the mask after the reset
+    accepted.assign(rows.size(), 1);
+    if (!filter.isEmpty()) compute_mask(false);
+}
+
+void ProductFilterModel::refilter(bool narrowing) {
+    compute_mask(narrowing);
+    invalidateFilter();
+}
+
+void ProductFilterModel::compute_mask(bool narrowing) {
+    const int count = int(rows.size());
+    accepted.resize(count, 1);
+
+    auto run = [this, narrowing](std::pair<int, int> range) {
+        for (int row = range.first; row < range.second; ++row) {
+            if (narrowing && !accepted[row]) continue;
+            accepted[row] = matches(rows[row]);
+        }
+    };
+
+    if (count < parallelThreshold) {
+        run({0, count});
+    } else {
+        std::vector<std::pair<int, int>> chunks;
+        for (int start = 0; start < count; start += chunkSize) {
+            chunks.emplace_back(start, qMin(start + chunkSize, count));
+        }
+        QtConcurrent::blockingMap(chunks, run);
+    }
+}
+
+bool ProductFilterModel::matches(const RowKeys& keys) const {
+    for (const QString& word : filter.words) {
+        if (!keys.name.contains(word) && !keys.type.contains(word) && !keys.code.contains(word)) return false;
+    }
+    for (const QString& name : filter.names) {
+        if (!keys.name.contains(name)) return false;
+    }
+    for (const QString& type : filter.types) {
+        if (!keys.type.contains(type)) return false;
+    }
+    for (const QString& code : filter.codes) {
+        if (!keys.code.startsWith(code)) return false;
+    }
+    return keys.quantity >= filter.qtyMin && keys.quantity <= filter.qtyMax
+           && keys.price >= filter.priceMin && keys.price <= filter.priceMax
+           && keys.bought >= filter.boughtMin && keys.bought <= filter.boughtMax;
+}
+
+bool ProductFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const {
+    Q_UNUSED(sourceParent);
+    return sourceRow >= int(accepted.size()) || accepted[sourceRow];
+}
+
+bool ProductFilterModel::lessThan(const QModelIndex& left, const QModelIndex& right) const {
+    int l = left.row();
+    int r = right.row();
+    if (l >= int(rows.size()) || r >= int(rows.size())) {
+        return QSortFilterProxyModel::lessThan(left, right);
+    }
+
+    switch (left.column()) {
+    case IdColumn: return rows[l].id < rows[r].id;
+    case NameColumn: return nameKeys[l].compare(nameKeys[r]) < 0;
+    case TypeColumn: return typeKeys[l].compare(typeKeys[r]) < 0;
+    case QuantityColumn: return rows[l].quantity < rows[r].quantity;
+    case PriceColumn: return rows[l].price < rows[r].price;
+    case BoughtColumn: return rows[l].bought < rows[r].bought;
+    case BarcodeColumn: return rows[l].code < rows[r].code;
+    default: return QSortFilterProxyModel::lessThan(left, right);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef PRODUCT_FILTER_H
+#define PRODUCT_FILTER_H
+
+#include <QCollatorSortKey>
+#include <QSortFilterProxyModel>
+#include <QStringList>
+#include <limits>
+#include <vector>
+
+class QTimer;
+
+// Parsed form of the item search box. Bare words must all appear in the name
+// or type, the rest are field filters:
+//   type:fabric  name:velvet  code:123  qty<5  qty>=2  price>100  bought<=50
+struct ProductFilter {
+    QStringList words;
+    QStringList names;
+    QStringList types;
+    QStringList codes;
+    double qtyMin = -std::numeric_limits<double>::infinity();
+    double qtyMax = std::numeric_limits<double>::infinity();
+    double priceMin = -std::numeric_limits<double>::infinity();
+    double priceMax = std::numeric_limits<double>::infinity();
+    double boughtMin = -std::numeric_limits<double>::infinity();
+    double boughtMax = std::numeric_limits<double>::infinity();
+    bool numeric = false; // has a range, so typing more can widen the result
+
+    static ProductFilter parse(const QString& text);
+    bool isEmpty() const;
+    bool narrows(const ProductFilter& previous) const;
+};
+
+// Product table proxy with typed sort keys built once per source reset and a
+// precomputed accept mask. Typing is debounced, large catalogs are filtered in
+// parallel chunks, and when the new query only narrows the last one just the
+// rows still shown are re-checked. The proxy then applies the mask as row
+// removals/insertions instead of a reset, so selection and scroll survive.
+class ProductFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+
+public:
+    explicit ProductFilterModel(QObject* parent = nullptr);
+
+    void setSourceModel(QAbstractItemModel* model) override;
+
+    void set_query(const QString& text);      // debounced, for textChanged
+    void apply_query(const QString& text);    // right away
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+    bool lessThan(const QModelIndex& left, const QModelIndex& right) const override;
+
+private:
+    struct RowKeys {
+        int id;
+        QString name;       // lower case
+        QString type;
+        QString code;
+        double quantity;
+        double price;
+        double bought;
+    };
+
+    RowKeys read_keys(int row) const;
+    void fetch_all();
+    void rebuild_keys();
+    void refilter(bool narrowing);
+    void compute_mask(bool narrowing);
+    bool matches(const RowKeys& keys) const;
+
+    std::vector<RowKeys> rows;
+    std::vector<QCollatorSortKey> nameKeys;
+    std::vector<QCollatorSortKey> typeKeys;
+    std::vector<char> accepted;
+
+    ProductFilter filter;
+    QString lastQuery;
+    QString pendingQuery;
+    QTimer* debounce;
+};
+
+#endif // PRODUCT_FILTER_H
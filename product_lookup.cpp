@@ -0,0 +1,138 @@
+#include "product_lookup.h"
+#include "query_registry.h"
+#include "memory_budget.h"
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+
+void ProductLookup::reload() {
+    products.clear();
+    idIndex.clear();
+    barcodeIndex.clear();
+    nameIndex.clear();
+
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    if (!query.exec(registered_sql(Statement::ProductsAll))) {
+        qDebug() << "Loading products failed:" << query.lastError();
+        return;
+    }
+
+    while (query.next()) {
+        CartProduct product;
+        product.id = query.value(0).toInt();
+        product.name = query.value(1).toString();
+        product.type = query.value(2).toString();
+        product.price = query.value(3).toDouble();
+        product.cost = query.value(4).toDouble();
+        product.barcode = query.value(5).toString();
+        product.categoryId = query.value(6).toInt();
+
+        products.append(product);
+        index(products.size() - 1);
+    }
+}
+
+bool ProductLookup::refresh(const QVector<int>& ids) {
+    if (ids.isEmpty()) return false;
+
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare(registered_sql(Statement::ProductsByIds, ids.size()));
+    for (int id : ids) query.addBindValue(id);
+    if (!query.exec()) {
+        qDebug() << "Refreshing products failed:" << query.lastError();
+        return false;
+    }
+
+    bool namesChanged = false;
+    while (query.next()) {
+        CartProduct product;
+        product.id = query.value(0).toInt();
+        product.name = query.value(1).toString();
+        product.type = query.value(2).toString();
+        product.price = query.value(3).toDouble();
+        product.cost = query.value(4).toDouble();
+        product.barcode = query.value(5).toString();
+        product.categoryId = query.value(6).toInt();
+
+        int slot = idIndex.value(product.id, -1);
+        if (slot < 0) {
+            slot = products.size();
+            products.append(product);
+            namesChanged = true;
+        } else {
+            unindex(slot);
+            namesChanged = namesChanged || products[slot].name != product.name;
+            products[slot] = product;
+        }
+        index(slot);
+    }
+    return namesChanged;
+}
+
+bool ProductLookup::remove(const QVector<int>& ids) {
+    bool removed = false;
+    for (int id : ids) {
+        int slot = idIndex.value(id, -1);
+        if (slot < 0) continue;
+        unindex(slot);
+        products[slot] = CartProduct();
+        removed = true;
+    }
+    return removed;
+}
+
+void ProductLookup::index(int slot) {
+    const CartProduct& product = products[slot];
+    idIndex.insert(product.id, slot);
+    nameIndex.insert(product.name, slot);
+    if (!product.barcode.isEmpty()) barcodeIndex.insert(product.barcode, slot);
+}
+
+void ProductLookup::unindex(int slot) {
+    const CartProduct& product = products[slot];
+    idIndex.remove(product.id);
+    // a rename or barcode swap inside one batch may have handed the key on already
+    if (nameIndex.value(product.name, -1) == slot) nameIndex.remove(product.name);
+    if (barcodeIndex.value(product.barcode, -1) == slot) barcodeIndex.remove(product.barcode);
+}
+
+const CartProduct* ProductLookup::by_id(int id) const {
+    auto it = idIndex.constFind(id);
+    return it == idIndex.constEnd() ? nullptr : &products[it.value()];
+}
+
+const CartProduct* ProductLookup::by_barcode(const QString& code) const {
+    auto it = barcodeIndex.constFind(code);
+    return it == barcodeIndex.constEnd() ? nullptr : &products[it.value()];
+}
+
+const CartProduct* ProductLookup::by_name(const QString& name) const {
+    auto it = nameIndex.constFind(name);
+    return it == nameIndex.constEnd() ? nullptr : &products[it.value()];
+}
+
+const CartProduct* ProductLookup::find(const QString& text) const {
+    const CartProduct* product = by_barcode(text);
+    return product ? product : by_name(text);
+}
+
+qint64 ProductLookup::footprint() const {
+    qint64 bytes = qint64(products.capacity()) * sizeof(CartProduct);
+    for (const CartProduct& product : products) {
+        bytes += string_bytes(product.name) + string_bytes(product.type) + string_bytes(product.barcode);
+    }
+    // hash nodes; the keys share their data with the products
+    bytes += qint64(idIndex.size() + barcodeIndex.size() + nameIndex.size()) * 32;
+    return bytes;
+}
+
+QStringList ProductLookup::names() const {
+    QStringList list;
+    list.reserve(products.size());
+    for (const CartProduct& product : products) {
+        if (product.id != 0) list << product.name;
+    }
+    return list;
+}
@@ -0,0 +1,49 @@
+#ifndef PRODUCT_LOOKUP_H
+#define PRODUCT_LOOKUP_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct CartProduct {
+    int id = 0;
+    QString name;
+    QString type;
+    double price = 0;
+    double cost = 0;
+    QString barcode;
+    int categoryId = 0;
+};
+
+// In-memory copy of what the register needs to put a product in the cart,
+// indexed by barcode and by exact name. Filled in one pass over products so a
+// scan is a hash hit instead of a query. refresh()/remove() patch single
+// products after a ProductRepository write.
+class ProductLookup
+{
+public:
+    void reload();
+    bool refresh(const QVector<int>& ids);     // true when the name list changed
+    bool remove(const QVector<int>& ids);
+
+    const CartProduct* by_id(int id) const;
+    const CartProduct* by_barcode(const QString& code) const;
+    const CartProduct* by_name(const QString& name) const;
+    // barcode first, then exact name, what a scan or Enter in the cart search means
+    const CartProduct* find(const QString& text) const;
+
+    QStringList names() const;
+    qint64 footprint() const;
+
+private:
+    void index(int slot);
+    void unindex(int slot);
+
+    QVector<CartProduct> products;      // removed products stay as id 0 until reload()
+    QHash<int, int> idIndex;
+    QHash<QString, int> barcodeIndex;
+    QHash<QString, int> nameIndex;
+};
+
+#endif // PRODUCT_LOOKUP_H
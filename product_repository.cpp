@@ -0,0 +1,251 @@
+#include "product_repository.h"
+#include "query_registry.h"
+#include "app_metrics.h"
+#include "stock_journal.h"
+#include <QDebug>
+#include <QPair>
+#include <QSqlError>
+
+ProductRepository::ProductRepository(QObject* parent)
+    : QObject(parent)
+{
+}
+
+bool ProductRepository::prepare(QString& message) {
+    if (prepared) return true;
+
+    const QVector<QPair<QSqlQuery*, Statement>> statements = {
+        {&selectById, Statement::ProductStockById},
+        {&selectByName, Statement::ProductStockByName},
+        {&insertProduct, Statement::ProductInsert},
+        {&updateProduct, Statement::ProductUpdate},
+        {&adjustProduct, Statement::ProductAdjust},
+        {&deleteProduct, Statement::ProductDelete},
+        {&insertCategory, Statement::CategoryInsert},
+        {&selectCategory, Statement::CategoryByName}
+    };
+    for (const auto& statement : statements) {
+        if (!statement.first->prepare(registered_sql(statement.second))) {
+            message = statement.first->lastError().text();
+            qDebug() << "Preparing product statements failed:" << message;
+            tx_failed_on(*statement.first);
+            return false;
+        }
+    }
+    prepared = true;
+    return true;
+}
+
+void ProductRepository::release() {
+    for (QSqlQuery* statement : {&selectById, &selectByName, &insertProduct, &updateProduct, &adjustProduct,
+                                 &deleteProduct, &insertCategory, &selectCategory}) {
+        statement->finish();
+        statement->clear();
+    }
+    prepared = false;
+}
+
+// categories seen in this transaction, so a batch resolves each one once
+int ProductRepository::category(const QString& name, QHash<QString, int>& categories) {
+    const QString key = name.trimmed().toLower();
+    auto it = categories.constFind(key);
+    if (it != categories.constEnd()) return it.value();
+
+    insertCategory.bindValue(0, name.trimmed());
+    if (!insertCategory.exec()) {
+        tx_failed_on(insertCategory);
+        return -1;
+    }
+    selectCategory.bindValue(0, name.trimmed());
+    if (!selectCategory.exec()) {
+        tx_failed_on(selectCategory);
+        return -1;
+    }
+    if (!selectCategory.next()) return -1;
+    int id = selectCategory.value(0).toInt();
+    selectCategory.finish();
+
+    categories.insert(key, id);
+    return id;
+}
+
+TxStatus ProductRepository::write(QSqlQuery& query, ProductRecord& product, bool insertOnly,
+                                  QHash<QString, int>& categories, QString& message) {
+    bool exists = false;
+    int oldQuantity = 0;
+    if (!insertOnly) {
+        QSqlQuery& select = product.id > 0 ? selectById : selectByName;
+        select.bindValue(0, product.id > 0 ? QVariant(product.id) : QVariant(product.name));
+        if (!select.exec()) {
+            message = select.lastError().text();
+            return tx_failed_on(select);
+        }
+        exists = select.next();
+        if (exists && product.id <= 0) product.id = select.value(0).toInt();
+        oldQuantity = exists ? select.value(1).toInt() : 0;
+        select.finish();
+
+        if (!exists && product.id > 0) {
+            message = product.name + " no longer exists";
+            return TxStatus::Abort;
+        }
+    }
+
+    int categoryId = category(product.type, categories);
+    if (categoryId < 0) {
+        message = "could not resolve category " + product.type;
+        return TxStatus::Error;
+    }
+
+    QSqlQuery& statement = exists ? updateProduct : insertProduct;
+    statement.bindValue(0, product.name);
+    statement.bindValue(1, product.type);
+    statement.bindValue(2, product.quantity);
+    statement.bindValue(3, product.price);
+    statement.bindValue(4, product.bought);
+    statement.bindValue(5, product.barcode.isEmpty() ? QVariant() : QVariant(product.barcode));
+    statement.bindValue(6, categoryId);
+    if (exists) statement.bindValue(7, product.id);
+    if (!statement.exec()) {
+        message = QString("%1: %2").arg(product.name, statement.lastError().text());
+        return tx_failed_on(statement);
+    }
+    if (!exists) product.id = statement.lastInsertId().toInt();
+
+    const int delta = product.quantity - oldQuantity;
+    if (delta == 0) return TxStatus::Ok;
+    QString reason = !exists || delta > 0 ? StockReason::Restock : StockReason::Adjustment;
+    return record_stock_change(query, product.name, delta, reason) ? TxStatus::Ok : TxStatus::Error;
+}
+
+TxResult ProductRepository::insert(ProductRecord& product) {
+    QVector<ProductRecord> products = {product};
+    TxResult tx = store(products, true);
+    product.id = products.first().id;
+    return tx;
+}
+
+TxResult ProductRepository::upsert(ProductRecord& product) {
+    QVector<ProductRecord> products = {product};
+    TxResult tx = store(products, false);
+    product.id = products.first().id;
+    return tx;
+}
+
+TxResult ProductRepository::upsert_batch(QVector<ProductRecord>& products) {
+    return store(products, false);
+}
+
+TxResult ProductRepository::store(QVector<ProductRecord>& products, bool insertOnly) {
+    // a busy retry starts over from the caller's ids, not the ones a rolled back attempt assigned
+    QVector<int> originalIds;
+    originalIds.reserve(products.size());
+    for (const ProductRecord& product : products) originalIds.append(insertOnly ? 0 : product.id);
+
+    QVector<int> ids;
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString& message) {
+        if (!prepare(message)) return TxStatus::Error;
+        ids.clear();
+        QHash<QString, int> categories;
+        for (int i = 0; i < products.size(); ++i) {
+            ProductRecord& product = products[i];
+            product.id = originalIds[i];
+            TxStatus status = write(query, product, insertOnly, categories, message);
+            if (status != TxStatus::Ok) return status;
+            ids.append(product.id);
+        }
+        return TxStatus::Ok;
+    });
+
+    record_timing(products.size() > 1 ? "product batch write" : "product write", tx.elapsedMs);
+    if (tx.outcome == TxOutcome::Committed) emit productsChanged(ids);
+    return tx;
+}
+
+TxResult ProductRepository::adjust_quantity(int id, int delta, const QString& reason) {
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString& message) {
+        if (!prepare(message)) return TxStatus::Error;
+
+        selectById.bindValue(0, id);
+        if (!selectById.exec()) return tx_failed_on(selectById);
+        if (!selectById.next()) {
+            message = "product no longer exists";
+            return TxStatus::Abort;
+        }
+        const QString name = selectById.value(0).toString();
+        const int quantity = selectById.value(1).toInt();
+        selectById.finish();
+
+        if (quantity + delta < 0) {
+            message = QString("only %1 %2 in stock").arg(quantity).arg(name);
+            return TxStatus::Abort;
+        }
+
+        adjustProduct.bindValue(0, delta);
+        adjustProduct.bindValue(1, id);
+        if (!adjustProduct.exec()) return tx_failed_on(adjustProduct);
+        return record_stock_change(query, name, delta, reason) ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    if (tx.outcome == TxOutcome::Committed) emit productsChanged({id});
+    return tx;
+}
+
+TxResult ProductRepository::remove(const QVector<int>& ids) {
+    QVector<int> removed;
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString& message) {
+        if (!prepare(message)) return TxStatus::Error;
+        removed.clear();
+        for (int id : ids) {
+            // the journal and replication see the stock leave, written while the name still resolves
+            selectById.bindValue(0, id);
+            if (!selectById.exec()) {
+                message = selectById.lastError().text();
+                return tx_failed_on(selectById);
+            }
+            if (!selectById.next()) continue;
+            const QString name = selectById.value(0).toString();
+            const int quantity = selectById.value(1).toInt();
+            selectById.finish();
+            if (!record_stock_change(query, name, -quantity, StockReason::Removal)) {
+                message = query.lastError().text();
+                return TxStatus::Error;
+            }
+
+            deleteProduct.bindValue(0, id);
+            if (!deleteProduct.exec()) {
+                message = deleteProduct.lastError().text();
+                return tx_failed_on(deleteProduct);
+            }
+            if (deleteProduct.numRowsAffected() > 0) removed.append(id);
+        }
+        return TxStatus::Ok;
+    });
+
+    if (tx.outcome == TxOutcome::Committed && !removed.isEmpty()) emit productsRemoved(removed);
+    return tx;
+}
+
+TxResult ProductRepository::scale_prices(int categoryId, double percent) {
+    QVector<int> ids;
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString& message) {
+        ids.clear();
+        query.prepare(registered_sql(Statement::ProductIdsByCategory));
+        query.addBindValue(categoryId);
+        if (!query.exec()) return TxStatus::Error;
+        while (query.next()) ids.append(query.value(0).toInt());
+
+        query.prepare(registered_sql(Statement::ProductScalePrices));
+        query.addBindValue(1 + percent / 100.0);
+        query.addBindValue(categoryId);
+        if (!query.exec()) {
+            message = query.lastError().text();
+            return TxStatus::Error;
+        }
+        return TxStatus::Ok;
+    });
+
+    record_timing("category price update", tx.elapsedMs);
+    if (tx.outcome == TxOutcome::Committed && !ids.isEmpty()) emit productsChanged(ids);
+    return tx;
+}
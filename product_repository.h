@@ -0,0 +1,67 @@
+#ifndef PRODUCT_REPOSITORY_H
+#define PRODUCT_REPOSITORY_H
+
+#include "db_concurrency.h"
+#include <QHash>
+#include <QObject>
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+
+struct ProductRecord {
+    int id = 0;             // 0 = match by name, insert when there is none
+    QString name;
+    QString type;           // category name, created on first use
+    int quantity = 0;
+    double price = 0;
+    double bought = 0;
+    QString barcode;
+};
+
+// Every write to products goes through here. The statements are prepared once
+// on the default connection and re-bound per row; a batch runs in a single
+// write transaction, so importing or re-pricing thousands of products is one
+// commit. Quantity changes are journaled like the edit form always did.
+// After a commit the touched ids are announced, so the lookup, the items
+// table and the stock watch reload those rows only.
+// Create it after start_db(), and release() it before close_db().
+class ProductRepository : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProductRepository(QObject* parent = nullptr);
+
+    TxResult insert(ProductRecord& product);                 // fails on a taken name or barcode
+    TxResult upsert(ProductRecord& product);                 // sets product.id
+    TxResult upsert_batch(QVector<ProductRecord>& products);
+    TxResult adjust_quantity(int id, int delta, const QString& reason);
+    TxResult remove(const QVector<int>& ids);
+    // price = price * (1 + percent / 100) for a whole category, in one UPDATE
+    TxResult scale_prices(int categoryId, double percent);
+    // finishes the prepared statements; the next write prepares them again
+    void release();
+
+signals:
+    void productsChanged(const QVector<int>& ids);           // inserted or updated
+    void productsRemoved(const QVector<int>& ids);
+
+private:
+    bool prepare(QString& message);
+    TxResult store(QVector<ProductRecord>& products, bool insertOnly);
+    TxStatus write(QSqlQuery& query, ProductRecord& product, bool insertOnly,
+                   QHash<QString, int>& categories, QString& message);
+    int category(const QString& name, QHash<QString, int>& categories);
+
+    bool prepared = false;
+    QSqlQuery selectById;
+    QSqlQuery selectByName;
+    QSqlQuery insertProduct;
+    QSqlQuery updateProduct;
+    QSqlQuery adjustProduct;
+    QSqlQuery deleteProduct;
+    QSqlQuery insertCategory;
+    QSqlQuery selectCategory;
+};
+
+#endif // PRODUCT_REPOSITORY_H
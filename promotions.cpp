@@ -0,0 +1,132 @@
+#include "promotions.h"
+#include "query_registry.h"
+#include <QDebug>
+#include <QSqlError>
+
+bool create_promotions(QSqlQuery& query) {
+    return query.exec(R"(
+        CREATE TABLE IF NOT EXISTS promotions (
+            id INTEGER PRIMARY KEY,
+            name TEXT NOT NULL,
+            kind TEXT NOT NULL CHECK (kind IN ('multibuy', 'percent', 'bundle', 'client')),
+            product_id INTEGER REFERENCES products(id),
+            category_id INTEGER REFERENCES categories(id),
+            client TEXT COLLATE NOCASE,
+            buy_qty INTEGER,
+            pay_qty INTEGER,
+            percent REAL,
+            bundle_price REAL,
+            starts_at TEXT,
+            ends_at TEXT,
+            active INTEGER NOT NULL DEFAULT 1
+        )
+    )");
+}
+
+void PromotionEngine::reload() {
+    byProduct.clear();
+    byCategory.clear();
+    byClient.clear();
+    ruleCount = 0;
+
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    if (!query.exec(registered_sql(Statement::PromotionsActive))) {
+        qDebug() << "Loading promotions failed:" << query.lastError();
+        return;
+    }
+
+    while (query.next()) {
+        Rule rule;
+        rule.id = query.value(0).toInt();
+        QString kind = query.value(1).toString();
+        rule.buy = query.value(5).toInt();
+        rule.pay = query.value(6).toInt();
+        rule.percent = qBound(0.0, query.value(7).toDouble(), 100.0);
+        rule.bundlePrice = query.value(8).toDouble();
+
+        int productId = query.value(2).toInt();
+        int categoryId = query.value(3).toInt();
+
+        if (kind == "client") {
+            rule.kind = Kind::Client;
+            QString name = query.value(4).toString().trimmed().toLower();
+            if (name.isEmpty()) continue;
+            byClient[name].append(rule);
+        } else {
+            if (kind == "multibuy") {
+                rule.kind = Kind::MultiBuy;
+                if (rule.buy <= 0 || rule.pay < 0 || rule.pay >= rule.buy) continue;
+            } else if (kind == "bundle") {
+                rule.kind = Kind::Bundle;
+                if (rule.buy <= 0) continue;
+            } else {
+                rule.kind = Kind::Percent;
+            }
+
+            if (productId > 0) byProduct[productId].append(rule);
+            else if (categoryId > 0) byCategory[categoryId].append(rule);
+            else continue;
+        }
+        ++ruleCount;
+    }
+
+    clientRules = byClient.value(client);
+}
+
+bool PromotionEngine::set_client(const QString& name) {
+    QString key = name.trimmed().toLower();
+    if (key == client) return false;
+    bool hadRules = !clientRules.isEmpty();
+    client = key;
+    clientRules = byClient.value(client);
+    return hadRules || !clientRules.isEmpty();
+}
+
+LineDiscount PromotionEngine::price_line(const CartLine& line) const {
+    LineDiscount result;
+    const double gross = line.quantity * line.price;
+    if (gross <= 0) return result;
+
+    // best single product or category rule, they don't stack
+    for (const QHash<int, QVector<Rule>>* index : {&byProduct, &byCategory}) {
+        int key = index == &byProduct ? line.productId : line.categoryId;
+        auto it = index->constFind(key);
+        if (key <= 0 || it == index->constEnd()) continue;
+        for (const Rule& rule : it.value()) {
+            double amount = discount(rule, line);
+            if (amount > result.amount) {
+                result.amount = amount;
+                result.promotionId = rule.id;
+            }
+        }
+    }
+    result.amount = qMin(result.amount, gross);
+
+    // the client's percentage applies to what is left of the line
+    for (const Rule& rule : clientRules) {
+        double amount = (gross - result.amount) * rule.percent / 100.0;
+        if (amount <= 0) continue;
+        result.amount += amount;
+        if (result.promotionId == 0) result.promotionId = rule.id;
+        break;
+    }
+
+    // whole cents, so the cart, the receipt and the stored totals agree
+    result.amount = qRound64(result.amount * 100) / 100.0;
+    return result;
+}
+
+double PromotionEngine::discount(const Rule& rule, const CartLine& line) {
+    switch (rule.kind) {
+    case Kind::MultiBuy:
+        return (line.quantity / rule.buy) * (rule.buy - rule.pay) * line.price;
+    case Kind::Bundle:
+        return (line.quantity / rule.buy) * qMax(0.0, rule.buy * line.price - rule.bundlePrice);
+    case Kind::Percent:
+        return line.quantity * line.price * rule.percent / 100.0;
+    case Kind::Client:
+        break;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef PROMOTIONS_H
+#define PROMOTIONS_H
+
+#include <QHash>
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+
+// What the engine needs to know about one cart line.
+struct CartLine {
+    int productId = 0;
+    int categoryId = 0;
+    int quantity = 0;
+    double price = 0;
+};
+
+struct LineDiscount {
+    double amount = 0;
+    int promotionId = 0;    // rule that gave the discount, 0 = none
+};
+
+// Promotions are rows of the promotions table, one kind per row:
+//   multibuy  product_id, buy_qty, pay_qty       "3 for 2"
+//   percent   product_id or category_id, percent  "20% off fabrics"
+//   bundle    product_id, buy_qty, bundle_price   "4 for 1000 DZD"
+//   client    client, percent                     "10% for Ali"
+// A line gets the best product/category rule that applies to it, and the
+// client's percentage on top of what is left.
+bool create_promotions(QSqlQuery& query);
+
+// Active rules (active = 1 and today inside starts_at..ends_at) compiled into
+// hash indexes by product, category and client, so pricing a line only looks
+// at the handful of rules that can touch it.
+class PromotionEngine
+{
+public:
+    void reload();
+    bool set_client(const QString& client);    // true when the client's rules changed
+    LineDiscount price_line(const CartLine& line) const;
+    int rule_count() const { return ruleCount; }
+
+private:
+    enum class Kind { MultiBuy, Percent, Bundle, Client };
+
+    struct Rule {
+        int id = 0;
+        Kind kind = Kind::Percent;
+        int buy = 0;
+        int pay = 0;
+        double percent = 0;
+        double bundlePrice = 0;
+    };
+
+    static double discount(const Rule& rule, const CartLine& line);
+
+    QHash<int, QVector<Rule>> byProduct;
+    QHash<int, QVector<Rule>> byCategory;
+    QHash<QString, QVector<Rule>> byClient;     // lower case name
+    QString client;
+    QVector<Rule> clientRules;
+    int ruleCount = 0;
+};
+
+#endif // PROMOTIONS_H
@@ -0,0 +1,545 @@
+#include "query_registry.h"
+#include "db_concurrency.h"
+#include "history_model.h"
+#include "replication.h"
+#include "schema_migrations.h"
+#include "store_db.h"
+#include "transaction_search.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+const QVector<RegisteredQuery>& registered_queries() {
+    static const QVector<RegisteredQuery> list = {
+        // the cart's lookup and the stock panel hold the whole catalog
+        {Statement::ProductsAll, "products all",
+         "SELECT id, name, item_type, price, bought, barcode, category_id FROM products", {"products"}},
+        {Statement::ProductsByIds, "products by ids",
+         "SELECT id, name, item_type, price, bought, barcode, category_id FROM products WHERE id IN (%1)", {}},
+        {Statement::ProductStockById, "product stock by id", "SELECT name, quantity FROM products WHERE id = ?", {}},
+        {Statement::ProductStockByName, "product stock by name", "SELECT id, quantity FROM products WHERE name = ?", {}},
+        {Statement::ProductRowById, "product row by id",
+         "SELECT id, name, item_type, quantity, price, barcode FROM products WHERE id = ?", {}},
+        {Statement::ProductRowByBarcode, "product row by barcode",
+         "SELECT id, name, item_type, quantity, price, barcode FROM products WHERE barcode = ?", {}},
+        {Statement::ProductForSaleById, "product for sale by id",
+         "SELECT id, name, item_type, price, bought, category_id FROM products WHERE id = ?", {}},
+        {Statement::ProductForSaleByBarcode, "product for sale by barcode",
+         "SELECT id, name, item_type, price, bought, category_id FROM products WHERE barcode = ?", {}},
+        // "contains" has no index to use; the catalog is the small table
+        {Statement::ProductSearch, "product search", R"(
+            SELECT id, name, item_type, quantity, price, barcode
+            FROM products
+            WHERE barcode = ? OR name LIKE ? ESCAPE '\'
+            ORDER BY barcode = ? DESC, name
+            LIMIT ?
+         )", {"products"}, true, {"", "%milk%", ""}},
+        {Statement::ProductInsert, "product insert",
+         "INSERT INTO products (name, item_type, quantity, price, bought, barcode, category_id) "
+         "VALUES (?, ?, ?, ?, ?, ?, ?)", {}},
+        {Statement::ProductUpdate, "product update",
+         "UPDATE products SET name = ?, item_type = ?, quantity = ?, price = ?, bought = ?, "
+         "barcode = ?, category_id = ? WHERE id = ?", {}},
+        {Statement::ProductAdjust, "product adjust", "UPDATE products SET quantity = quantity + ? WHERE id = ?", {}},
+        {Statement::ProductDelete, "product delete", "DELETE FROM products WHERE id = ?", {}},
+        {Statement::CategoryInsert, "category insert", "INSERT OR IGNORE INTO categories (name) VALUES (?)", {}},
+        {Statement::CategoryByName, "category by name", "SELECT id FROM categories WHERE name = ?", {}},
+        {Statement::CategoriesInUse, "categories in use",
+         "SELECT id, name, product_count FROM categories WHERE product_count > 0 ORDER BY name", {"categories"}},
+        {Statement::CategorySales, "category sales", R"(
+            SELECT COALESCE(c.name, 'Uncategorized'), SUM(i.quantity), SUM(i.subtotal), SUM(i.subexpense)
+            FROM transactions t
+            JOIN transaction_items i ON i.transaction_id = t.id
+            LEFT JOIN products p ON p.id = i.product_id
+            LEFT JOIN categories c ON c.id = p.category_id
+            WHERE t.date >= ? AND t.date < ?
+            GROUP BY 1
+            ORDER BY 3 DESC
+         )", {}, true},
+        {Statement::ProductIdsByCategory, "product ids by category", "SELECT id FROM products WHERE category_id = ?", {}},
+        {Statement::ProductScalePrices, "product scale prices",
+         "UPDATE products SET price = ROUND(price * ?, 2) WHERE category_id = ?", {}},
+
+        {Statement::StockLevels, "stock levels", "SELECT name, quantity FROM products", {"products"}},
+        {Statement::StockLevelsByIds, "stock levels by ids",
+         "SELECT name, quantity FROM products WHERE id IN (%1)", {}},
+
+        // checkout, inside the write lock
+        {Statement::SaleInsert, "sale insert",
+         "INSERT INTO transactions (name, details, total, total_expense, date) VALUES (?, ?, ?, ?, ?)", {}},
+        {Statement::SaleDecrementStock, "sale decrement stock",
+         "UPDATE products SET quantity = quantity - ? WHERE name = ? AND quantity >= ?", {}},
+        {Statement::SaleStockLeft, "sale stock left", "SELECT quantity FROM products WHERE name = ?", {}},
+        {Statement::SaleItemInsert, "sale item insert",
+         "INSERT INTO transaction_items "
+         "(transaction_id, product_id, name, quantity, price, cost, subtotal, subexpense, discount, promotion_id) "
+         "VALUES (?, (SELECT id FROM products WHERE name = ?), ?, ?, ?, ?, ?, ?, ?, ?)", {}},
+        {Statement::StockMovementInsert, "stock movement insert",
+         "INSERT INTO stock_movements (product_id, delta, reason, reference) "
+         "SELECT id, ?, ?, ? FROM products WHERE name = ?", {}},
+
+        {Statement::StockSnapshotAt, "stock snapshot at",
+         "SELECT id, last_movement_id FROM stock_snapshots WHERE taken_at <= ? "
+         "ORDER BY taken_at DESC LIMIT 1", {}},
+        {Statement::StockSnapshotRows, "stock snapshot rows",
+         "SELECT product_id, quantity FROM stock_snapshot_rows WHERE snapshot_id = ?", {}},
+        {Statement::StockMovementsSince, "stock movements since",
+         "SELECT product_id, delta, at FROM stock_movements WHERE id > ? ORDER BY id", {}},
+        {Statement::StockLastMovement, "stock last movement", "SELECT COALESCE(MAX(id), 0) FROM stock_movements", {}},
+        {Statement::StockSnapshotInsert, "stock snapshot insert",
+         "INSERT INTO stock_snapshots (taken_at, last_movement_id) VALUES (CURRENT_TIMESTAMP, ?)", {}},
+        {Statement::StockSnapshotCopy, "stock snapshot copy",
+         "INSERT INTO stock_snapshot_rows (snapshot_id, product_id, quantity) SELECT ?, id, quantity FROM products",
+         {"products"}},
+        {Statement::StockSnapshotLatest, "stock snapshot latest",
+         "SELECT last_movement_id, taken_at FROM stock_snapshots ORDER BY id DESC LIMIT 1", {"stock_snapshots"}},
+        {Statement::StockSnapshotFirst, "stock snapshot first",
+         "SELECT id, last_movement_id FROM stock_snapshots ORDER BY id LIMIT 1", {"stock_snapshots"}},
+
+        {Statement::ChangeLogInsert, "change log insert", "INSERT INTO change_log (kind, payload, register_id) VALUES (?, ?, ?)", {}},
+        {Statement::ChangeLogPending, "change log pending",
+         "SELECT seq, kind, payload FROM change_log WHERE register_id = ? AND seq > ? ORDER BY seq LIMIT ?", {}},
+        {Statement::ChangeLogAcked, "change log acked", "DELETE FROM change_log WHERE register_id = ? AND seq <= ?", {}},
+        {Statement::SyncStateLoad, "sync state load", "SELECT acked_seq FROM sync_state WHERE peer = ?", {}},
+        {Statement::SyncStateSave, "sync state save",
+         "INSERT OR REPLACE INTO sync_state (peer, acked_seq) VALUES (?, ?)", {}},
+        // the back office side, one batch per write transaction
+        {Statement::ReplicationCursorLoad, "replication cursor load",
+         "SELECT applied_seq FROM replication_cursor WHERE register_id = ?", {}},
+        {Statement::ReplicationCursorSave, "replication cursor save",
+         "INSERT OR REPLACE INTO replication_cursor (register_id, applied_seq) VALUES (?, ?)", {}},
+        {Statement::RegisterSaleInsert, "register sale insert",
+         "INSERT OR IGNORE INTO register_sales "
+         "(register_id, seq, transaction_id, name, details, total, total_expense, date) "
+         "VALUES (?, ?, ?, ?, ?, ?, ?, ?)", {}},
+        {Statement::RegisterStockInsert, "register stock insert",
+         "INSERT OR IGNORE INTO register_stock (register_id, seq, product, delta, reason) VALUES (?, ?, ?, ?, ?)", {}},
+
+        {Statement::SearchIndexInsert, "search index insert",
+         "INSERT INTO transactions_fts (rowid, client, items) VALUES (?, ?, ?)", {}},
+        // item names straight from the json, so this doesn't wait for the sale items backfill
+        {Statement::SearchIndexRange, "search index range", R"(
+            INSERT INTO transactions_fts (rowid, client, items)
+            SELECT t.id, COALESCE(t.name, ''),
+                   COALESCE((SELECT group_concat(json_extract(j.value, '$.name'), ' ')
+                             FROM json_each(CASE WHEN json_valid(t.details) THEN t.details ELSE '[]' END) j), '')
+            FROM transactions t
+            WHERE t.id > ? AND t.id <= ?
+         )", {}},
+        // every active rule is compiled, the table is a handful of rows
+        {Statement::PromotionsActive, "promotions active", R"(
+            SELECT id, kind, product_id, category_id, client, buy_qty, pay_qty, percent, bundle_price
+            FROM promotions
+            WHERE active = 1
+              AND (starts_at IS NULL OR starts_at = '' OR starts_at <= date('now', 'localtime'))
+              AND (ends_at IS NULL OR ends_at = '' OR ends_at >= date('now', 'localtime'))
+         )", {"promotions"}},
+        {Statement::MetaGet, "meta get", "SELECT value FROM app_meta WHERE key = ?", {}},
+        {Statement::MetaSet, "meta set", "INSERT OR REPLACE INTO app_meta (key, value) VALUES (?, ?)", {}},
+
+        {Statement::TransactionsByIds, "transactions by ids",
+         "SELECT id, name, date, total, details FROM transactions WHERE id IN (%1)", {}},
+        // julianday of a date is x.5 (noon based), + 0.5 gives QDate::toJulianDay()
+        {Statement::SalesByDaySince, "sales by day since", R"(
+            SELECT CAST(julianday(date(date)) + 0.5 AS INTEGER) AS day,
+                   SUM(total), SUM(total_expense), MAX(id)
+            FROM transactions
+            WHERE id > ?
+            GROUP BY day
+         )", {}, true},
+        {Statement::SaleLinesSince, "sale lines since", R"(
+            SELECT i.rowid, i.name, i.quantity, i.subtotal, i.subexpense,
+                   CAST(julianday(date(t.date)) + 0.5 AS INTEGER)
+            FROM transaction_items i
+            JOIN transactions t ON t.id = i.transaction_id
+            WHERE i.rowid > ?
+            ORDER BY i.rowid
+         )", {}},
+        {Statement::SalesVelocity, "sales velocity", R"(
+            SELECT i.name, CAST(julianday(date(t.date)) + 0.5 AS INTEGER) AS day, SUM(i.quantity)
+            FROM transactions t
+            JOIN transaction_items i ON i.transaction_id = t.id
+            WHERE t.date >= date('now', ?)
+            GROUP BY i.name, day
+            ORDER BY day
+         )", {}, true},
+        {Statement::SalesTotals, "sales totals", R"(
+            SELECT COUNT(*), COALESCE(SUM(total), 0), COALESCE(SUM(total_expense), 0)
+            FROM transactions
+            WHERE date >= ? AND date < ?
+         )", {}},
+        {Statement::BestSellers, "best sellers", R"(
+            SELECT i.name, SUM(i.quantity), SUM(i.subtotal)
+            FROM transactions t
+            JOIN transaction_items i ON i.transaction_id = t.id
+            WHERE t.date >= ? AND t.date < ?
+            GROUP BY i.name
+            ORDER BY 3 DESC
+            LIMIT ?
+         )", {}, true},
+        // multi_store runs it against every other store's database
+        {Statement::StoreProductSales, "store product sales", R"(
+            SELECT i.name, SUM(i.quantity), SUM(i.subtotal), SUM(i.subexpense)
+            FROM transactions t
+            JOIN transaction_items i ON i.transaction_id = t.id
+            WHERE t.date >= ? AND t.date < ?
+            GROUP BY i.name
+         )", {}, true},
+        // one row per category, kept current by triggers on products
+        {Statement::ValuationCurrent, "valuation current", R"(
+            SELECT v.category_id, COALESCE(c.name, 'Uncategorized'), v.units, v.cost_value, v.retail_value
+            FROM stock_valuation v
+            LEFT JOIN categories c ON c.id = v.category_id
+            WHERE v.units != 0 OR v.cost_value != 0 OR v.retail_value != 0
+            ORDER BY v.cost_value DESC
+         )", {"v"}, true},
+        // the recount the triggers are checked against reads the whole catalog on purpose
+        {Statement::ValuationScanned, "valuation scanned", R"(
+            SELECT COALESCE(p.category_id, 0), COALESCE(c.name, 'Uncategorized'),
+                   SUM(p.quantity), SUM(p.quantity * p.bought), SUM(p.quantity * p.price)
+            FROM products p
+            LEFT JOIN categories c ON c.id = p.category_id
+            GROUP BY 1
+            ORDER BY 4 DESC
+         )", {"p"}, true},
+        {Statement::ValuationSnapshotClear, "valuation snapshot clear", "DELETE FROM valuation_snapshots WHERE day = ?", {}},
+        {Statement::ValuationSnapshotInsert, "valuation snapshot insert",
+         "INSERT INTO valuation_snapshots (day, category_id, units, cost_value, retail_value) "
+         "SELECT ?, category_id, units, cost_value, retail_value FROM stock_valuation", {"stock_valuation"}},
+        {Statement::ValuationHistory, "valuation history", R"(
+            SELECT day, SUM(units), SUM(cost_value), SUM(retail_value)
+            FROM valuation_snapshots
+            WHERE day >= ?
+            GROUP BY day
+            ORDER BY day DESC
+         )", {}, true},
+    };
+    return list;
+}
+
+QString registered_sql(Statement id, int listSize) {
+    for (const RegisteredQuery& query : registered_queries()) {
+        if (query.id != id) continue;
+        QString sql = QString::fromUtf8(query.sql);
+        if (!sql.contains("%1")) return sql;
+        QStringList placeholders;
+        for (int i = 0; i < qMax(1, listSize); ++i) placeholders << "?";
+        return sql.arg(placeholders.join(','));
+    }
+    qFatal("statement %d is not registered", int(id));
+    return QString();
+}
+
+//=====================================================================================================================
+
+namespace {
+
+const int categoryCount = 20;
+
+// spread over two years, so date ranges, velocity windows and snapshots all have something to skip
+TxStatus generate_store(QSqlQuery& query, int products, int sales) {
+    for (int c = 1; c <= categoryCount; ++c) {
+        query.prepare(registered_sql(Statement::CategoryInsert));
+        query.addBindValue(QString("Category %1").arg(c));
+        if (!query.exec()) return TxStatus::Error;
+    }
+
+    query.prepare(registered_sql(Statement::ProductInsert));
+    for (int p = 1; p <= products; ++p) {
+        query.bindValue(0, QString("Product %1").arg(p));
+        query.bindValue(1, QString("Category %1").arg(p % categoryCount + 1));
+        query.bindValue(2, 1000);
+        query.bindValue(3, 1.0 + p % 500);
+        query.bindValue(4, 0.5 + p % 400);
+        query.bindValue(5, QString::number(4000000000000LL + p));
+        query.bindValue(6, p % categoryCount + 1);
+        if (!query.exec()) return TxStatus::Error;
+    }
+
+    const QDateTime start = QDateTime::currentDateTimeUtc().addDays(-730);
+    const qint64 step = qMax<qint64>(1, 730LL * 86400 / qMax(1, sales));
+    QSqlQuery items(QSqlDatabase::database());
+    items.prepare("INSERT INTO transaction_items (transaction_id, product_id, name, quantity, price, cost, "
+                  "subtotal, subexpense) VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+    QSqlQuery movements(QSqlDatabase::database());
+    movements.prepare("INSERT INTO stock_movements (product_id, delta, reason, reference, at) VALUES (?, ?, 'sale', ?, ?)");
+    query.prepare(registered_sql(Statement::SaleInsert));
+    for (int s = 1; s <= sales; ++s) {
+        const QString date = start.addSecs(s * step).toString("yyyy-MM-dd HH:mm:ss");
+        query.bindValue(0, s % 7 == 0 ? QString("Client %1").arg(s % 997) : QString());
+        query.bindValue(1, "[]");
+        query.bindValue(2, 10.0 + s % 90);
+        query.bindValue(3, 6.0 + s % 50);
+        query.bindValue(4, date);
+        if (!query.exec()) return TxStatus::Error;
+
+        for (int line = 0; line < 2; ++line) {
+            const int product = (s * 31 + line * 7919) % products + 1;
+            items.bindValue(0, s);
+            items.bindValue(1, product);
+            items.bindValue(2, QString("Product %1").arg(product));
+            items.bindValue(3, 1 + line);
+            items.bindValue(4, 5.0);
+            items.bindValue(5, 3.0);
+            items.bindValue(6, 5.0 * (1 + line));
+            items.bindValue(7, 3.0 * (1 + line));
+            if (!items.exec()) return tx_failed_on(items);
+
+            movements.bindValue(0, product);
+            movements.bindValue(1, -(1 + line));
+            movements.bindValue(2, s);
+            movements.bindValue(3, date);
+            if (!movements.exec()) return tx_failed_on(movements);
+        }
+    }
+
+    QSqlQuery log(QSqlDatabase::database());
+    log.prepare(registered_sql(Statement::ChangeLogInsert));
+    for (int c = 0; c < sales / 10; ++c) {
+        log.bindValue(0, "sale");
+        log.bindValue(1, "{}");
+        log.bindValue(2, register_id());
+        if (!log.exec()) return tx_failed_on(log);
+    }
+
+    for (int month = 0; month < 24; month += 6) {
+        query.prepare("INSERT INTO stock_snapshots (taken_at, last_movement_id) VALUES (?, ?)");
+        query.addBindValue(start.addDays(month * 30).toString("yyyy-MM-dd HH:mm:ss"));
+        query.addBindValue(qint64(sales) * 2 * month / 24);
+        if (!query.exec()) return TxStatus::Error;
+        const QVariant snapshot = query.lastInsertId();
+        query.prepare("INSERT INTO stock_snapshot_rows (snapshot_id, product_id, quantity) "
+                      "SELECT ?, id, quantity FROM products");
+        query.addBindValue(snapshot);
+        if (!query.exec()) return TxStatus::Error;
+    }
+
+    const QDate today = QDate::currentDate();
+    for (int day = 0; day < 365; ++day) {
+        query.prepare("INSERT INTO valuation_snapshots (day, category_id, units, cost_value, retail_value) "
+                      "SELECT ?, category_id, units, cost_value, retail_value FROM stock_valuation");
+        query.addBindValue(today.addDays(-day).toString(Qt::ISODate));
+        if (!query.exec()) return TxStatus::Error;
+    }
+    return TxStatus::Ok;
+}
+
+// "SCAN products", "SCAN i USING COVERING INDEX ...", "SCAN TABLE products AS p" (older sqlite)
+QStringList scanned_names(const QString& detail) {
+    QStringList words = detail.split(' ', Qt::SkipEmptyParts).mid(1);
+    if (words.value(0) == "TABLE") words.removeFirst();
+    QStringList names = {words.value(0)};
+    if (words.value(1) == "AS") names << words.value(2);
+    return names;
+}
+
+// "SCAN t USING INDEX idx_transactions_date", "SCAN i USING COVERING INDEX idx_items_sale"
+QString scanned_index(const QString& detail) {
+    static const QRegularExpression index(" USING (?:COVERING )?INDEX (\\S+)");
+    return index.match(detail).captured(1);
+}
+
+PlanCheck explain(const QString& name, const QString& sql, const QVariantList& binds,
+                  const QStringList& scans, bool sorts) {
+    PlanCheck check;
+    check.name = name;
+
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare("EXPLAIN QUERY PLAN " + sql);
+    for (const QVariant& value : binds) query.addBindValue(value);
+    if (!query.exec()) {
+        check.problems << "cannot explain: " + query.lastError().text();
+        return check;
+    }
+    while (query.next()) {
+        const QString detail = query.value(3).toString();
+        check.plan << detail;
+
+        if (detail.startsWith("USE TEMP B-TREE")) {
+            if (!sorts) check.problems << detail.mid(4).toLower();
+            continue;
+        }
+        if (!detail.startsWith("SCAN ")) continue;
+        if (detail.contains("VIRTUAL TABLE") || detail.contains("CONSTANT ROW")) continue;
+        QStringList names = scanned_names(detail);
+        if (names.first().startsWith('(')) continue;     // a materialized subquery
+        // a scan through an index reads every entry all the same, and a
+        // non-covering one also looks each row up in the table: only the
+        // index walks an entry declares (ORDER BY order under a LIMIT) pass
+        const QString index = scanned_index(detail);
+        if (!index.isEmpty()) names << index;
+        bool declared = false;
+        for (const QString& scanned : names) declared = declared || scans.contains(scanned);
+        if (declared) continue;
+        if (index.isEmpty()) {
+            check.problems << "full scan of " + names.join(" as ");
+        } else {
+            check.problems << QString("full scan of %1 through %2%3").arg(names.first(), index,
+                              detail.contains("COVERING INDEX") ? "" : " with a table lookup per row");
+        }
+    }
+    return check;
+}
+
+PlanCheck explain(const RegisteredQuery& registered) {
+    const QString sql = registered_sql(registered.id, 3);
+    QVariantList binds = registered.sample;
+    while (binds.size() < sql.count('?')) binds << QVariant();
+    return explain(registered.name, sql, binds, registered.scans, registered.sorts);
+}
+
+struct HistoryCheck {
+    QString name;
+    HistoryPage page;
+    QStringList scans;
+    bool sorts = false;
+};
+
+// every sort both ways, from the top, after a cursor on a value, on a NULL
+// key and across into the other range; then the filters, newest first
+QVector<HistoryCheck> history_checks() {
+    static const char* const columns[] = {"id", "name", "date", "total", "expense", "profit"};
+    // what the first page walks under its LIMIT: the table in rowid order or the sort's index
+    static const char* const walks[] = {"transactions", "idx_transactions_name", "idx_transactions_date",
+                                        "idx_transactions_total", "idx_transactions_expense",
+                                        "idx_transactions_profit"};
+    const QVariantList keys = {QVariant(), "Client 5", "2025-01-01 00:00:00", 50.0, 30.0, 20.0};
+
+    QVector<HistoryCheck> checks;
+    for (int column = HistoryModel::IdColumn; column < HistoryModel::ColumnCount; ++column) {
+        for (Qt::SortOrder order : {Qt::DescendingOrder, Qt::AscendingOrder}) {
+            const QString label = QString("history by %1 %2")
+                                      .arg(columns[column], order == Qt::DescendingOrder ? "desc" : "asc");
+            HistoryPage page;
+            page.sortColumn = column;
+            page.order = order;
+            checks.append({label + ", first page", page, {walks[column]}});
+
+            page.hasCursor = true;
+            page.cursorId = 50000;
+            page.cursorKey = keys[column];
+            checks.append({label + ", next page", page, {}});
+            if (column == HistoryModel::IdColumn) continue;
+
+            page.cursorKey = QVariant();
+            checks.append({label + ", NULL keys", page, {}});
+            page.crossNulls = true;
+            checks.append({label + ", other range", page, {}});
+        }
+    }
+
+    // a filtered page sorts what its index found
+    HistoryPage page;
+    page.query.client = "Client 1";
+    checks.append({"history client filter", page, {}, true});
+    page = HistoryPage();
+    page.query.product = "Product 12";
+    checks.append({"history product filter", page, {}, true});
+    page = HistoryPage();
+    page.query.dateFrom = "2025-01-01 00:00:00";
+    page.query.dateTo = "2025-02-01 00:00:00";
+    checks.append({"history date filter", page, {}});
+    page = HistoryPage();
+    page.query.amountMin = 50;
+    page.query.amountMax = 55;
+    checks.append({"history amount filter", page, {}, true});
+    page = HistoryPage();
+    page.query.idMin = 1000;
+    page.query.idMax = 2000;
+    checks.append({"history id filter", page, {}, true});
+    page = HistoryPage();
+    page.query.text = "client";
+    checks.append({"history text search", page, {}, true});
+    page.ranked = true;
+    checks.append({"history text search by relevance", page, {}});
+    return checks;
+}
+
+}
+
+PlanReport check_query_plans(int products, int sales) {
+    PlanReport report;
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        report.error = "cannot create a temporary directory";
+        return report;
+    }
+    const QString dbPath = dir.filePath("plans.db");
+    if (!start_db(dbPath)) {
+        report.error = "cannot create " + dbPath;
+        return report;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+        return generate_store(query, qMax(1, products), qMax(1, sales));
+    });
+    if (tx.outcome != TxOutcome::Committed) {
+        report.error = "generating the store failed: " + tx.message;
+        close_db();
+        return report;
+    }
+    for (const QString& name : pending_index_builds()) {
+        qint64 elapsedMs = 0;
+        QString message;
+        if (!build_index(dbPath, name, elapsedMs, message)) {
+            report.error = "building " + name + " failed: " + message;
+            close_db();
+            return report;
+        }
+    }
+    // the replication statements of the back office read and write its own tables
+    QSqlQuery analyze;
+    if (!create_aggregator_tables(analyze)) {
+        report.error = "creating the back office tables failed: " + analyze.lastError().text();
+        close_db();
+        return report;
+    }
+    // the planner picks by statistics; without them a big table looks like a small one
+    if (!analyze.exec("ANALYZE")) qDebug() << "ANALYZE failed:" << analyze.lastError();
+    report.generateMs = timer.elapsed();
+
+    for (const RegisteredQuery& registered : registered_queries()) {
+        // without fts5 the search index statements never run
+        if (!transaction_search_available() && QString(registered.sql).contains("transactions_fts")) continue;
+        report.queries.append(explain(registered));
+    }
+    for (const HistoryCheck& history : history_checks()) {
+        if (history.page.ranked && !transaction_search_available()) continue;
+        QVariantList binds;
+        const QString sql = history.page.sql(binds);
+        report.queries.append(explain(history.name, sql, binds, history.scans, history.sorts));
+    }
+    for (const PlanCheck& check : report.queries) {
+        if (!check.problems.isEmpty()) ++report.failures;
+    }
+    close_db();
+    return report;
+}
+
+QString plan_report_text(const PlanReport& report, bool verbose) {
+    if (!report.error.isEmpty()) return "plan check failed: " + report.error + "\n";
+
+    QString text;
+    for (const PlanCheck& check : report.queries) {
+        text += QString("%1  %2\n")
+                    .arg(check.problems.isEmpty() ? "ok  " : "FAIL")
+                    .arg(check.name);
+        for (const QString& problem : check.problems) text += "        " + problem + "\n";
+        if (verbose || !check.problems.isEmpty()) {
+            for (const QString& step : check.plan) text += "          | " + step + "\n";
+        }
+    }
+    text += QString("%1 statements, %2 with undeclared scans or sorts (store generated in %3 ms)\n")
+                .arg(report.queries.size())
+                .arg(report.failures)
+                .arg(report.generateMs);
+    return text;
+}
@@ -0,0 +1,115 @@
+#ifndef QUERY_REGISTRY_H
+#define QUERY_REGISTRY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+#include <QVector>
+
+// The statements on paths that grow with the store (every scan, every sale,
+// every history page or report refresh, the API) are declared here once and
+// prepared from registered_sql() at their call sites. check_query_plans()
+// runs EXPLAIN QUERY PLAN on each of them against a generated store and
+// flags every full scan, of a table or through an index (covering or not),
+// and every temp b-tree sort the entry does not declare: a filter that lost
+// its index or an ORDER BY that now sorts fails --check-plans before it
+// reaches a big store. The history pages are composed from filters, so the
+// check explains HistoryPage::sql() over a spread of filters and sorts.
+// Schema changes, migrations and one-off maintenance are not listed.
+
+enum class Statement {
+    ProductsAll,
+    ProductsByIds,
+    ProductStockById,
+    ProductStockByName,
+    ProductRowById,
+    ProductRowByBarcode,
+    ProductForSaleById,
+    ProductForSaleByBarcode,
+    ProductSearch,
+    ProductInsert,
+    ProductUpdate,
+    ProductAdjust,
+    ProductDelete,
+    CategoryInsert,
+    CategoryByName,
+    CategoriesInUse,
+    CategorySales,
+    ProductIdsByCategory,
+    ProductScalePrices,
+    StockLevels,
+    StockLevelsByIds,
+    SaleInsert,
+    SaleDecrementStock,
+    SaleStockLeft,
+    SaleItemInsert,
+    StockMovementInsert,
+    StockSnapshotAt,
+    StockSnapshotRows,
+    StockMovementsSince,
+    StockLastMovement,
+    StockSnapshotInsert,
+    StockSnapshotCopy,
+    StockSnapshotLatest,
+    StockSnapshotFirst,
+    ChangeLogInsert,
+    ChangeLogPending,
+    ChangeLogAcked,
+    SyncStateLoad,
+    SyncStateSave,
+    ReplicationCursorLoad,
+    ReplicationCursorSave,
+    RegisterSaleInsert,
+    RegisterStockInsert,
+    SearchIndexInsert,
+    SearchIndexRange,
+    PromotionsActive,
+    MetaGet,
+    MetaSet,
+    TransactionsByIds,
+    SalesByDaySince,
+    SaleLinesSince,
+    SalesVelocity,
+    SalesTotals,
+    BestSellers,
+    StoreProductSales,
+    ValuationCurrent,
+    ValuationScanned,
+    ValuationSnapshotClear,
+    ValuationSnapshotInsert,
+    ValuationHistory,
+};
+
+struct RegisteredQuery {
+    Statement id;
+    const char* name;
+    const char* sql;            // %1 stands for an IN list of ?
+    QStringList scans;          // tables (or their aliases) read whole on purpose, or indexes walked whole
+                                // in ORDER BY order under a LIMIT
+    bool sorts = false;         // a temp b-tree is expected, eg. grouping on a computed day
+    QVariantList sample;        // bound when explaining, the rest are NULL; LIKE needs a real prefix
+};
+
+const QVector<RegisteredQuery>& registered_queries();
+QString registered_sql(Statement id, int listSize = 1);
+
+struct PlanCheck {
+    QString name;
+    QStringList plan;           // EXPLAIN QUERY PLAN details
+    QStringList problems;       // undeclared scans and sorts, or why it could not be explained
+};
+
+struct PlanReport {
+    QVector<PlanCheck> queries;
+    int failures = 0;
+    qint64 generateMs = 0;
+    QString error;              // the generated database could not be built
+};
+
+// builds a temporary store with `products` products and `sales` two-line
+// sales, every deferred index and fresh ANALYZE statistics, then explains
+// every registered statement; uses the default connection
+PlanReport check_query_plans(int products, int sales);
+QString plan_report_text(const PlanReport& report, bool verbose);
+
+#endif // QUERY_REGISTRY_H
@@ -0,0 +1,141 @@
+#include "receipt_printer.h"
+#include "app_metrics.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QProcess>
+#include <QThreadPool>
+
+namespace {
+
+const char ESC = 0x1b;
+const char GS = 0x1d;
+
+QString money(double value) {
+    return QString::number(value, 'f', 2);
+}
+
+// left text and right text on one line, the left side cut to fit
+QString columns_line(const QString& left, const QString& right, int width) {
+    int room = qMax(0, width - right.size() - 1);
+    return left.left(room).leftJustified(room) + ' ' + right;
+}
+
+QString centered(const QString& text, int width) {
+    QString cut = text.left(width);
+    return QString((width - cut.size()) / 2, ' ') + cut;
+}
+
+// ESC/POS printers only know single byte code pages
+QByteArray printer_bytes(const QString& text, ReceiptFormat format) {
+    return format == ReceiptFormat::EscPos ? text.toLatin1() : text.toUtf8();
+}
+
+}
+
+QByteArray render_receipt(const Receipt& receipt, ReceiptFormat format, int columns) {
+    const bool escpos = format == ReceiptFormat::EscPos;
+    QString storeName = qEnvironmentVariable("STOCKING_STORE_NAME", "Stocking");
+    QString separator(columns, '-');
+
+    QByteArray out;
+    auto line = [&](const QString& text) { out += printer_bytes(text, format) + '\n'; };
+
+    if (escpos) out += QByteArray() + ESC + '@' + ESC + 'a' + char(1) + ESC + 'E' + char(1);
+    line(escpos ? storeName : centered(storeName, columns));
+    if (escpos) out += QByteArray() + ESC + 'E' + char(0);
+
+    QDateTime when = QDateTime::fromString(QString(receipt.date).replace(' ', 'T') + 'Z', Qt::ISODate);
+    QString stamp = when.isValid() ? when.toLocalTime().toString("yyyy-MM-dd HH:mm") : receipt.date;
+    QString number = QString("Receipt #%1").arg(receipt.transactionId, 8, 10, QChar('0'));
+    line(escpos ? number : centered(number, columns));
+    line(escpos ? stamp : centered(stamp, columns));
+    if (escpos) out += QByteArray() + ESC + 'a' + char(0);
+
+    if (!receipt.client.isEmpty()) line("Client: " + receipt.client);
+    line(separator);
+
+    double discounts = 0;
+    for (const QJsonValue& value : receipt.items) {
+        QJsonObject item = value.toObject();
+        int quantity = item["quantity"].toInt();
+        double price = item["price"].toDouble();
+        double discount = item["discount"].toDouble();
+        discounts += discount;
+
+        line(item["name"].toString().left(columns));
+        line(columns_line(QString("  %1 x %2").arg(quantity).arg(money(price)), money(quantity * price), columns));
+        if (discount > 0) line(columns_line("  discount", "-" + money(discount), columns));
+    }
+
+    line(separator);
+    if (discounts > 0) line(columns_line("You saved", money(discounts), columns));
+    if (escpos) out += QByteArray() + ESC + 'E' + char(1) + GS + '!' + char(0x11);
+    // double size halves the usable width
+    line(columns_line("TOTAL", money(receipt.total) + " DZD", escpos ? columns / 2 : columns));
+    if (escpos) out += QByteArray() + GS + '!' + char(0) + ESC + 'E' + char(0);
+
+    line(QString());
+    line(escpos ? QString("Thank you!") : centered("Thank you!", columns));
+
+    // feed past the tear bar and cut
+    if (escpos) out += QByteArray() + ESC + 'd' + char(4) + GS + 'V' + char(66) + char(0);
+    else out += "\n\n";
+    return out;
+}
+
+//=====================================================================================================================
+
+ReceiptPrinter::ReceiptPrinter(QObject* parent)
+    : QObject(parent)
+    , printerTarget(qEnvironmentVariable("STOCKING_RECEIPT_PRINTER").trimmed())
+{
+    QString formatName = qEnvironmentVariable("STOCKING_RECEIPT_FORMAT").toLower();
+    bool device = printerTarget.startsWith("/dev/") || printerTarget.startsWith("COM", Qt::CaseInsensitive);
+    if (formatName.isEmpty()) formatName = device ? "escpos" : "text";
+    format = formatName == "escpos" ? ReceiptFormat::EscPos : ReceiptFormat::Text;
+
+    int width = qEnvironmentVariableIntValue("STOCKING_RECEIPT_COLUMNS");
+    columns = width >= 24 ? width : 42;
+}
+
+void ReceiptPrinter::print(const Receipt& receipt) {
+    if (!enabled()) return;
+
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray bytes = render_receipt(receipt, format, columns);
+    record_timing("receipt render", timer.elapsed());
+
+    if (printerTarget.startsWith('|')) {
+        QStringList command = QProcess::splitCommand(printerTarget.mid(1).trimmed());
+        if (command.isEmpty()) return;
+
+        QProcess* process = new QProcess(this);
+        connect(process, &QProcess::errorOccurred, process, [process](QProcess::ProcessError) {
+            qDebug() << "Receipt printer command failed:" << process->errorString();
+            process->deleteLater();
+        });
+        connect(process, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), process, &QObject::deleteLater);
+        process->start(command.takeFirst(), command);
+        process->write(bytes);
+        process->closeWriteChannel();
+        return;
+    }
+
+    // a device can stall (paper out, offline), so never write from the GUI thread
+    QString path = printerTarget;
+    QThreadPool::globalInstance()->start([path, bytes]() {
+        QElapsedTimer timer;
+        timer.start();
+        QFile device(path);
+        if (!device.open(QIODevice::WriteOnly | QIODevice::Append) || device.write(bytes) != bytes.size()) {
+            qDebug() << "Receipt printer" << path << "failed:" << device.errorString();
+            return;
+        }
+        device.close();
+        record_timing("receipt print", timer.elapsed());
+    });
+}
@@ -0,0 +1,46 @@
+#ifndef RECEIPT_PRINTER_H
+#define RECEIPT_PRINTER_H
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QObject>
+#include <QString>
+
+struct Receipt {
+    int transactionId = 0;
+    QString client;
+    QString date;       // as stored, UTC
+    QJsonArray items;   // transactions.details
+    double total = 0;
+};
+
+enum class ReceiptFormat { Text, EscPos };
+
+// Fixed-width receipt for 58/80 mm thermal printers: plain UTF-8 text, or an
+// ESC/POS byte stream (init, bold/centered header, double size total, cut).
+QByteArray render_receipt(const Receipt& receipt, ReceiptFormat format, int columns = 42);
+
+// Sends receipts to where STOCKING_RECEIPT_PRINTER points, without blocking
+// the register and without dialogs:
+//   /dev/usb/lp0, COM3, receipts.txt   written (appended) on the thread pool
+//   |lp -d thermal                     piped to the command's stdin
+// Unset, printing is off and print() does nothing.
+// STOCKING_RECEIPT_FORMAT is "escpos" (default for /dev and COM ports) or "text".
+class ReceiptPrinter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReceiptPrinter(QObject* parent = nullptr);
+
+    void print(const Receipt& receipt);
+    bool enabled() const { return !printerTarget.isEmpty(); }
+    QString target() const { return printerTarget; }
+
+private:
+    QString printerTarget;
+    ReceiptFormat format;
+    int columns;
+};
+
+#endif // RECEIPT_PRINTER_H
@@ -0,0 +1,352 @@
+#include "replication.h"
+#include "query_registry.h"
+#include "db_concurrency.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSqlError>
+#include <QTimer>
+
+namespace {
+
+const int maxRetryMs = 30000;
+
+void write_frame(QLocalSocket* socket, const QJsonObject& message) {
+    QDataStream stream(socket);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << qCompress(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+// returns false while the frame is still incomplete
+bool read_frame(QLocalSocket* socket, QJsonObject& message) {
+    QDataStream stream(socket);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream.startTransaction();
+    QByteArray frame;
+    stream >> frame;
+    if (!stream.commitTransaction()) return false;
+    message = QJsonDocument::fromJson(qUncompress(frame)).object();
+    return true;
+}
+
+}
+
+QString default_sync_server() {
+    QString name = qEnvironmentVariable("STOCKING_SYNC_SERVER");
+    return name.isEmpty() ? QString("stocking_backoffice") : name;
+}
+
+bool sync_enabled() {
+    return qEnvironmentVariableIsSet("STOCKING_SYNC_SERVER");
+}
+
+bool create_change_log(QSqlQuery& query) {
+    return query.exec(R"(
+        CREATE TABLE IF NOT EXISTS change_log (
+            seq INTEGER PRIMARY KEY AUTOINCREMENT,
+            kind TEXT NOT NULL,
+            payload TEXT NOT NULL
+        )
+    )")
+    && query.exec(R"(
+        CREATE TABLE IF NOT EXISTS sync_state (
+            peer TEXT PRIMARY KEY,
+            acked_seq INTEGER NOT NULL
+        )
+    )");
+}
+
+// rows from before the writer was recorded are claimed by the register that migrates
+bool add_change_log_writer(QSqlQuery& query) {
+    if (!query.exec("ALTER TABLE change_log ADD COLUMN register_id TEXT")) return false;
+    query.prepare("UPDATE change_log SET register_id = ?");
+    query.addBindValue(register_id());
+    return query.exec()
+        && query.exec("CREATE INDEX IF NOT EXISTS idx_change_log_register ON change_log(register_id, seq)");
+}
+
+bool append_change(QSqlQuery& query, const QString& kind, const QJsonObject& payload) {
+    // nothing would ever ship or prune the rows
+    if (!sync_enabled()) return true;
+
+    query.prepare(registered_sql(Statement::ChangeLogInsert));
+    query.addBindValue(kind);
+    query.addBindValue(QString::fromUtf8(QJsonDocument(payload).toJson(QJsonDocument::Compact)));
+    query.addBindValue(register_id());
+    return query.exec();
+}
+
+//=====================================================================================================================
+
+SyncClient::SyncClient(const QString& serverName, QObject* parent)
+    : QObject(parent)
+    , serverName(serverName)
+    , peer(serverName + '/' + register_id())
+    , socket(new QLocalSocket(this))
+    , retryTimer(new QTimer(this))
+{
+    retryTimer->setSingleShot(true);
+    connect(retryTimer, &QTimer::timeout, this, &SyncClient::connect_to_server);
+
+    connect(socket, &QLocalSocket::connected, this, [this]() {
+        retryMs = 1000;
+        inFlightUpTo = 0;
+        send_next_batch();
+    });
+    connect(socket, &QLocalSocket::readyRead, this, &SyncClient::read_acks);
+    connect(socket, &QLocalSocket::disconnected, this, [this]() {
+        inFlightUpTo = 0;
+        schedule_retry();
+    });
+    connect(socket, &QLocalSocket::errorOccurred, this, [this](QLocalSocket::LocalSocketError) {
+        if (socket->state() == QLocalSocket::UnconnectedState) schedule_retry();
+    });
+}
+
+void SyncClient::start() {
+    QSqlQuery query;
+    query.prepare(registered_sql(Statement::SyncStateLoad));
+    query.addBindValue(peer);
+    if (query.exec() && query.next()) ackedSeq = query.value(0).toLongLong();
+
+    connect_to_server();
+}
+
+void SyncClient::poke() {
+    if (socket->state() == QLocalSocket::ConnectedState) send_next_batch();
+}
+
+void SyncClient::connect_to_server() {
+    if (socket->state() != QLocalSocket::UnconnectedState) return;
+    socket->connectToServer(serverName);
+}
+
+void SyncClient::schedule_retry() {
+    if (retryTimer->isActive()) return;
+    retryTimer->start(retryMs);
+    retryMs = qMin(retryMs * 2, maxRetryMs);
+}
+
+void SyncClient::send_next_batch() {
+    // one batch in flight at a time, the next one goes out when this is acked
+    if (inFlightUpTo > 0) return;
+
+    QSqlQuery query;
+    query.prepare(registered_sql(Statement::ChangeLogPending));
+    query.addBindValue(register_id());
+    query.addBindValue(ackedSeq);
+    query.addBindValue(batchSize);
+    if (!query.exec()) {
+        qDebug() << "Sync: reading change log failed:" << query.lastError();
+        return;
+    }
+
+    QJsonArray changes;
+    while (query.next()) {
+        QJsonObject change;
+        change["seq"] = query.value(0).toLongLong();
+        change["kind"] = query.value(1).toString();
+        change["payload"] = QJsonDocument::fromJson(query.value(2).toString().toUtf8()).object();
+        changes.append(change);
+        inFlightUpTo = query.value(0).toLongLong();
+    }
+    if (changes.isEmpty()) return;
+
+    QJsonObject batch;
+    batch["type"] = "batch";
+    batch["register"] = register_id();
+    batch["changes"] = changes;
+    write_frame(socket, batch);
+}
+
+void SyncClient::read_acks() {
+    QJsonObject message;
+    bool nacked = false;
+    while (read_frame(socket, message)) {
+        if (message["type"].toString() == "nack") {
+            nacked = true;
+            continue;
+        }
+        if (message["type"].toString() != "ack") continue;
+
+        retryMs = 1000;
+        qint64 upTo = message["upTo"].toVariant().toLongLong();
+        if (upTo <= ackedSeq) {
+            inFlightUpTo = 0;
+            continue;
+        }
+        ackedSeq = upTo;
+        inFlightUpTo = 0;
+
+        // remember the cursor and drop what the back office now holds
+        TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+            query.prepare(registered_sql(Statement::SyncStateSave));
+            query.addBindValue(peer);
+            query.addBindValue(ackedSeq);
+            if (!query.exec()) return TxStatus::Error;
+            query.prepare(registered_sql(Statement::ChangeLogAcked));
+            query.addBindValue(register_id());
+            query.addBindValue(ackedSeq);
+            return query.exec() ? TxStatus::Ok : TxStatus::Error;
+        });
+        if (tx.outcome != TxOutcome::Committed) {
+            qDebug() << "Sync: saving ack failed:" << tx.message;
+        }
+    }
+    if (nacked) {
+        // the back office could not store the batch; it stays in flight, so
+        // poke() waits too, until it is re-sent after a backoff
+        QTimer::singleShot(retryMs, this, [this]() {
+            inFlightUpTo = 0;
+            send_next_batch();
+        });
+        retryMs = qMin(retryMs * 2, maxRetryMs);
+        return;
+    }
+    send_next_batch();
+}
+
+//=====================================================================================================================
+
+SyncAggregator::SyncAggregator(QObject* parent)
+    : QObject(parent)
+    , server(new QLocalServer(this))
+{
+    connect(server, &QLocalServer::newConnection, this, [this]() {
+        while (QLocalSocket* client = server->nextPendingConnection()) {
+            connect(client, &QLocalSocket::readyRead, this, [this, client]() { read_batches(client); });
+            connect(client, &QLocalSocket::disconnected, client, &QObject::deleteLater);
+        }
+    });
+}
+
+bool create_aggregator_tables(QSqlQuery& query) {
+    return query.exec(R"(
+        CREATE TABLE IF NOT EXISTS register_sales (
+            register_id TEXT NOT NULL,
+            seq INTEGER NOT NULL,
+            transaction_id INTEGER,
+            name TEXT,
+            details TEXT,
+            total REAL,
+            total_expense REAL,
+            date TIMESTAMP,
+            PRIMARY KEY (register_id, seq)
+        )
+    )")
+    && query.exec(R"(
+        CREATE TABLE IF NOT EXISTS register_stock (
+            register_id TEXT NOT NULL,
+            seq INTEGER NOT NULL,
+            product TEXT NOT NULL,
+            delta INTEGER NOT NULL,
+            reason TEXT,
+            PRIMARY KEY (register_id, seq)
+        )
+    )")
+    && query.exec(R"(
+        CREATE TABLE IF NOT EXISTS replication_cursor (
+            register_id TEXT PRIMARY KEY,
+            applied_seq INTEGER NOT NULL
+        )
+    )");
+}
+
+bool SyncAggregator::listen(const QString& serverName) {
+    QSqlQuery query;
+    if (!create_aggregator_tables(query)) {
+        qDebug() << "Aggregator: creating tables failed:" << query.lastError();
+        return false;
+    }
+
+    QLocalServer::removeServer(serverName);
+    if (!server->listen(serverName)) {
+        qDebug() << "Aggregator: listen failed:" << server->errorString();
+        return false;
+    }
+    qDebug() << "Aggregator: listening on" << server->fullServerName();
+    return true;
+}
+
+void SyncAggregator::read_batches(QLocalSocket* client) {
+    QJsonObject message;
+    while (read_frame(client, message)) {
+        if (message["type"].toString() != "batch") continue;
+
+        QString registerId = message["register"].toString();
+        qint64 applied = apply_batch(registerId, message["changes"].toArray());
+        if (applied < 0) {
+            // the register keeps the batch in flight until it hears back
+            QJsonObject nack;
+            nack["type"] = "nack";
+            nack["register"] = registerId;
+            write_frame(client, nack);
+            continue;
+        }
+
+        QJsonObject ack;
+        ack["type"] = "ack";
+        ack["register"] = registerId;
+        ack["upTo"] = applied;
+        write_frame(client, ack);
+    }
+}
+
+// returns the highest seq now stored for this register, or -1 on failure
+qint64 SyncAggregator::apply_batch(const QString& registerId, const QJsonArray& changes) {
+    qint64 applied = 0;
+
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+        query.prepare(registered_sql(Statement::ReplicationCursorLoad));
+        query.addBindValue(registerId);
+        if (!query.exec()) return TxStatus::Error;
+        applied = query.next() ? query.value(0).toLongLong() : 0;
+
+        for (const QJsonValue& value : changes) {
+            QJsonObject change = value.toObject();
+            qint64 seq = change["seq"].toVariant().toLongLong();
+            if (seq <= applied) continue; // replayed batch
+
+            QString kind = change["kind"].toString();
+            QJsonObject payload = change["payload"].toObject();
+
+            if (kind == "sale") {
+                query.prepare(registered_sql(Statement::RegisterSaleInsert));
+                query.addBindValue(registerId);
+                query.addBindValue(seq);
+                query.addBindValue(payload["transaction_id"].toInt());
+                query.addBindValue(payload["name"].toString());
+                query.addBindValue(payload["details"].toString());
+                query.addBindValue(payload["total"].toDouble());
+                query.addBindValue(payload["total_expense"].toDouble());
+                query.addBindValue(payload["date"].toString());
+            } else if (kind == "stock") {
+                query.prepare(registered_sql(Statement::RegisterStockInsert));
+                query.addBindValue(registerId);
+                query.addBindValue(seq);
+                query.addBindValue(payload["product"].toString());
+                query.addBindValue(payload["delta"].toInt());
+                query.addBindValue(payload["reason"].toString());
+            } else {
+                qDebug() << "Aggregator: skipping unknown change kind" << kind;
+                applied = seq;
+                continue;
+            }
+            if (!query.exec()) return TxStatus::Error;
+            applied = seq;
+        }
+
+        query.prepare(registered_sql(Statement::ReplicationCursorSave));
+        query.addBindValue(registerId);
+        query.addBindValue(applied);
+        return query.exec() ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Aggregator: batch from" << registerId << "failed:" << tx.message;
+        return -1;
+    }
+    return applied;
+}
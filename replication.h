@@ -0,0 +1,86 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QSqlQuery>
+#include <QString>
+
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+
+// Register -> back-office replication.
+//
+// Every write transaction that changes sales or stock also appends a row to
+// the local change_log table, in the same transaction, so the log is exactly
+// as durable as the data. Each row records the register that wrote it, and a
+// register ships and prunes only its own rows, so registers sharing one
+// database neither double count nor drop each other's unsent changes
+// (STOCKING_REGISTER_ID tells apart registers on one machine).
+// SyncClient ships unacknowledged rows in compressed
+// batches over a QLocalSocket; the aggregator applies a batch in one
+// transaction keyed by (register, seq) and acknowledges the highest seq it
+// holds, so a batch that is re-sent after a lost ack is simply ignored.
+//
+// Wire format: QDataStream QByteArray frames, each one a qCompress()ed json
+// object. {"type":"batch","register":..,"changes":[{seq,kind,payload}]}
+// from the register, {"type":"ack","register":..,"upTo":seq} back, or
+// {"type":"nack","register":..} when the batch could not be stored and is
+// to be re-sent.
+
+QString default_sync_server();
+// registers replicate only when STOCKING_SYNC_SERVER is set; otherwise no
+// change_log rows are written at all
+bool sync_enabled();
+bool create_change_log(QSqlQuery& query);
+bool add_change_log_writer(QSqlQuery& query);
+bool append_change(QSqlQuery& query, const QString& kind, const QJsonObject& payload);
+// the back office's tables, made by SyncAggregator::listen()
+bool create_aggregator_tables(QSqlQuery& query);
+
+class SyncClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SyncClient(const QString& serverName = default_sync_server(), QObject* parent = nullptr);
+
+    void start();
+    // new changes were committed, ship them when the socket is free
+    void poke();
+
+private:
+    void connect_to_server();
+    void send_next_batch();
+    void read_acks();
+    void schedule_retry();
+
+    QString serverName;
+    QString peer;               // sync_state key: registers sharing a database keep their own cursor
+    QLocalSocket* socket;
+    QTimer* retryTimer;
+    qint64 ackedSeq = 0;
+    qint64 inFlightUpTo = 0;
+    int retryMs = 1000;
+    int batchSize = 500;
+};
+
+class SyncAggregator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SyncAggregator(QObject* parent = nullptr);
+
+    bool listen(const QString& serverName = default_sync_server());
+
+private:
+    void read_batches(QLocalSocket* client);
+    qint64 apply_batch(const QString& registerId, const QJsonArray& changes);
+
+    QLocalServer* server;
+};
+
+#endif // REPLICATION_H
@@ -0,0 +1,148 @@
+#include "sales_analytics.h"
+#include "query_registry.h"
+#include "checkout.h"
+#include "memory_budget.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <algorithm>
+
+namespace {
+
+const int maxCachedPeriods = 16;      // every date picker change is a new period
+
+}
+
+// lines the backfill copies get new rowids, so they are picked up here as they land
+void SalesAnalytics::refresh() {
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare(registered_sql(Statement::SaleLinesSince));
+    query.addBindValue(lastRowId);
+    if (!query.exec()) {
+        qDebug() << "Loading sale lines failed:" << query.lastError();
+        return;
+    }
+
+    while (query.next()) {
+        lastRowId = query.value(0).toLongLong();
+
+        QString name = query.value(1).toString();
+        auto it = productIndex.constFind(name);
+        if (it == productIndex.constEnd()) {
+            it = productIndex.insert(name, names.size());
+            names << name;
+        }
+
+        product.push_back(it.value());
+        quantity.push_back(query.value(2).toInt());
+        subtotal.push_back(query.value(3).toDouble());
+        subexpense.push_back(query.value(4).toDouble());
+        day.push_back(query.value(5).toInt());
+    }
+}
+
+void SalesAnalytics::accumulate(Totals& totals, qint32 fromDay, qint32 toDay) const {
+    const size_t productCount = names.size();
+    totals.units.resize(productCount, 0);
+    totals.revenue.resize(productCount, 0.0);
+    totals.cost.resize(productCount, 0.0);
+
+    const qint32* p = product.data();
+    const qint32* d = day.data();
+    const qint32* q = quantity.data();
+    const double* s = subtotal.data();
+    const double* e = subexpense.data();
+    qint64* units = totals.units.data();
+    double* revenue = totals.revenue.data();
+    double* cost = totals.cost.data();
+
+    // no branch on the date: lines outside the period add zero, which keeps the
+    // loop free of unpredictable jumps over unsorted dates
+    const size_t end = day.size();
+    for (size_t i = totals.linesSeen; i < end; ++i) {
+        const int in = (d[i] >= fromDay) & (d[i] <= toDay);
+        units[p[i]] += in * q[i];
+        revenue[p[i]] += in * s[i];
+        cost[p[i]] += in * e[i];
+    }
+    totals.linesSeen = end;
+}
+
+qint64 SalesAnalytics::footprint() const {
+    qint64 bytes = qint64(product.capacity() + day.capacity() + quantity.capacity()) * sizeof(qint32)
+                   + qint64(subtotal.capacity() + subexpense.capacity()) * sizeof(double);
+    // each name is held by the list and as a key of the index
+    for (const QString& name : names) bytes += 2 * string_bytes(name) + 16;
+    for (const Totals& totals : cache) {
+        bytes += qint64(totals.units.capacity()) * sizeof(qint64)
+                 + qint64(totals.revenue.capacity() + totals.cost.capacity()) * sizeof(double) + 64;
+    }
+    return bytes;
+}
+
+qint64 SalesAnalytics::trim(qint64 bytes) {
+    const qint64 before = footprint();
+    cache.clear();
+    cache.squeeze();
+    cacheOrder.clear();
+    if (before - footprint() < bytes) {
+        std::vector<qint32>().swap(product);
+        std::vector<qint32>().swap(day);
+        std::vector<qint32>().swap(quantity);
+        std::vector<double>().swap(subtotal);
+        std::vector<double>().swap(subexpense);
+        names.clear();
+        productIndex.clear();
+        productIndex.squeeze();
+        lastRowId = 0;
+    }
+    return before - footprint();
+}
+
+SalesReport SalesAnalytics::report(const QDate& from, const QDate& to) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // checked first: lines copied after the refresh would be missing from a "complete" report
+    const bool partial = sale_items_backfill_pending();
+    refresh();
+
+    const qint32 fromDay = qint32(from.toJulianDay());
+    const qint32 toDay = qint32(to.toJulianDay());
+    const QPair<qint32, qint32> period = qMakePair(fromDay, toDay);
+    cacheOrder.removeOne(period);
+    cacheOrder.append(period);
+    if (cacheOrder.size() > maxCachedPeriods) cache.remove(cacheOrder.takeFirst());
+    Totals& totals = cache[period];
+    if (totals.linesSeen < day.size()) accumulate(totals, fromDay, toDay);
+
+    const double days = qMax<qint64>(1, from.daysTo(to) + 1);
+
+    SalesReport result;
+    result.partial = partial;
+    for (size_t i = 0; i < totals.units.size(); ++i) {
+        if (totals.units[i] == 0 && totals.revenue[i] == 0) continue;
+
+        ProductSales sales;
+        sales.name = names[int(i)];
+        sales.units = totals.units[i];
+        sales.revenue = totals.revenue[i];
+        sales.cost = totals.cost[i];
+        sales.perDay = sales.units / days;
+        result.products.append(sales);
+
+        result.units += sales.units;
+        result.revenue += sales.revenue;
+        result.cost += sales.cost;
+    }
+
+    std::sort(result.products.begin(), result.products.end(), [](const ProductSales& a, const ProductSales& b) {
+        return a.revenue != b.revenue ? a.revenue > b.revenue : a.units > b.units;
+    });
+    for (int i = 0; i < result.products.size(); ++i) result.products[i].rank = i + 1;
+
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
@@ -0,0 +1,78 @@
+#ifndef SALES_ANALYTICS_H
+#define SALES_ANALYTICS_H
+
+#include <QDate>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <vector>
+
+struct ProductSales {
+    QString name;
+    int rank = 0;
+    qint64 units = 0;
+    double revenue = 0;
+    double cost = 0;
+    double perDay = 0;    // units per day of the period
+
+    double margin() const { return revenue > 0 ? (revenue - cost) / revenue * 100.0 : 0.0; }
+};
+
+struct SalesReport {
+    QVector<ProductSales> products;   // best seller (revenue) first
+    qint64 units = 0;
+    double revenue = 0;
+    double cost = 0;
+    qint64 elapsedMs = 0;
+    bool partial = false;             // old sales are still being copied into transaction_items
+};
+
+// Per-product sales over a period, computed in memory from transaction_items.
+// Line items are kept column by column (dense product index, day, quantity,
+// subtotal, subexpense) and only rows added since the last refresh are read
+// from sqlite. Per period totals are cached and extended with the new lines,
+// so asking for the same period again only touches what was sold since; the
+// most recently asked periods are kept.
+// Sales from before transaction_items existed arrive as the background
+// backfill copies them; until then a report is marked partial.
+class SalesAnalytics
+{
+public:
+    // from and to are inclusive days
+    SalesReport report(const QDate& from, const QDate& to);
+    void refresh();
+
+    size_t line_count() const { return day.size(); }
+    qint64 footprint() const;
+    // period totals go first, then the line columns, which the next report reads back
+    qint64 trim(qint64 bytes);
+
+private:
+    struct Totals {
+        std::vector<qint64> units;
+        std::vector<double> revenue;
+        std::vector<double> cost;
+        size_t linesSeen = 0;
+    };
+
+    void accumulate(Totals& totals, qint32 fromDay, qint32 toDay) const;
+
+    // one entry per line item, all the same length
+    std::vector<qint32> product;
+    std::vector<qint32> day;          // QDate julian day
+    std::vector<qint32> quantity;
+    std::vector<double> subtotal;
+    std::vector<double> subexpense;
+
+    QStringList names;                // dense product index -> name
+    QHash<QString, qint32> productIndex;
+    qint64 lastRowId = 0;
+
+    QHash<QPair<qint32, qint32>, Totals> cache;
+    QList<QPair<qint32, qint32>> cacheOrder;  // least recently asked first
+};
+
+#endif // SALES_ANALYTICS_H
@@ -0,0 +1,138 @@
+#include "sales_chart.h"
+#include <QComboBox>
+#include <QPainter>
+#include <QPainterPath>
+#include <QHBoxLayout>
+
+namespace {
+
+struct Line {
+    const char* label;
+    QColor color;
+    Qt::PenStyle style;
+    double SalesPoint::*value;
+};
+
+const Line lines[] = {
+    {"Revenue", QColor(0x1e, 0x88, 0xe5), Qt::SolidLine, &SalesPoint::revenue},
+    {"Profit", QColor(0x43, 0xa0, 0x47), Qt::SolidLine, &SalesPoint::profit},
+    {"Moving average", QColor(0xfb, 0x8c, 0x00), Qt::DashLine, &SalesPoint::average},
+    {"Last year", QColor(0x9e, 0x9e, 0x9e), Qt::DotLine, &SalesPoint::lastYear},
+};
+
+}
+
+SalesChart::SalesChart(SalesTimeSeries* series, QWidget* parent)
+    : QWidget(parent)
+    , series(series)
+    , granularityBox(new QComboBox(this))
+    , from(QDate::currentDate())
+    , to(QDate::currentDate())
+{
+    setMinimumHeight(240);
+
+    granularityBox->addItem("Daily", int(Granularity::Day));
+    granularityBox->addItem("Weekly", int(Granularity::Week));
+    granularityBox->addItem("Monthly", int(Granularity::Month));
+    connect(granularityBox, qOverload<int>(&QComboBox::currentIndexChanged), this, [this]() { rebuild(); });
+
+    QHBoxLayout* layout = new QHBoxLayout(this);
+    layout->addStretch();
+    layout->addWidget(granularityBox, 0, Qt::AlignTop);
+}
+
+void SalesChart::show_range(const QString& text, const QDate& start, const QDate& end, Granularity granularity) {
+    title = text;
+    from = start;
+    to = end;
+    series->refresh();
+
+    QSignalBlocker blocker(granularityBox);
+    granularityBox->setCurrentIndex(granularityBox->findData(int(granularity)));
+    rebuild();
+}
+
+void SalesChart::refresh() {
+    series->refresh();
+    rebuild();
+}
+
+void SalesChart::rebuild() {
+    Granularity granularity = Granularity(granularityBox->currentData().toInt());
+    points = series->series(granularity, from, to);
+    totals = series->totals(from, to);
+    update();
+}
+
+void SalesChart::paintEvent(QPaintEvent*) {
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    QFont font = painter.font();
+    font.setBold(true);
+    painter.setFont(font);
+    painter.drawText(QRect(12, 8, width() - 24, 20), Qt::AlignLeft | Qt::AlignVCenter,
+                     QString("%1   Revenue: %2 DZD   Expenses: %3 DZD   Net Profit: %4 DZD")
+                         .arg(title)
+                         .arg(totals.revenue, 0, 'f', 2)
+                         .arg(totals.expenses, 0, 'f', 2)
+                         .arg(totals.profit(), 0, 'f', 2));
+    font.setBold(false);
+    painter.setFont(font);
+
+    // legend
+    int x = 12;
+    for (const Line& line : lines) {
+        painter.setPen(QPen(line.color, 2, line.style));
+        painter.drawLine(x, 40, x + 24, 40);
+        painter.setPen(palette().color(QPalette::WindowText));
+        painter.drawText(x + 30, 45, line.label);
+        x += 40 + painter.fontMetrics().horizontalAdvance(line.label);
+    }
+
+    const QRect plot(64, 60, width() - 84, height() - 90);
+    if (points.isEmpty() || plot.width() < 10 || plot.height() < 10) return;
+
+    double low = 0, high = 0;
+    for (const SalesPoint& point : points) {
+        for (const Line& line : lines) {
+            low = qMin(low, point.*line.value);
+            high = qMax(high, point.*line.value);
+        }
+    }
+    if (high - low < 1e-9) high = low + 1;
+
+    auto x_at = [&](int i) {
+        return points.size() == 1 ? plot.center().x() : plot.left() + plot.width() * i / double(points.size() - 1);
+    };
+    auto y_at = [&](double value) { return plot.bottom() - (value - low) / (high - low) * plot.height(); };
+
+    // axes, zero line and a few labels
+    painter.setPen(palette().color(QPalette::Mid));
+    painter.drawLine(plot.bottomLeft(), plot.bottomRight());
+    painter.drawLine(plot.bottomLeft(), plot.topLeft());
+    if (low < 0) painter.drawLine(QPointF(plot.left(), y_at(0)), QPointF(plot.right(), y_at(0)));
+
+    painter.setPen(palette().color(QPalette::WindowText));
+    painter.drawText(QRect(0, plot.top() - 8, plot.left() - 6, 16), Qt::AlignRight | Qt::AlignVCenter, QString::number(high, 'f', 0));
+    painter.drawText(QRect(0, plot.bottom() - 8, plot.left() - 6, 16), Qt::AlignRight | Qt::AlignVCenter, QString::number(low, 'f', 0));
+
+    const int labelCount = qMin<int>(points.size(), qMax(2, plot.width() / 110));
+    for (int n = 0; n < labelCount; ++n) {
+        int i = labelCount == 1 ? 0 : n * (points.size() - 1) / (labelCount - 1);
+        painter.drawText(QRectF(x_at(i) - 50, plot.bottom() + 4, 100, 20), Qt::AlignHCenter | Qt::AlignTop,
+                         points[i].start.toString("yyyy-MM-dd"));
+    }
+
+    for (const Line& line : lines) {
+        QPainterPath path;
+        for (int i = 0; i < points.size(); ++i) {
+            QPointF p(x_at(i), y_at(points[i].*line.value));
+            if (i == 0) path.moveTo(p);
+            else path.lineTo(p);
+        }
+        painter.setPen(QPen(line.color, 2, line.style));
+        painter.drawPath(path);
+        if (points.size() == 1) painter.drawEllipse(path.currentPosition(), 3, 3);
+    }
+}
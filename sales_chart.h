@@ -0,0 +1,38 @@
+#ifndef SALES_CHART_H
+#define SALES_CHART_H
+
+#include "sales_series.h"
+#include <QWidget>
+
+class QComboBox;
+
+// Revenue / profit over time for the History page: revenue, profit, the
+// moving average of revenue and the same period a year earlier, with the
+// totals of the range on top. Reads everything from a SalesTimeSeries, so
+// switching range or granularity never goes back to the database.
+class SalesChart : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit SalesChart(SalesTimeSeries* series, QWidget* parent = nullptr);
+
+    void show_range(const QString& title, const QDate& from, const QDate& to, Granularity granularity);
+    void refresh();     // picks up new transactions and redraws the current range
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    void rebuild();
+
+    SalesTimeSeries* series;
+    QComboBox* granularityBox;
+    QString title;
+    QDate from;
+    QDate to;
+    QVector<SalesPoint> points;
+    SalesTotals totals;
+};
+
+#endif // SALES_CHART_H
@@ -0,0 +1,117 @@
+#include "sales_series.h"
+#include "query_registry.h"
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+
+void SalesTimeSeries::refresh() {
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare(registered_sql(Statement::SalesByDaySince));
+    query.addBindValue(lastId);
+    if (!query.exec()) {
+        qDebug() << "Loading sales series failed:" << query.lastError();
+        return;
+    }
+
+    while (query.next()) {
+        QDate day = QDate::fromJulianDay(query.value(0).toLongLong());
+        double revenue = query.value(1).toDouble();
+        double cost = query.value(2).toDouble();
+        lastId = qMax(lastId, query.value(3).toLongLong());
+        if (!day.isValid()) continue;
+
+        for (Granularity granularity : {Granularity::Day, Granularity::Week, Granularity::Month}) {
+            Bucket& bucket = buckets[int(granularity)][bucket_key(granularity, day)];
+            bucket.revenue += revenue;
+            bucket.cost += cost;
+        }
+    }
+}
+
+QVector<SalesPoint> SalesTimeSeries::series(Granularity granularity, const QDate& from, const QDate& to) const {
+    const std::map<qint32, Bucket>& map = buckets[int(granularity)];
+    auto revenue_at = [&map](qint32 key) {
+        auto it = map.find(key);
+        return it == map.end() ? 0.0 : it->second.revenue;
+    };
+
+    QVector<SalesPoint> points;
+    const qint32 last = bucket_key(granularity, to);
+    const int window = average_window(granularity);
+
+    for (qint32 key = bucket_key(granularity, from); key <= last; key = next_key(granularity, key)) {
+        SalesPoint point;
+        point.start = bucket_start(granularity, key);
+
+        auto it = map.find(key);
+        if (it != map.end()) {
+            point.revenue = it->second.revenue;
+            point.profit = it->second.revenue - it->second.cost;
+        }
+
+        qint32 previous = key;
+        double sum = 0;
+        for (int i = 0; i < window; ++i) {
+            sum += revenue_at(previous);
+            previous -= granularity == Granularity::Week ? 7 : 1;
+        }
+        point.average = sum / window;
+        point.lastYear = revenue_at(year_ago_key(granularity, key));
+
+        points.append(point);
+    }
+    return points;
+}
+
+qint64 SalesTimeSeries::footprint() const {
+    // a map node: the pair plus three pointers and the colour
+    const qint64 node = sizeof(std::pair<const qint32, Bucket>) + 4 * sizeof(void*);
+    qint64 count = 0;
+    for (const auto& granularity : buckets) count += qint64(granularity.size());
+    return count * node;
+}
+
+SalesTotals SalesTimeSeries::totals(const QDate& from, const QDate& to) const {
+    const std::map<qint32, Bucket>& days = buckets[int(Granularity::Day)];
+
+    SalesTotals totals;
+    for (auto it = days.lower_bound(qint32(from.toJulianDay())); it != days.end() && it->first <= to.toJulianDay(); ++it) {
+        totals.revenue += it->second.revenue;
+        totals.expenses += it->second.cost;
+    }
+    return totals;
+}
+
+qint32 SalesTimeSeries::bucket_key(Granularity granularity, const QDate& date) {
+    switch (granularity) {
+    case Granularity::Week: return qint32(date.toJulianDay() - (date.dayOfWeek() - 1));   // monday
+    case Granularity::Month: return date.year() * 12 + date.month() - 1;
+    default: return qint32(date.toJulianDay());
+    }
+}
+
+QDate SalesTimeSeries::bucket_start(Granularity granularity, qint32 key) {
+    if (granularity == Granularity::Month) return QDate(key / 12, key % 12 + 1, 1);
+    return QDate::fromJulianDay(key);
+}
+
+qint32 SalesTimeSeries::next_key(Granularity granularity, qint32 key) {
+    return key + (granularity == Granularity::Week ? 7 : 1);
+}
+
+qint32 SalesTimeSeries::year_ago_key(Granularity granularity, qint32 key) {
+    switch (granularity) {
+    case Granularity::Week: return key - 52 * 7;    // same weekday, 364 days back
+    case Granularity::Month: return key - 12;
+    default: return bucket_key(granularity, QDate::fromJulianDay(key).addYears(-1));
+    }
+}
+
+int SalesTimeSeries::average_window(Granularity granularity) {
+    switch (granularity) {
+    case Granularity::Week: return 4;
+    case Granularity::Month: return 3;
+    default: return 7;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef SALES_SERIES_H
+#define SALES_SERIES_H
+
+#include <QDate>
+#include <QVector>
+#include <map>
+
+enum class Granularity { Day, Week, Month };
+
+struct SalesPoint {
+    QDate start;            // first day of the bucket
+    double revenue = 0;
+    double profit = 0;
+    double average = 0;     // trailing moving average of revenue
+    double lastYear = 0;    // revenue of the same bucket a year earlier
+};
+
+struct SalesTotals {
+    double revenue = 0;
+    double expenses = 0;
+    double profit() const { return revenue - expenses; }
+};
+
+// Revenue and expense per day, week and month. The buckets are kept for the
+// whole ledger and refresh() only aggregates transactions newer than the last
+// one seen (GROUP BY day in sqlite, so that is a single indexed range scan).
+// Any range at any granularity is then read from memory.
+class SalesTimeSeries
+{
+public:
+    void refresh();
+
+    // zero filled, one point per bucket from the bucket holding `from` to the one holding `to`
+    QVector<SalesPoint> series(Granularity granularity, const QDate& from, const QDate& to) const;
+    SalesTotals totals(const QDate& from, const QDate& to) const;   // inclusive days
+    qint64 footprint() const;
+
+private:
+    struct Bucket {
+        double revenue = 0;
+        double cost = 0;
+    };
+
+    static qint32 bucket_key(Granularity granularity, const QDate& date);
+    static QDate bucket_start(Granularity granularity, qint32 key);
+    static qint32 next_key(Granularity granularity, qint32 key);
+    static qint32 year_ago_key(Granularity granularity, qint32 key);
+    static int average_window(Granularity granularity);
+
+    std::map<qint32, Bucket> buckets[3];    // indexed by Granularity
+    qint64 lastId = 0;
+};
+
+#endif // SALES_SERIES_H
@@ -0,0 +1,77 @@
+#include "scan_detector.h"
+#include <QAbstractItemView>
+#include <QCompleter>
+#include <QKeyEvent>
+#include <QLineEdit>
+
+ScanDetector::ScanDetector(QLineEdit* lineEdit, QObject* parent)
+    : QObject(parent)
+    , lineEdit(lineEdit)
+{
+    clock.start();
+    lineEdit->installEventFilter(this);
+    watch_completer();
+}
+
+void ScanDetector::watch_completer() {
+    // while the popup is open it gets the keys and forwards them to the line
+    // edit directly, past the line edit's filters
+    if (QCompleter* completer = lineEdit->completer()) {
+        completer->popup()->installEventFilter(this);
+    }
+}
+
+bool ScanDetector::eventFilter(QObject* obj, QEvent* event) {
+    Q_UNUSED(obj);
+    if (event->type() != QEvent::KeyPress) return false;
+
+    QKeyEvent* keyEvent = static_cast<QKeyEvent*>(event);
+    qint64 now = clock.elapsed();
+    qint64 gap = now - lastKeyAt;
+    lastKeyAt = now;
+
+    if (keyEvent->key() == Qt::Key_Return || keyEvent->key() == Qt::Key_Enter) {
+        bool burst = fastKeys >= minCodeLength - 1 && gap <= maxGapMs;
+        fastKeys = 0;
+        if (!burst) {
+            restore_completer();
+            return false;
+        }
+
+        QString code = lineEdit->text().trimmed();
+        lineEdit->clear();
+        restore_completer();
+        emit scanned(code);
+        return true;
+    }
+
+    QString text = keyEvent->text();
+    if (text.isEmpty() || !text.at(0).isPrint()) return false;
+
+    if (gap <= maxGapMs) {
+        if (++fastKeys == 2) {
+            // can't swap the completer while its popup is still dispatching this key
+            QMetaObject::invokeMethod(this, [this]() { detach_completer(); }, Qt::QueuedConnection);
+        }
+    } else if (fastKeys > 0) {
+        fastKeys = 0;
+        restore_completer();
+    }
+    return false;
+}
+
+void ScanDetector::detach_completer() {
+    QCompleter* completer = lineEdit->completer();
+    if (!completer) return;
+
+    completer->popup()->hide();
+    parkedCompleter = completer;
+    lineEdit->setCompleter(nullptr);
+}
+
+void ScanDetector::restore_completer() {
+    if (!parkedCompleter) return;
+    // a newer completer may have been installed while this one was parked
+    if (!lineEdit->completer()) lineEdit->setCompleter(parkedCompleter);
+    parkedCompleter.clear();
+}
@@ -0,0 +1,46 @@
+#ifndef SCAN_DETECTOR_H
+#define SCAN_DETECTOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+
+class QCompleter;
+class QLineEdit;
+
+// Tells a keyboard-wedge barcode scanner apart from a person typing: a scanner
+// sends the whole code a few milliseconds per key and finishes with Enter.
+// Once keys come in that fast the completer is taken off the line edit so no
+// popup gets in the way, and the final Enter emits scanned() instead of
+// reaching returnPressed.
+class ScanDetector : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ScanDetector(QLineEdit* lineEdit, QObject* parent = nullptr);
+
+    // the line edit's completer was replaced, watch the new popup too
+    void watch_completer();
+
+signals:
+    void scanned(const QString& code);
+
+protected:
+    bool eventFilter(QObject* obj, QEvent* event) override;
+
+private:
+    void detach_completer();
+    void restore_completer();
+
+    QLineEdit* lineEdit;
+    QPointer<QCompleter> parkedCompleter;
+    QElapsedTimer clock;
+    qint64 lastKeyAt = 0;
+    int fastKeys = 0;
+
+    static const int maxGapMs = 30;
+    static const int minCodeLength = 4;
+};
+
+#endif // SCAN_DETECTOR_H
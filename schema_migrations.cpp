@@ -0,0 +1,459 @@
+#include "schema_migrations.h"
+#include "app_metrics.h"
+#include "categories.h"
+#include "checkout.h"
+#include "db_concurrency.h"
+#include "inventory_valuation.h"
+#include "promotions.h"
+#include "replication.h"
+#include "stock_journal.h"
+#include "store_db.h"
+#include "transaction_search.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentRun>
+#include <atomic>
+#include <functional>
+
+namespace {
+
+struct Migration {
+    int version;
+    const char* name;
+    std::function<bool(QSqlQuery&)> apply;
+};
+
+struct IndexBuild {
+    const char* name;
+    const char* sql;
+};
+
+const int indexPauseMs = 2000;          // lets checkouts take the write lock between builds
+const qint64 indexIdleMs = 30000;       // a build only starts after this long without a scan or a sale
+const qint64 staleBuildSecs = 3600;     // a marker older than this was left by a register that died mid-build
+const int backfillIntervalMs = 50;
+
+std::atomic<bool> buildingHere{false};
+std::atomic<qint64> lastActivityMs{0};
+
+bool exec_all(QSqlQuery& query, const QStringList& statements) {
+    for (const QString& sql : statements) {
+        if (!query.exec(sql)) return false;
+    }
+    return true;
+}
+
+// databases from before barcodes and categories still get their columns here
+bool base_tables(QSqlQuery& query) {
+    if (!exec_all(query, {
+            R"(CREATE TABLE IF NOT EXISTS products (
+                   id INTEGER PRIMARY KEY AUTOINCREMENT,
+                   name TEXT UNIQUE NOT NULL,
+                   item_type TEXT NOT NULL,
+                   quantity INTEGER NOT NULL,
+                   price REAL NOT NULL,
+                   bought REAL NOT NULL,
+                   barcode TEXT,
+                   category_id INTEGER REFERENCES categories(id)
+               ))",
+            R"(CREATE TABLE IF NOT EXISTS transactions (
+                   id INTEGER PRIMARY KEY AUTOINCREMENT,
+                   name TEXT,
+                   details TEXT, -- JSON or CSV of items
+                   total REAL,
+                   total_expense REAL,
+                   date TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+               ))",
+            "CREATE TABLE IF NOT EXISTS app_meta (key TEXT PRIMARY KEY, value)"})) {
+        return false;
+    }
+
+    if (!has_column("products", "barcode") && !query.exec("ALTER TABLE products ADD COLUMN barcode TEXT")) return false;
+    if (!has_column("products", "category_id")
+        && !query.exec("ALTER TABLE products ADD COLUMN category_id INTEGER REFERENCES categories(id)")) {
+        return false;
+    }
+    // products is small, and the uniqueness has to hold before the first scan
+    return query.exec("CREATE UNIQUE INDEX IF NOT EXISTS idx_products_barcode ON products(barcode) WHERE barcode IS NOT NULL");
+}
+
+bool total_expense_typed(QSqlQuery& query) {
+    QString type;
+    if (!query.exec("PRAGMA table_info(transactions)")) return true;
+    while (query.next()) {
+        if (query.value(1).toString() == "total_expense") type = query.value(2).toString();
+    }
+    return !type.isEmpty();
+}
+
+// total_expense was declared without a type. sqlite can't change a column
+// type, so the table is copied into a typed one. Only the empty copy and the
+// triggers that keep already copied rows in step are made here; the rows are
+// moved by copy_typed_transactions() in chunks from BackgroundMigrations, and
+// the tables swapped once it has caught up
+bool typed_total_expense(QSqlQuery& query) {
+    if (total_expense_typed(query)) return true;
+
+    return exec_all(query, {
+        R"(CREATE TABLE IF NOT EXISTS transactions_typed (
+               id INTEGER PRIMARY KEY AUTOINCREMENT,
+               name TEXT,
+               details TEXT, -- JSON or CSV of items
+               total REAL,
+               total_expense REAL,
+               date TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+           ))",
+        R"(CREATE TRIGGER IF NOT EXISTS transactions_typed_update AFTER UPDATE ON transactions
+           BEGIN
+               UPDATE transactions_typed
+               SET name = NEW.name, details = NEW.details, total = NEW.total,
+                   total_expense = CAST(NEW.total_expense AS REAL), date = NEW.date
+               WHERE id = NEW.id;
+           END)",
+        R"(CREATE TRIGGER IF NOT EXISTS transactions_typed_delete AFTER DELETE ON transactions
+           BEGIN
+               DELETE FROM transactions_typed WHERE id = OLD.id;
+           END)"});
+}
+
+const QVector<Migration>& migrations() {
+    static const QVector<Migration> list = {
+        {1, "products and transactions", base_tables},
+        {2, "categories", create_categories},
+        {3, "promotions", create_promotions},
+        {4, "sale items", create_sale_items},
+        // not fatal: without fts5 the history bar falls back to name prefixes, re-tried every start
+        {5, "transaction search", [](QSqlQuery& query) { create_transaction_search(query); return true; }},
+        {6, "change log", create_change_log},
+        {7, "stock journal", create_stock_journal},
+        {8, "typed total_expense", typed_total_expense},
+        {9, "inventory valuation", create_inventory_valuation},
+        {10, "change log writer", add_change_log_writer},
+    };
+    return list;
+}
+
+// history search: every filter and sort column of the history bar
+const QVector<IndexBuild>& index_builds() {
+    static const QVector<IndexBuild> list = {
+        {"idx_transactions_date", "CREATE INDEX IF NOT EXISTS idx_transactions_date ON transactions(date)"},
+        {"idx_transactions_name", "CREATE INDEX IF NOT EXISTS idx_transactions_name ON transactions(name COLLATE NOCASE)"},
+        {"idx_transactions_total", "CREATE INDEX IF NOT EXISTS idx_transactions_total ON transactions(total)"},
+        {"idx_transactions_expense", "CREATE INDEX IF NOT EXISTS idx_transactions_expense ON transactions(total_expense)"},
+        {"idx_transactions_profit",
+         "CREATE INDEX IF NOT EXISTS idx_transactions_profit ON transactions((total - total_expense))"},
+    };
+    return list;
+}
+
+bool log_step(QSqlQuery& query, int version, const QString& name, qint64 elapsedMs, bool deferred) {
+    query.prepare("INSERT INTO schema_migrations (version, name, elapsed_ms, deferred) VALUES (?, ?, ?, ?)");
+    query.addBindValue(version);
+    query.addBindValue(name);
+    query.addBindValue(elapsedMs);
+    query.addBindValue(deferred ? 1 : 0);
+    return query.exec();
+}
+
+void log_deferred(const QString& name, qint64 elapsedMs) {
+    record_timing("migration " + name, elapsedMs);
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+        return log_step(query, schema_version(), name, elapsedMs, true) ? TxStatus::Ok : TxStatus::Error;
+    });
+    if (tx.outcome != TxOutcome::Committed) qDebug() << "Logging migration step failed:" << tx.message;
+}
+
+}
+
+int schema_version() {
+    QSqlQuery query;
+    return query.exec("PRAGMA user_version") && query.next() ? query.value(0).toInt() : 0;
+}
+
+int latest_schema_version() {
+    return migrations().last().version;
+}
+
+bool run_migrations() {
+    QSqlQuery setup;
+    if (!setup.exec(R"(
+            CREATE TABLE IF NOT EXISTS schema_migrations (
+                version INTEGER NOT NULL,
+                name TEXT NOT NULL,
+                elapsed_ms INTEGER NOT NULL,
+                deferred INTEGER NOT NULL DEFAULT 0,
+                applied_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+            )
+        )")) {
+        qDebug() << "Error creating migrations table:" << setup.lastError();
+        return false;
+    }
+
+    // the window is still disabled and waiting for these, Busy would only fail the start
+    RetryPolicy startup;
+    startup.capOnGuiThread = false;
+
+    const int current = schema_version();
+    for (const Migration& migration : migrations()) {
+        if (migration.version <= current) continue;
+
+        bool applied = false;
+        QElapsedTimer timer;
+        TxResult tx = run_write_transaction([&](QSqlQuery& query, QString& message) {
+            timer.start();
+            // another register may have migrated while we waited for the lock
+            if (!query.exec("PRAGMA user_version") || !query.next()) return TxStatus::Error;
+            applied = query.value(0).toInt() < migration.version;
+            if (!applied) return TxStatus::Ok;
+
+            if (!migration.apply(query)) {
+                message = query.lastError().text();
+                return TxStatus::Error;
+            }
+            if (!query.exec(QString("PRAGMA user_version = %1").arg(migration.version))) return TxStatus::Error;
+            return log_step(query, migration.version, migration.name, timer.elapsed(), false) ? TxStatus::Ok
+                                                                                           : TxStatus::Error;
+        }, startup);
+
+        if (tx.outcome != TxOutcome::Committed) {
+            qDebug() << "Migration" << migration.version << migration.name << "failed:" << tx.message;
+            return false;
+        }
+        if (applied) {
+            qDebug() << "Migration" << migration.version << migration.name << "applied in" << tx.elapsedMs << "ms";
+            record_timing(QString("migration %1 %2").arg(migration.version).arg(migration.name), tx.elapsedMs);
+        }
+    }
+
+    // the migration that creates it may have run in an earlier session, or on
+    // a sqlite without fts5: then it is still recorded as applied, and a build
+    // that has fts5 creates the table here and the backfill indexes old sales
+    if (!detect_transaction_search()) {
+        run_write_transaction([](QSqlQuery& query, QString&) {
+            return create_transaction_search(query) ? TxStatus::Ok : TxStatus::Abort;
+        });
+    }
+    return true;
+}
+
+bool copy_typed_transactions(int transactionsPerChunk) {
+    bool done = true;
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+        done = true;
+        if (!query.exec("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'transactions_typed'"))
+            return TxStatus::Error;
+        if (!query.next()) return TxStatus::Ok;
+
+        query.prepare(R"(
+            INSERT INTO transactions_typed (id, name, details, total, total_expense, date)
+            SELECT id, name, details, total, CAST(total_expense AS REAL), date
+            FROM transactions
+            WHERE id > (SELECT COALESCE(MAX(id), 0) FROM transactions_typed)
+            ORDER BY id
+            LIMIT ?
+        )");
+        query.addBindValue(transactionsPerChunk);
+        if (!query.exec()) return TxStatus::Error;
+        if (query.numRowsAffected() >= transactionsPerChunk) {
+            done = false;
+            return TxStatus::Ok;
+        }
+
+        // caught up: the last rows came with this chunk and the lock is still held, swap now.
+        // The indexes on transactions go with the old table and are rebuilt by the index builds
+        return exec_all(query, {
+            // ids of deleted last sales are never handed out again (the search index is keyed by them)
+            R"(INSERT INTO sqlite_sequence (name, seq)
+               SELECT 'transactions_typed', 0 WHERE NOT EXISTS (SELECT 1 FROM sqlite_sequence WHERE name = 'transactions_typed'))",
+            R"(UPDATE sqlite_sequence SET seq = MAX(seq, COALESCE((SELECT seq FROM sqlite_sequence WHERE name = 'transactions'), 0))
+               WHERE name = 'transactions_typed')",
+            "DROP TRIGGER IF EXISTS transactions_typed_update",
+            "DROP TRIGGER IF EXISTS transactions_typed_delete",
+            "DROP TABLE transactions",
+            "ALTER TABLE transactions_typed RENAME TO transactions"}) ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Typed transactions copy failed:" << tx.message;
+        return true;    // don't spin on a broken chunk, the next start retries it
+    }
+    return done;
+}
+
+QStringList pending_index_builds() {
+    QSet<QString> existing;
+    QSqlQuery query("SELECT name FROM sqlite_master WHERE type = 'index'");
+    while (query.next()) existing.insert(query.value(0).toString());
+
+    QStringList pending;
+    for (const IndexBuild& build : index_builds()) {
+        if (!existing.contains(build.name)) pending << build.name;
+    }
+    return pending;
+}
+
+bool build_index(const QString& dbPath, const QString& name, qint64& elapsedMs, QString& message) {
+    QString sql;
+    for (const IndexBuild& build : index_builds()) {
+        if (name == build.name) sql = build.sql;
+    }
+    if (sql.isEmpty()) {
+        message = "unknown index " + name;
+        return false;
+    }
+
+    const QString connection = QString("migration_%1").arg(quintptr(QThread::currentThreadId()));
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+        db.setDatabaseName(dbPath);
+        if (!db.open()) {
+            message = db.lastError().text();
+        } else {
+            QSqlQuery query(db);
+            query.exec("PRAGMA busy_timeout = 5000");
+            // the build holds the write lock until it is done; the marker tells
+            // other registers on this database why their checkouts are busy
+            buildingHere = true;
+            query.prepare("INSERT OR REPLACE INTO app_meta (key, value) VALUES ('index_building', ?)");
+            query.addBindValue(QDateTime::currentSecsSinceEpoch());
+            query.exec();
+            QElapsedTimer timer;
+            timer.start();
+            ok = query.exec(sql);
+            elapsedMs = timer.elapsed();
+            if (!ok) message = query.lastError().text();
+            query.exec("DELETE FROM app_meta WHERE key = 'index_building'");
+            buildingHere = false;
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return ok;
+}
+
+bool index_build_running() {
+    if (buildingHere) return true;
+    qint64 started = get_meta("index_building", 0).toLongLong();
+    return started > 0 && QDateTime::currentSecsSinceEpoch() - started < staleBuildSecs;
+}
+
+void note_register_activity() {
+    lastActivityMs = QDateTime::currentMSecsSinceEpoch();
+}
+
+QString migrations_report() {
+    QString report = QString("Schema version %1 of %2\n").arg(schema_version()).arg(latest_schema_version());
+    QSqlQuery query("SELECT version, name, elapsed_ms, deferred, applied_at FROM schema_migrations ORDER BY rowid");
+    while (query.next()) {
+        report += QString("  v%1  %2 %3 ms%4  %5\n")
+                      .arg(query.value(0).toInt(), -3)
+                      .arg(query.value(1).toString(), -32)
+                      .arg(query.value(2).toLongLong(), 7)
+                      .arg(query.value(3).toInt() ? " (background)" : "             ")
+                      .arg(query.value(4).toString());
+    }
+    return report;
+}
+
+//=====================================================================================================================
+
+BackgroundMigrations::BackgroundMigrations(QObject* parent)
+    : QObject(parent)
+    , dbPath(QSqlDatabase::database().databaseName())
+    , copyTimer(new QTimer(this))
+    , backfillTimer(new QTimer(this))
+{
+    copyTimer->setInterval(backfillIntervalMs);
+    connect(copyTimer, &QTimer::timeout, this, &BackgroundMigrations::run_copy_chunk);
+    note_register_activity();           // the idle wait counts from start, the cashier may begin at once
+    backfillTimer->setInterval(backfillIntervalMs);
+    connect(backfillTimer, &QTimer::timeout, this, &BackgroundMigrations::run_backfill_chunk);
+
+    connect(&watcher, &QFutureWatcher<qint64>::finished, this, [this]() {
+        qint64 elapsedMs = watcher.result();
+        if (elapsedMs >= 0) log_deferred("index " + building, elapsedMs);
+        emit indexBuildFinished(building);
+        QTimer::singleShot(indexPauseMs, this, &BackgroundMigrations::next_index);
+    });
+}
+
+// table copies first: their swap drops the indexes the builds would make
+void BackgroundMigrations::start() {
+    QSqlQuery query("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'transactions_typed'");
+    if (query.next()) {
+        copyTimer->start();
+        return;
+    }
+    indexes = pending_index_builds();
+    next_index();
+}
+
+void BackgroundMigrations::run_copy_chunk() {
+    QElapsedTimer timer;
+    timer.start();
+    bool done = copy_typed_transactions();
+    record_timing("typed transactions copy chunk", timer.elapsed());
+    copyMs += timer.elapsed();
+    if (!done) return;
+
+    copyTimer->stop();
+    log_deferred("typed total_expense copy", copyMs);
+    indexes = pending_index_builds();
+    next_index();
+}
+
+void BackgroundMigrations::next_index() {
+    if (indexes.isEmpty()) {
+        backfillTimer->start();
+        return;
+    }
+    // a build blocks every sale until it is done, so it waits for a quiet register
+    qint64 idleMs = QDateTime::currentMSecsSinceEpoch() - lastActivityMs;
+    if (idleMs < indexIdleMs) {
+        QTimer::singleShot(int(indexIdleMs - idleMs), this, &BackgroundMigrations::next_index);
+        return;
+    }
+
+    building = indexes.takeFirst();
+    emit indexBuildStarted(building);
+    const QString path = dbPath;
+    const QString name = building;
+    watcher.setFuture(QtConcurrent::run([path, name]() -> qint64 {
+        qint64 elapsedMs = 0;
+        QString message;
+        if (!build_index(path, name, elapsedMs, message)) {
+            qDebug() << "Building" << name << "failed:" << message;   // retried next start
+            return -1;
+        }
+        return elapsedMs;
+    }));
+}
+
+// copy line items of sales made before transaction_items existed and index
+// old sales for full-text search, a chunk of each per tick
+void BackgroundMigrations::run_backfill_chunk() {
+    QElapsedTimer timer;
+    timer.start();
+    bool done = backfill_sale_items();
+    record_timing("sale items backfill chunk", timer.elapsed());
+    qint64 itemsMs = timer.restart();
+    done = index_pending_transactions() && done;
+    record_timing("search index chunk", timer.elapsed());
+
+    backfillMs += itemsMs + timer.elapsed();
+    ++backfillChunks;
+    if (!done) return;
+
+    backfillTimer->stop();
+    // a single chunk means there was nothing left to do
+    if (backfillChunks > 1) log_deferred("backfill sale items, search index", backfillMs);
+    emit finished();
+}
@@ -0,0 +1,73 @@
+#ifndef SCHEMA_MIGRATIONS_H
+#define SCHEMA_MIGRATIONS_H
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+// The schema version lives in PRAGMA user_version. Migrations are numbered
+// and applied in order at start_db(), each in its own write transaction
+// together with the version bump, so a crash or a second register starting
+// at the same time never leaves a half-applied step behind.
+//
+// Expensive work does not run there. BackgroundMigrations first copies rows
+// for table rewrites in chunks, then builds the separately listed indexes one
+// at a time on their own connection once the register is idle, and the chunked backfills (sale items,
+// search index) run after them on a timer.
+// Every step, immediate or deferred, is logged to schema_migrations with its
+// duration.
+
+int schema_version();
+int latest_schema_version();
+bool run_migrations();
+
+// migration 8's row copy, in chunks with the write lock held only per chunk;
+// the table swap is part of the last one. True once there is nothing left
+bool copy_typed_transactions(int transactionsPerChunk = 5000);
+
+QStringList pending_index_builds();       // index names not built yet
+// blocking, one CREATE INDEX on a private connection; any thread
+bool build_index(const QString& dbPath, const QString& name, qint64& elapsedMs, QString& message);
+
+// true while an index build holds the write lock, in this process or another
+// register's; checkouts wait for it instead of failing as busy
+bool index_build_running();
+// a scan or a sale: index builds start only after the register has been quiet
+void note_register_activity();
+
+QString migrations_report();
+
+class QTimer;
+
+class BackgroundMigrations : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BackgroundMigrations(QObject* parent = nullptr);
+
+    void start();
+
+signals:
+    void indexBuildStarted(const QString& name);
+    void indexBuildFinished(const QString& name);
+    void finished();
+
+private:
+    void run_copy_chunk();
+    void next_index();
+    void run_backfill_chunk();
+
+    QString dbPath;
+    QStringList indexes;
+    QString building;
+    QFutureWatcher<qint64> watcher;     // build time, -1 on failure
+    QTimer* copyTimer;
+    qint64 copyMs = 0;
+    QTimer* backfillTimer;
+    qint64 backfillMs = 0;
+    int backfillChunks = 0;
+};
+
+#endif // SCHEMA_MIGRATIONS_H
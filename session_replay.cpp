@@ -0,0 +1,329 @@
+#include "session_replay.h"
+#include "checkout.h"
+#include "db_backup.h"
+#include "db_concurrency.h"
+#include "invoice_cache.h"
+#include "product_lookup.h"
+#include "promotions.h"
+#include "sales_analytics.h"
+#include "sales_series.h"
+#include "stock_journal.h"
+#include "store_db.h"
+#include "transaction_detail.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QMap>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+QString default_session_log() {
+    return qEnvironmentVariable("STOCKING_SESSION_LOG");
+}
+
+SessionRecorder::SessionRecorder(const QString& path)
+{
+    if (path.isEmpty()) return;
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qDebug() << "Cannot open session log" << path << file.errorString();
+        return;
+    }
+    clock.start();
+    record("session", {{"register", register_id()},
+                       {"started", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)}});
+}
+
+SessionRecorder::~SessionRecorder() {
+    if (file.isOpen()) file.flush();
+}
+
+void SessionRecorder::record(const QString& op, QJsonObject args) {
+    if (!file.isOpen()) return;
+    args["t"] = double(clock.elapsed());
+    args["op"] = op;
+    file.write(QJsonDocument(args).toJson(QJsonDocument::Compact));
+    file.write("\n");
+    // buffered; a crash loses at most the operations since the last sale
+    if (op == "checkout") file.flush();
+}
+
+//=====================================================================================================================
+
+namespace {
+
+struct Operation {
+    qint64 t = 0;
+    QString op;
+    QJsonObject args;
+};
+
+QVector<Operation> read_log(const QString& path, QString& error) {
+    QVector<Operation> operations;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        error = "cannot open " + path + ": " + file.errorString();
+        return operations;
+    }
+
+    // a log holds one session after another, each with its clock from 0: they are played back to back
+    qint64 offset = 0;
+    qint64 last = 0;
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty()) continue;
+        QJsonParseError parseError;
+        const QJsonObject object = QJsonDocument::fromJson(line, &parseError).object();
+        if (parseError.error != QJsonParseError::NoError) {
+            error = QString("%1:%2: %3").arg(path).arg(lineNumber).arg(parseError.errorString());
+            return {};
+        }
+
+        Operation operation;
+        operation.op = object["op"].toString();
+        operation.args = object;
+        if (operation.op == "session") offset = last;
+        operation.t = offset + qint64(object["t"].toDouble());
+        last = operation.t;
+        operations.append(operation);
+    }
+    return operations;
+}
+
+// The cart page without its widgets: the same lookup, pricing and checkout
+// calls the window makes for each operation, so their cost is what is timed.
+class Replayer
+{
+public:
+    explicit Replayer(const QString& invoiceDir)
+        : invoices(invoiceDir, 64 * 1024 * 1024)
+    {
+        lookup.reload();
+        promotions.reload();
+    }
+
+    // false when the operation failed the way it would have shown an error
+    bool run(const Operation& operation) {
+        const QJsonObject& args = operation.args;
+        const QString& op = operation.op;
+        if (op == "add") return add(args["text"].toString());
+        if (op == "quantity") return set_quantity(args["row"].toInt(), args["quantity"].toInt());
+        if (op == "remove") {
+            const int row = args["row"].toInt();
+            if (row < 0 || row >= cart.size()) return false;
+            cart.remove(row);
+            return true;
+        }
+        if (op == "clear") {
+            cart.clear();
+            return true;
+        }
+        if (op == "checkout") return checkout(args["client"].toString());
+        if (op == "summary") {
+            const QDate from = QDate::fromString(args["from"].toString(), Qt::ISODate);
+            const QDate to = QDate::fromString(args["to"].toString(), Qt::ISODate);
+            series.refresh();
+            series.series(Granularity(args["granularity"].toInt()), from, to);
+            series.totals(from, to);
+            return true;
+        }
+        if (op == "report") {
+            analytics.report(QDate::fromString(args["from"].toString(), Qt::ISODate),
+                             QDate::fromString(args["to"].toString(), Qt::ISODate));
+            return true;
+        }
+        if (op == "history") return details.get(args["id"].toInt()) != nullptr;
+        if (op == "invoice") {
+            const DecodedTransaction* transaction = details.get(args["id"].toInt());
+            if (!transaction || !transaction->valid) return false;
+            const QString html = generateInvoice(transaction->items, transaction->date,
+                                                 QString::number(transaction->id));
+            return !invoices.pdf_for(html).isEmpty();
+        }
+        return false;
+    }
+
+private:
+    struct Line {
+        CartProduct product;
+        int quantity = 0;
+        LineDiscount discount;
+    };
+
+    bool add(const QString& text) {
+        const CartProduct* product = lookup.find(text);
+        if (!product) return false;
+        for (int row = 0; row < cart.size(); ++row) {
+            if (cart[row].product.name == product->name) return set_quantity(row, cart[row].quantity + 1);
+        }
+        Line line;
+        line.product = *product;
+        line.quantity = 1;
+        cart.append(line);
+        price(cart.last());
+        return true;
+    }
+
+    bool set_quantity(int row, int quantity) {
+        if (row < 0 || row >= cart.size() || quantity < 1) return false;
+        cart[row].quantity = quantity;
+        price(cart[row]);
+        return true;
+    }
+
+    void price(Line& line) {
+        CartLine cartLine;
+        cartLine.productId = line.product.id;
+        cartLine.categoryId = line.product.categoryId;
+        cartLine.quantity = line.quantity;
+        cartLine.price = line.product.price;
+        line.discount = promotions.price_line(cartLine);
+    }
+
+    bool checkout(const QString& client) {
+        if (cart.isEmpty()) return false;
+        if (promotions.set_client(client)) {
+            for (Line& line : cart) price(line);
+        }
+
+        QList<SaleLine> lines;
+        for (const Line& line : cart) {
+            SaleLine sale;
+            sale.name = line.product.name;
+            sale.type = line.product.type;
+            sale.quantity = line.quantity;
+            sale.price = line.product.price;
+            sale.cost = line.product.cost;
+            sale.subtotal = line.quantity * line.product.price - line.discount.amount;
+            sale.subexpense = line.quantity * line.product.cost;
+            sale.discount = line.discount.amount;
+            sale.promotionId = line.discount.promotionId;
+            lines << sale;
+        }
+        CheckoutResult result = checkout_sale(client, lines);
+
+        // what the window does after every sale, short of the widgets
+        cart.clear();
+        promotions.set_client(QString());
+        if (!result.ok()) return false;
+        maybe_snapshot_stock();
+        promotions.reload();
+        return true;
+    }
+
+    ProductLookup lookup;
+    PromotionEngine promotions;
+    SalesTimeSeries series;
+    SalesAnalytics analytics;
+    TransactionCache details;
+    InvoiceCache invoices;
+    QVector<Line> cart;
+};
+
+// nearest rank
+double percentile(const QVector<double>& sorted, double p) {
+    if (sorted.isEmpty()) return 0;
+    int rank = int(std::ceil(p * sorted.size()));
+    return sorted[qBound(0, rank - 1, sorted.size() - 1)];
+}
+
+}
+
+ReplayReport replay_session(const QString& logPath, const QString& dbPath, bool paced) {
+    ReplayReport report;
+    const QVector<Operation> operations = read_log(logPath, report.error);
+    if (!report.error.isEmpty()) return report;
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        report.error = "cannot create a temporary directory";
+        return report;
+    }
+    // the same online copy a backup makes, so a live store.db can be used
+    BackupResult copy = backup_database(dbPath, dir.filePath("backup"), 1);
+    if (!copy.ok) {
+        report.error = "copying " + dbPath + " failed: " + copy.message;
+        return report;
+    }
+    const QString replayDb = dir.filePath("replay.db");
+    QString restoreError = restore_backup(copy.file, replayDb);
+    if (!restoreError.isEmpty()) {
+        report.error = restoreError;
+        return report;
+    }
+    if (!start_db(replayDb)) {
+        report.error = "cannot open the copy of " + dbPath;
+        return report;
+    }
+
+    QMap<QString, QVector<double>> latencies;
+    QMap<QString, int> failures;
+    {
+        Replayer replayer(dir.filePath("invoices"));
+        QElapsedTimer wall;
+        wall.start();
+        for (const Operation& operation : operations) {
+            if (operation.op == "session") continue;
+            if (paced) {
+                const qint64 wait = operation.t - wall.elapsed();
+                if (wait > 0) QThread::msleep(quint64(wait));
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+            const bool ok = replayer.run(operation);
+            latencies[operation.op].append(timer.nsecsElapsed() / 1e6);
+            if (!ok) ++failures[operation.op];
+        }
+        report.wallMs = wall.elapsed();
+    }
+    close_db();
+
+    for (auto it = latencies.begin(); it != latencies.end(); ++it) {
+        QVector<double>& samples = it.value();
+        std::sort(samples.begin(), samples.end());
+
+        OperationLatency latency;
+        latency.op = it.key();
+        latency.count = samples.size();
+        latency.failures = failures.value(it.key());
+        latency.p50Ms = percentile(samples, 0.50);
+        latency.p90Ms = percentile(samples, 0.90);
+        latency.p99Ms = percentile(samples, 0.99);
+        latency.maxMs = samples.last();
+        report.operations.append(latency);
+        report.total += latency.count;
+        report.failures += latency.failures;
+    }
+    return report;
+}
+
+QString replay_report_text(const ReplayReport& report) {
+    if (!report.error.isEmpty()) return "replay failed: " + report.error + "\n";
+
+    QString text = QString("%1  %2  %3  %4  %5  %6  %7\n")
+                       .arg("operation", -10)
+                       .arg("count", 7)
+                       .arg("failed", 7)
+                       .arg("p50 ms", 9)
+                       .arg("p90 ms", 9)
+                       .arg("p99 ms", 9)
+                       .arg("max ms", 9);
+    for (const OperationLatency& latency : report.operations) {
+        text += QString("%1  %2  %3  %4  %5  %6  %7\n")
+                    .arg(latency.op, -10)
+                    .arg(latency.count, 7)
+                    .arg(latency.failures, 7)
+                    .arg(latency.p50Ms, 9, 'f', 3)
+                    .arg(latency.p90Ms, 9, 'f', 3)
+                    .arg(latency.p99Ms, 9, 'f', 3)
+                    .arg(latency.maxMs, 9, 'f', 3);
+    }
+    text += QString("%1 operations, %2 failed, %3 ms\n").arg(report.total).arg(report.failures).arg(report.wallMs);
+    return text;
+}
@@ -0,0 +1,64 @@
+#ifndef SESSION_REPLAY_H
+#define SESSION_REPLAY_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+// Real register sessions as regression workloads. With STOCKING_SESSION_LOG
+// set, the register appends what the cashier does to that file, one json
+// object per line: {"t": ms since the session started, "op": ..., arguments}.
+//   add       text           scanned code or typed name
+//   quantity  row, quantity  +/- or Set Quantity on a cart line
+//   remove    row
+//   clear
+//   checkout  client
+//   summary   granularity, from, to     a sales chart period
+//   report    from, to                  product sales
+//   history   id                        a sale opened in the history page
+//   invoice   id
+// replay_session() runs a log against a copy of a database through the same
+// lookup, promotion, checkout and report code the window uses, either as
+// fast as it can or with the recorded pauses, and times every operation.
+
+QString default_session_log();      // STOCKING_SESSION_LOG, "" = not recording
+
+class SessionRecorder
+{
+public:
+    explicit SessionRecorder(const QString& path = default_session_log());
+    ~SessionRecorder();
+
+    bool active() const { return file.isOpen(); }
+    void record(const QString& op, QJsonObject args = QJsonObject());
+
+private:
+    QFile file;
+    QElapsedTimer clock;
+};
+
+struct OperationLatency {
+    QString op;
+    int count = 0;
+    int failures = 0;
+    double p50Ms = 0;
+    double p90Ms = 0;
+    double p99Ms = 0;
+    double maxMs = 0;
+};
+
+struct ReplayReport {
+    QVector<OperationLatency> operations;   // by name
+    int total = 0;
+    int failures = 0;
+    qint64 wallMs = 0;
+    QString error;                          // the log or the database could not be used
+};
+
+// dbPath is copied first (online, like a backup), the original is never written
+ReplayReport replay_session(const QString& logPath, const QString& dbPath, bool paced);
+QString replay_report_text(const ReplayReport& report);
+
+#endif // SESSION_REPLAY_H
@@ -0,0 +1,158 @@
+#include "stock_journal.h"
+#include "query_registry.h"
+#include "db_concurrency.h"
+#include "replication.h"
+#include <QDebug>
+#include <QJsonObject>
+#include <QSqlError>
+
+namespace {
+
+QString sql_timestamp(const QDateTime& when) {
+    return when.toUTC().toString("yyyy-MM-dd HH:mm:ss");
+}
+
+// inside the caller's write transaction, so products can't move between the two reads
+bool insert_stock_snapshot(QSqlQuery& query) {
+    if (!query.exec(registered_sql(Statement::StockLastMovement)) || !query.next()) return false;
+    qint64 lastMovement = query.value(0).toLongLong();
+
+    query.prepare(registered_sql(Statement::StockSnapshotInsert));
+    query.addBindValue(lastMovement);
+    if (!query.exec()) return false;
+    qint64 snapshotId = query.lastInsertId().toLongLong();
+
+    query.prepare(registered_sql(Statement::StockSnapshotCopy));
+    query.addBindValue(snapshotId);
+    return query.exec();
+}
+
+}
+
+bool create_stock_journal(QSqlQuery& query) {
+    // no secondary index on movements on purpose: the checkout path only appends,
+    // and rebuilding walks a rowid range
+    return query.exec(R"(
+        CREATE TABLE IF NOT EXISTS stock_movements (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            product_id INTEGER NOT NULL,
+            delta INTEGER NOT NULL,
+            reason TEXT NOT NULL,
+            reference INTEGER,
+            at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+        )
+    )")
+    && query.exec(R"(
+        CREATE TABLE IF NOT EXISTS stock_snapshots (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            taken_at TIMESTAMP NOT NULL,
+            last_movement_id INTEGER NOT NULL
+        )
+    )")
+    && query.exec("CREATE INDEX IF NOT EXISTS idx_stock_snapshots_taken ON stock_snapshots(taken_at)")
+    && query.exec(R"(
+        CREATE TABLE IF NOT EXISTS stock_snapshot_rows (
+            snapshot_id INTEGER NOT NULL,
+            product_id INTEGER NOT NULL,
+            quantity INTEGER NOT NULL,
+            PRIMARY KEY (snapshot_id, product_id)
+        ) WITHOUT ROWID
+    )")
+    // the stock from before the journal existed is its baseline
+    && insert_stock_snapshot(query);
+}
+
+bool record_stock_change(QSqlQuery& query, const QString& productName, int delta,
+                         const QString& reason, int reference) {
+    query.prepare(registered_sql(Statement::StockMovementInsert));
+    query.addBindValue(delta);
+    query.addBindValue(reason);
+    query.addBindValue(reference);
+    query.addBindValue(productName);
+    if (!query.exec()) return false;
+
+    QJsonObject stockChange;
+    stockChange["product"] = productName;
+    stockChange["delta"] = delta;
+    stockChange["reason"] = reason;
+    return append_change(query, "stock", stockChange);
+}
+
+bool take_stock_snapshot() {
+    TxResult tx = run_write_transaction([](QSqlQuery& query, QString&) {
+        return insert_stock_snapshot(query) ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Stock snapshot failed:" << tx.message;
+        return false;
+    }
+    qDebug() << "Stock snapshot taken in" << tx.elapsedMs << "ms";
+    return true;
+}
+
+void maybe_snapshot_stock(int movementThreshold) {
+    QSqlQuery query;
+    if (!query.exec(registered_sql(Statement::StockSnapshotLatest))) {
+        qDebug() << "Reading stock snapshots failed:" << query.lastError();
+        return;
+    }
+    if (!query.next()) {
+        // journals created before migration 7 took its own baseline: the current stock is it
+        take_stock_snapshot();
+        return;
+    }
+    qint64 lastSnapshotMovement = query.value(0).toLongLong();
+    bool stale = query.value(1).toString() < sql_timestamp(QDateTime::currentDateTimeUtc().addDays(-1));
+
+    if (!query.exec(registered_sql(Statement::StockLastMovement)) || !query.next()) return;
+    qint64 pending = query.value(0).toLongLong() - lastSnapshotMovement;
+
+    if (pending >= movementThreshold
+        || (pending > 0 && stale)) {
+        take_stock_snapshot();
+    }
+}
+
+QHash<int, int> stock_levels_at(const QDateTime& when) {
+    QHash<int, int> levels;
+    QString until = sql_timestamp(when);
+
+    QSqlQuery query;
+    query.prepare(registered_sql(Statement::StockSnapshotAt));
+    query.addBindValue(until);
+    if (!query.exec()) {
+        qDebug() << "Reading stock snapshots failed:" << query.lastError();
+        return levels;
+    }
+
+    // before the first snapshot the baseline is the oldest one: no movement predates it
+    bool found = query.next();
+    if (!found) {
+        query.prepare(registered_sql(Statement::StockSnapshotFirst));
+        found = query.exec() && query.next();
+    }
+    qint64 fromMovement = 0;
+    if (found) {
+        qint64 snapshotId = query.value(0).toLongLong();
+        fromMovement = query.value(1).toLongLong();
+
+        query.prepare(registered_sql(Statement::StockSnapshotRows));
+        query.addBindValue(snapshotId);
+        query.exec();
+        while (query.next()) {
+            levels.insert(query.value(0).toInt(), query.value(1).toInt());
+        }
+    }
+
+    // movements are appended in time order, so the walk stops at the first one past `when`
+    query.prepare(registered_sql(Statement::StockMovementsSince));
+    query.addBindValue(fromMovement);
+    query.exec();
+    while (query.next()) {
+        if (query.value(2).toString() > until) break;
+        levels[query.value(0).toInt()] += query.value(1).toInt();
+    }
+
+    return levels;
+}
@@ -0,0 +1,36 @@
+#ifndef STOCK_JOURNAL_H
+#define STOCK_JOURNAL_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QSqlQuery>
+#include <QString>
+
+// Every stock change is appended to stock_movements; products.quantity is only
+// the materialized current level. stock_snapshots store the full stock table
+// every so often together with the last movement they include, so the level
+// at a given date is "closest snapshot before it + the movements after it".
+
+namespace StockReason {
+const char* const Sale = "sale";
+const char* const Restock = "restock";
+const char* const Adjustment = "adjustment";
+const char* const Removal = "removal";       // the product was deleted with this much left
+}
+
+bool create_stock_journal(QSqlQuery& query);
+
+// Appends the movement (and its replication change) inside the caller's write
+// transaction. productName must already exist in products.
+bool record_stock_change(QSqlQuery& query, const QString& productName, int delta,
+                         const QString& reason, int reference = 0);
+
+// Snapshots products.quantity when enough movements piled up since the last
+// snapshot or it is older than a day. Cheap to call after every write.
+void maybe_snapshot_stock(int movementThreshold = 5000);
+bool take_stock_snapshot();
+
+// product id -> quantity as of `when`
+QHash<int, int> stock_levels_at(const QDateTime& when);
+
+#endif // STOCK_JOURNAL_H
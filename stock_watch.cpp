@@ -0,0 +1,208 @@
+#include "stock_watch.h"
+#include "query_registry.h"
+#include "memory_budget.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSet>
+#include <QStringList>
+#include <cmath>
+
+namespace {
+
+const double smoothing = 0.1;           // weight of the newest day, ~a week half-life
+const double minVelocity = 1.0 / 30;    // assume at least one sale a month
+const int historyDays = 90;
+const double watchDays = 14;            // listed when stock runs out within this
+const double leadDays = 7;              // supplier delay
+const double coverDays = 14;            // stock to have once the order arrives
+
+// transactions.date is UTC
+qint64 today_julian() {
+    return QDateTime::currentDateTimeUtc().date().toJulianDay();
+}
+
+}
+
+void StockWatch::load() {
+    entries.clear();
+    queue.clear();
+    currentDay = today_julian();
+
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    if (!query.exec(registered_sql(Statement::StockLevels))) {
+        qDebug() << "Loading stock levels failed:" << query.lastError();
+        return;
+    }
+    while (query.next()) {
+        Entry& entry = entries[query.value(0).toString()];
+        entry.quantity = query.value(1).toInt();
+        entry.day = currentDay - historyDays;
+    }
+
+    query.prepare(registered_sql(Statement::SalesVelocity));
+    query.addBindValue(QString("-%1 days").arg(historyDays));
+    if (!query.exec()) {
+        qDebug() << "Loading sales velocity failed:" << query.lastError();
+    }
+    while (query.next()) {
+        auto it = entries.find(query.value(0).toString());
+        if (it == entries.end()) continue;
+        advance(*it, query.value(1).toLongLong());
+        it->pending += query.value(2).toInt();
+    }
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        advance(*it, currentDay);
+        reposition(it.key(), *it);
+    }
+}
+
+void StockWatch::sync_quantities() {
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    if (!query.exec(registered_sql(Statement::StockLevels))) {
+        qDebug() << "Loading stock levels failed:" << query.lastError();
+        return;
+    }
+
+    QSet<QString> seen;
+    while (query.next()) {
+        QString name = query.value(0).toString();
+        int quantity = query.value(1).toInt();
+        seen.insert(name);
+        set_quantity(name, quantity);
+    }
+
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (seen.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        queue.erase({it->key, it.key()});
+        it = entries.erase(it);
+    }
+}
+
+void StockWatch::sync_products(const QVector<int>& ids) {
+    if (ids.isEmpty()) return;
+
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare(registered_sql(Statement::StockLevelsByIds, ids.size()));
+    for (int id : ids) query.addBindValue(id);
+    if (!query.exec()) {
+        qDebug() << "Loading stock levels failed:" << query.lastError();
+        return;
+    }
+    while (query.next()) set_quantity(query.value(0).toString(), query.value(1).toInt());
+}
+
+// the sales rate belongs to the product, not to its old name
+void StockWatch::rename(const QString& oldName, const QString& name) {
+    auto it = entries.find(oldName);
+    if (oldName == name || it == entries.end()) return;
+    Entry entry = *it;
+    queue.erase({entry.key, oldName});
+    entries.erase(it);
+
+    queue.erase({entries.value(name).key, name});
+    Entry& moved = entries[name] = entry;
+    queue.insert({moved.key, name});
+}
+
+void StockWatch::forget(const QString& name) {
+    auto it = entries.find(name);
+    if (it == entries.end()) return;
+    queue.erase({it->key, name});
+    entries.erase(it);
+}
+
+void StockWatch::set_quantity(const QString& name, int quantity) {
+    auto it = entries.find(name);
+    if (it == entries.end()) {
+        it = entries.insert(name, Entry());
+        it->day = today_julian();
+    } else if (it->quantity == quantity) {
+        return;
+    }
+    it->quantity = quantity;
+    reposition(name, *it);
+}
+
+void StockWatch::record_sale(const QString& name, int units) {
+    roll_day();
+    auto it = entries.find(name);
+    if (it == entries.end()) return;
+
+    advance(*it, currentDay);
+    it->pending += units;
+    it->quantity -= units;
+    reposition(name, *it);
+}
+
+QVector<StockAlert> StockWatch::alerts(int limit) {
+    roll_day();
+
+    QVector<StockAlert> result;
+    for (const auto& item : queue) {
+        if (item.first > watchDays || result.size() >= limit) break;
+
+        const Entry entry = entries.value(item.second);
+        StockAlert alert;
+        alert.name = item.second;
+        alert.quantity = entry.quantity;
+        alert.perDay = velocity(entry);
+        alert.daysLeft = item.first;
+        alert.reorder = qMax(1, int(std::ceil(qMax(alert.perDay, minVelocity) * (leadDays + coverDays))) - entry.quantity);
+        result.append(alert);
+    }
+    return result;
+}
+
+qint64 StockWatch::footprint() const {
+    qint64 bytes = 0;
+    // the name is shared by the hash key and the queue entry
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        bytes += string_bytes(it.key()) + sizeof(Entry) + 32;
+    }
+    bytes += qint64(queue.size()) * (sizeof(std::pair<double, QString>) + 4 * sizeof(void*));
+    return bytes;
+}
+
+// closes the days between entry.day and today: the pending day gets its
+// smoothing step, the days without sales decay the rate
+void StockWatch::advance(Entry& entry, qint64 today) {
+    if (today <= entry.day) return;
+    entry.rate = smoothing * entry.pending + (1 - smoothing) * entry.rate;
+    entry.rate *= std::pow(1 - smoothing, double(today - entry.day - 1));
+    entry.pending = 0;
+    entry.day = today;
+}
+
+// today's sales count right away instead of waiting for the day to close
+double StockWatch::velocity(const Entry& entry) {
+    return qMax(entry.rate, smoothing * entry.pending + (1 - smoothing) * entry.rate);
+}
+
+void StockWatch::reposition(const QString& name, Entry& entry) {
+    queue.erase({entry.key, name});
+    entry.key = qMax(0, entry.quantity) / qMax(velocity(entry), minVelocity);
+    queue.insert({entry.key, name});
+}
+
+// a new day decays every rate, so the whole order is rebuilt once per day
+void StockWatch::roll_day() {
+    qint64 today = today_julian();
+    if (today == currentDay) return;
+    currentDay = today;
+
+    queue.clear();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        advance(*it, currentDay);
+        it->key = qMax(0, it->quantity) / qMax(velocity(*it), minVelocity);
+        queue.insert({it->key, it.key()});
+    }
+}
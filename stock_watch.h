@@ -0,0 +1,57 @@
+#ifndef STOCK_WATCH_H
+#define STOCK_WATCH_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <set>
+#include <utility>
+
+struct StockAlert {
+    QString name;
+    int quantity = 0;
+    double perDay = 0;      // smoothed sales velocity
+    double daysLeft = 0;
+    int reorder = 0;        // suggested units to order
+};
+
+// Low-stock watch list for the register. Every product has an exponentially
+// smoothed daily sales rate and sits in an ordered set keyed by days of stock
+// left, so a sale or a quantity change only repositions that one product.
+// load() seeds the rates from the last 90 days of sale lines once; after that
+// checkouts feed record_sale(), item edits feed sync_products() with the ids
+// that changed, and the periodic sync_quantities() catches other registers.
+class StockWatch
+{
+public:
+    void load();
+    void sync_quantities();
+    void sync_products(const QVector<int>& ids);
+    void rename(const QString& oldName, const QString& name);
+    void forget(const QString& name);
+    void record_sale(const QString& name, int units);
+
+    QVector<StockAlert> alerts(int limit = 20);    // most urgent first
+    qint64 footprint() const;
+
+private:
+    struct Entry {
+        int quantity = 0;
+        double rate = 0;        // smoothed units/day over the days before `day`
+        qint64 day = 0;         // julian day the pending units belong to
+        int pending = 0;        // units sold on `day` so far
+        double key = 0;         // days left, position in `queue`
+    };
+
+    static void advance(Entry& entry, qint64 today);
+    static double velocity(const Entry& entry);
+    void reposition(const QString& name, Entry& entry);
+    void roll_day();
+    void set_quantity(const QString& name, int quantity);
+
+    QHash<QString, Entry> entries;
+    std::set<std::pair<double, QString>> queue;
+    qint64 currentDay = 0;
+};
+
+#endif // STOCK_WATCH_H
@@ -1,5 +1,26 @@
 #include "stoking_p.h"
 #include "./ui_stoking_p.h"
+#include "store_db.h"
+#include "checkout.h"
+#include "replication.h"
+#include "stock_journal.h"
+#include "scan_detector.h"
+#include "product_filter.h"
+#include "app_metrics.h"
+#include "history_model.h"
+#include "transaction_search.h"
+#include "sales_analytics.h"
+#include "sales_chart.h"
+#include "db_backup.h"
+#include "categories.h"
+#include "receipt_printer.h"
+#include "product_repository.h"
+#include "schema_migrations.h"
+#include "transaction_detail.h"
+#include "invoice_cache.h"
+#include "inventory_valuation.h"
+#include "memory_budget.h"
+#include "api_server.h"
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
@@ -9,6 +30,7 @@
 #include <QSortFilterProxyModel>
 #include <QMenu>
 #include <QCompleter>
+#include <QStringListModel>
 #include <QStandardItemModel>
 #include <QKeyEvent>
 #include <QJsonArray>
@@ -18,44 +40,461 @@
 #include <QTextEdit>
 #include <QFormLayout>
 #include <QFileDialog>
+#include <QFile>
 #include <QUrl>
-#include <QPrinter>
 #include <QPrintDialog>
 #include <QDesktopServices>
-#include <QTextDocument>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QEventLoop>
+#include <QProgressDialog>
+#include <QStatusBar>
+#include <QShortcut>
+#include <QSet>
+#include <QFutureWatcher>
+#include <memory>
+#include <algorithm>
+#include <QPlainTextEdit>
+#include <QFontDatabase>
+#include <QDateEdit>
+#include <QComboBox>
 
 
-void start_db();
-void close_db();
 QString intToString(int num, int size = 8);
 int getIntSize(int num, int ren = 0);
-QString generateInvoice(const QJsonArray& items, const QString& transactionTime,
-                        const QString& transactionNumber,
-                        const QString& companyName = "Atelier Princesse",
-                        const QString& companyAddress = "123 Rue Example, 31007 oran",
-                        const QString& clientName = "Client Name",
-                        const QString& clientAddress = "Client Address");
 
 stoking_p::stoking_p(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::stoking_p)
 {
     ui->setupUi(this);
+    startup_mark("window built");
 
-    start_db();
-    setup_search_autocomplete();
-    setup_cartTb();
-    setupHistoryTable();
-
+    scanDetector = new ScanDetector(ui->searchShop, this);
+    receiptPrinter = new ReceiptPrinter(this);
     ui->itemListTB->setContextMenuPolicy(Qt::CustomContextMenu);
     ui->cartListTB->setContextMenuPolicy(Qt::CustomContextMenu);
     ui->historyTable->setContextMenuPolicy(Qt::CustomContextMenu);
-    setup_table();
+
+    // the window goes up first; the database, its migrations and the product
+    // lookup are opened on the first event loop turn, with the pages disabled
+    centralWidget()->setEnabled(false);
+    statusBar()->showMessage("Opening the store...");
+    QTimer::singleShot(0, this, &stoking_p::open_store);
+}
+
+void stoking_p::open_store() {
+    // nothing below works on a closed connection: the window stays disabled
+    // and storeOpen false, so closing it does not snapshot the valuation
+    if (!start_db()) {
+        statusBar()->showMessage("The store database could not be opened.");
+        QMessageBox::critical(this, "Database", "Could not open the store database, see the log for details.");
+        return;
+    }
+    startup_mark("database open");
+
+    if (sync_enabled()) {
+        syncClient = new SyncClient(default_sync_server(), this);
+        syncClient->start();
+    }
+    productRepository = new ProductRepository(this);
+    connect(productRepository, &ProductRepository::productsChanged, this, &stoking_p::products_updated);
+    connect(productRepository, &ProductRepository::productsRemoved, this, &stoking_p::products_removed);
+
+    // only the cart page is needed to start selling, Items and History
+    // load the first time they are opened
+    setup_search_autocomplete();
+    setup_cartTb();
+    startup_mark("cart ready");
+
     setup_form();
 
     setup_connects();
 
+    QTimer::singleShot(2000, this, []() { maybe_snapshot_stock(); });
 
+    // low-stock panel: seeded once, then kept current by checkouts and item edits;
+    // the timer picks up what other registers sold
+    QTimer::singleShot(1000, this, [this]() {
+        QElapsedTimer timer;
+        timer.start();
+        stockWatch.load();
+        update_low_stock_panel();
+        record_timing("stock watch load", timer.elapsed());
+    });
+    // backups run on the thread pool; STOCKING_BACKUP_HOURS sets the interval
+    int backupHours = qEnvironmentVariableIntValue("STOCKING_BACKUP_HOURS");
+    BackupScheduler* backups = new BackupScheduler(QSqlDatabase::database().databaseName(), default_backup_dir(),
+                                                   backupHours > 0 ? backupHours : 6, this);
+    QTimer::singleShot(10000, backups, &BackupScheduler::start);
+
+    // the valuation of a day is snapshotted when the day rolls over or the register closes
+    valuationDay = QDate::currentDate();
+    QTimer* stockSync = new QTimer(this);
+    connect(stockSync, &QTimer::timeout, this, &stoking_p::refresh_stock_watch);
+    stockSync->start(60000);
+
+    setup_memory_budget();
+    setup_api_server();
+
+    // deferred migration work: index builds off the GUI thread, then the
+    // sale items and search index backfills in small chunks
+    BackgroundMigrations* migrations = new BackgroundMigrations(this);
+    connect(migrations, &BackgroundMigrations::finished, migrations, &QObject::deleteLater);
+    connect(migrations, &BackgroundMigrations::indexBuildStarted, this, [this](const QString& name) {
+        statusBar()->showMessage(QString("Updating the database (%1), sales wait until it is done...").arg(name));
+    });
+    connect(migrations, &BackgroundMigrations::indexBuildFinished, this, [this]() {
+        statusBar()->clearMessage();
+    });
+    QTimer::singleShot(3000, migrations, &BackgroundMigrations::start);
+
+    // promotions are compiled once and re-compiled when edited (F9) or after a sale
+    promotions.reload();
+    connect(ui->transactionNameLineEdit, &QLineEdit::textChanged, this, [this](const QString& client) {
+        if (promotions.set_client(client)) reprice_cart();
+    });
+    QShortcut* promotionEditor = new QShortcut(QKeySequence(Qt::Key_F9), this);
+    connect(promotionEditor, &QShortcut::activated, this, &stoking_p::showPromotionsWindow);
+
+    QShortcut* diagnostics = new QShortcut(QKeySequence(Qt::Key_F12), this);
+    connect(diagnostics, &QShortcut::activated, this, &stoking_p::showDiagnosticsWindow);
+
+    // the window has been on screen since before the database was opened;
+    // from here it accepts scans
+    storeOpen = true;
+    centralWidget()->setEnabled(true);
+    statusBar()->clearMessage();
+    ui->searchShop->setFocus();
+    startup_mark("first scan ready");
+    qDebug().noquote() << startup_report();
+}
+
+// everything a committed sale changes outside the cart, whether it was rung up
+// here or came in through the API
+void stoking_p::sale_committed(const QString& client, const CheckoutResult& result, const QList<SaleLine>& lines) {
+    if (syncClient) syncClient->poke();
+    maybe_snapshot_stock();
+    promotions.reload();
+    QVector<int> ids;
+    for (const SaleLine& line : lines) {
+        stockWatch.record_sale(line.name, line.quantity);
+        if (const CartProduct* product = productLookup.find(line.name)) ids.append(product->id);
+    }
+    update_low_stock_panel();
+    update_valuation_label();
+    // only the sold products' rows are re-read, and the sale goes on top of the history
+    refresh_item_rows(ids);
+    if (historyPageLoaded) {
+        if (HistoryModel* model = qobject_cast<HistoryModel*>(ui->historyTable->model())) {
+            model->sale_added(result.transactionId, client, result.date, result.total, result.totalExpense);
+        }
+        salesChart->refresh();
+    }
+}
+
+// lookups are answered off this thread; API checkouts are queued here and
+// run between the cashier's own, on the same connection
+void stoking_p::setup_api_server() {
+    const QString address = default_api_address();
+    if (address.isEmpty()) return;
+
+    apiServer = new ApiServer(QSqlDatabase::database().databaseName(), this,
+                              [this](const QString& client, const QVector<ApiLine>& lines) {
+        QElapsedTimer timer;
+        timer.start();
+        QList<SaleLine> sold;
+        CheckoutResult result = price_and_checkout(client, lines, sold);
+        record_timing("api checkout commit", timer.elapsed());
+        if (result.ok()) sale_committed(client, result, sold);
+        return result;
+    }, this);
+    if (!apiServer->start(address)) {
+        QMessageBox::warning(this, "API Server", "The API is off: " + apiServer->error() + ".");
+        delete apiServer;
+        apiServer = nullptr;
+    }
+}
+
+// what the register keeps in memory, measured for F12; with STOCKING_MEMORY_MB
+// the trimmable caches are cut back, least recently used first, every 15 s
+void stoking_p::setup_memory_budget() {
+    register_cache("product lookup", [this]() { return productLookup.footprint(); });
+    register_cache("stock watch", [this]() { return stockWatch.footprint(); });
+    register_cache("sales series", [this]() { return salesSeries.footprint(); });
+    register_cache("sales analytics", [this]() { return salesAnalytics.footprint(); },
+                   [this](qint64 bytes) { return salesAnalytics.trim(bytes); });
+    register_cache("store reports", [this]() { return federatedReporting.footprint(); },
+                   [this](qint64) { return federatedReporting.trim(); });
+    // QSqlTableModel keeps each fetched row as a QSqlRecord of variants
+    register_cache("items table", [this]() -> qint64 {
+        if (!itemsPageLoaded) return 0;
+        QAbstractItemModel* model = static_cast<QSortFilterProxyModel*>(ui->itemListTB->model())->sourceModel();
+        return qint64(model->rowCount()) * model->columnCount() * 48;
+    });
+    register_cache("cart", [this]() -> qint64 {
+        QAbstractItemModel* model = ui->cartListTB->model();
+        return qint64(model->rowCount()) * model->columnCount() * 96;
+    });
+
+    if (!low_memory_mode()) return;
+    QTimer* budget = new QTimer(this);
+    connect(budget, &QTimer::timeout, this, &enforce_memory_budget);
+    budget->start(15000);
+}
+
+void stoking_p::ensure_items_page() {
+    if (itemsPageLoaded) return;
+    QElapsedTimer timer;
+    timer.start();
+    setup_table();
+    update_category_facets();
+    connect(ui->categoryList, &QListWidget::currentItemChanged, this, [this](QListWidgetItem* item) {
+        if (!item) return;
+        categoryFilter = item->data(Qt::UserRole).toInt();
+        setup_table();
+    });
+    ui->categoryList->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(ui->categoryList, &QListWidget::customContextMenuRequested, this, &stoking_p::showContextMenuCategoryList);
+    connect(ui->valuationLabel, &QLabel::linkActivated, this, &stoking_p::showValuationWindow);
+    itemsPageLoaded = true;
+    update_valuation_label();
+    record_timing("items page first load", timer.elapsed());
+}
+
+void stoking_p::ensure_history_page() {
+    if (historyPageLoaded) return;
+    QElapsedTimer timer;
+    timer.start();
+    setupHistoryTable();
+    setupSalesChart();
+    historyPageLoaded = true;
+    record_timing("history page first load", timer.elapsed());
+}
+
+void stoking_p::refresh_stock_watch() {
+    stockWatch.sync_quantities();
+    update_low_stock_panel();
+    update_valuation_label();
+
+    if (QDate::currentDate() != valuationDay && snapshot_valuation(valuationDay)) {
+        valuationDay = QDate::currentDate();
+    }
+}
+
+// a ProductRepository commit: only the touched products are reloaded
+void stoking_p::products_updated(const QVector<int>& ids) {
+    QHash<int, QString> oldNames;
+    for (int id : ids) {
+        if (const CartProduct* product = productLookup.by_id(id)) oldNames.insert(id, product->name);
+    }
+    if (productLookup.refresh(ids)) update_completer();
+    for (auto it = oldNames.constBegin(); it != oldNames.constEnd(); ++it) {
+        if (const CartProduct* product = productLookup.by_id(it.key())) stockWatch.rename(it.value(), product->name);
+    }
+
+    stockWatch.sync_products(ids);
+    update_low_stock_panel();
+    refresh_item_rows(ids);
+    if (itemsPageLoaded) update_category_facets();
+    update_valuation_label();
+    if (syncClient) syncClient->poke();
+}
+
+void stoking_p::products_removed(const QVector<int>& ids) {
+    for (int id : ids) {
+        if (const CartProduct* product = productLookup.by_id(id)) stockWatch.forget(product->name);
+    }
+    if (productLookup.remove(ids)) update_completer();
+
+    update_low_stock_panel();
+    refresh_item_rows(ids);
+    if (itemsPageLoaded) update_category_facets();
+    update_valuation_label();
+    if (syncClient) syncClient->poke();
+}
+
+// rows already on screen are re-read one by one; a new or deleted product
+// changes the row set, so that needs a select()
+void stoking_p::refresh_item_rows(const QVector<int>& ids) {
+    if (!itemsPageLoaded) return;
+    QSortFilterProxyModel* proxyModel = static_cast<QSortFilterProxyModel*>(ui->itemListTB->model());
+    QSqlTableModel* model = static_cast<QSqlTableModel*>(proxyModel->sourceModel());
+
+    QSet<int> pending(ids.begin(), ids.end());
+    QVector<int> rows;
+    for (int row = 0; row < model->rowCount() && !pending.isEmpty(); ++row) {
+        if (pending.remove(model->data(model->index(row, 0)).toInt())) rows.append(row);
+    }
+
+    if (!pending.isEmpty()) {
+        model->select();
+        return;
+    }
+    for (int row : rows) {
+        model->selectRow(row);
+    }
+}
+
+// reads the running sums, one row per category, never the catalog
+void stoking_p::update_valuation_label() {
+    if (!itemsPageLoaded) return;
+    Valuation valuation = current_valuation();
+
+    ui->valuationLabel->setText(QString("Stock value: %1 units   Cost: %2 DZD   Retail: %3 DZD   "
+                                        "<a href=\"report\">Details...</a>")
+                                    .arg(valuation.units)
+                                    .arg(valuation.cost, 0, 'f', 2)
+                                    .arg(valuation.retail, 0, 'f', 2));
+    QStringList breakdown;
+    for (const CategoryValuation& category : valuation.categories) {
+        breakdown << QString("%1: %2 units, cost %3, retail %4")
+                         .arg(category.category)
+                         .arg(category.units)
+                         .arg(category.cost, 0, 'f', 2)
+                         .arg(category.retail, 0, 'f', 2);
+    }
+    ui->valuationLabel->setToolTip(breakdown.join('\n'));
+}
+
+void stoking_p::showValuationWindow() {
+    QDialog dialog(this);
+    dialog.setWindowTitle("Stock Valuation");
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+
+    auto make_table = [&dialog, layout](QStandardItemModel* model) {
+        QTableView* table = new QTableView(&dialog);
+        table->setModel(model);
+        table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        table->setSelectionBehavior(QAbstractItemView::SelectRows);
+        table->verticalHeader()->setVisible(false);
+        table->horizontalHeader()->setStretchLastSection(true);
+        table->horizontalHeader()->setMinimumSectionSize(96);
+        layout->addWidget(table);
+        return table;
+    };
+
+    Valuation valuation = current_valuation();
+    layout->addWidget(new QLabel("On hand now, by category", &dialog));
+    QStandardItemModel* current = new QStandardItemModel(&dialog);
+    current->setHorizontalHeaderLabels({"Category", "Units", "Cost Value", "Retail Value", "Margin"});
+    current->setRowCount(valuation.categories.size());
+    for (int i = 0; i < valuation.categories.size(); ++i) {
+        const CategoryValuation& category = valuation.categories[i];
+        current->setItem(i, 0, new QStandardItem(category.category));
+        current->setItem(i, 1, new QStandardItem(QString::number(category.units)));
+        current->setItem(i, 2, new QStandardItem(QString::number(category.cost, 'f', 2)));
+        current->setItem(i, 3, new QStandardItem(QString::number(category.retail, 'f', 2)));
+        current->setItem(i, 4, new QStandardItem(QString::number(category.retail - category.cost, 'f', 2)));
+    }
+    make_table(current)->resizeColumnsToContents();
+
+    QVector<ValuationSnapshot> history = valuation_history(30);
+    layout->addWidget(new QLabel("Closing value, last 30 days", &dialog));
+    QStandardItemModel* days = new QStandardItemModel(&dialog);
+    days->setHorizontalHeaderLabels({"Day", "Units", "Cost Value", "Retail Value", "Change (Cost)"});
+    days->setRowCount(history.size());
+    for (int i = 0; i < history.size(); ++i) {
+        const ValuationSnapshot& snapshot = history[i];
+        // newest first, so the previous day is the next row
+        double change = i + 1 < history.size() ? snapshot.cost - history[i + 1].cost : 0;
+        days->setItem(i, 0, new QStandardItem(snapshot.day.toString("yyyy-MM-dd")));
+        days->setItem(i, 1, new QStandardItem(QString::number(snapshot.units)));
+        days->setItem(i, 2, new QStandardItem(QString::number(snapshot.cost, 'f', 2)));
+        days->setItem(i, 3, new QStandardItem(QString::number(snapshot.retail, 'f', 2)));
+        days->setItem(i, 4, new QStandardItem(QString::number(change, 'f', 2)));
+    }
+    make_table(days)->resizeColumnsToContents();
+
+    dialog.resize(700, 550);
+    dialog.exec();
+}
+
+void stoking_p::update_low_stock_panel() {
+    ui->lowStockList->clear();
+    for (const StockAlert& alert : stockWatch.alerts()) {
+        QString text = alert.quantity <= 0
+                           ? QString("%1\nout of stock, order %2").arg(alert.name).arg(alert.reorder)
+                           : QString("%1\n%2 left, ~%3 days, order %4")
+                                 .arg(alert.name)
+                                 .arg(alert.quantity)
+                                 .arg(alert.daysLeft, 0, 'f', 0)
+                                 .arg(alert.reorder);
+        QListWidgetItem* item = new QListWidgetItem(text, ui->lowStockList);
+        item->setToolTip(QString("Selling %1 per day").arg(alert.perDay, 0, 'f', 2));
+    }
+}
+
+void stoking_p::showPromotionsWindow() {
+    QDialog dialog(this);
+    dialog.setWindowTitle("Promotions");
+
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel("kind: multibuy (buy_qty, pay_qty), percent (percent), bundle (buy_qty, bundle_price), "
+                                 "client (client, percent). Dates are yyyy-MM-dd, empty means open ended.", &dialog));
+
+    QSqlTableModel* model = new QSqlTableModel(&dialog);
+    model->setTable("promotions");
+    model->setEditStrategy(QSqlTableModel::OnManualSubmit);
+    model->select();
+
+    QTableView* table = new QTableView(&dialog);
+    table->setModel(model);
+    table->setColumnHidden(0, true);
+    table->verticalHeader()->setVisible(false);
+    table->resizeColumnsToContents();
+    layout->addWidget(table);
+
+    QHBoxLayout* buttons = new QHBoxLayout;
+    QPushButton* addButton = new QPushButton("Add", &dialog);
+    QPushButton* removeButton = new QPushButton("Remove", &dialog);
+    QPushButton* saveButton = new QPushButton("Save", &dialog);
+    buttons->addWidget(addButton);
+    buttons->addWidget(removeButton);
+    buttons->addStretch();
+    buttons->addWidget(saveButton);
+    layout->addLayout(buttons);
+
+    connect(addButton, &QPushButton::clicked, &dialog, [model, table]() {
+        int row = model->rowCount();
+        model->insertRow(row);
+        model->setData(model->index(row, model->fieldIndex("name")), "New promotion");
+        model->setData(model->index(row, model->fieldIndex("kind")), "percent");
+        model->setData(model->index(row, model->fieldIndex("active")), 1);
+        table->scrollToBottom();
+    });
+    connect(removeButton, &QPushButton::clicked, &dialog, [model, table]() {
+        if (table->currentIndex().isValid()) model->removeRow(table->currentIndex().row());
+    });
+    connect(saveButton, &QPushButton::clicked, &dialog, [this, model, &dialog]() {
+        if (!model->submitAll()) {
+            qDebug() << "Saving promotions failed:" << model->lastError();
+            QMessageBox::warning(&dialog, "Promotions", "Could not save: " + model->lastError().text());
+            return;
+        }
+        promotions.reload();
+        reprice_cart();
+        dialog.accept();
+    });
+
+    dialog.resize(1000, 500);
+    dialog.exec();
+}
+
+void stoking_p::showDiagnosticsWindow() {
+    QDialog dialog(this);
+    dialog.setWindowTitle("Diagnostics");
+
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+    QPlainTextEdit* text = new QPlainTextEdit(&dialog);
+    text->setReadOnly(true);
+    text->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    text->setPlainText(startup_report() + "\n" + timings_report() + "\n" + register_metrics_report() + "\n"
+                       + migrations_report() + "\n" + memory_report());
+    layout->addWidget(text);
+
+    dialog.resize(700, 450);
+    dialog.exec();
 }
 //=====================================================================================================================
 
@@ -65,9 +504,11 @@ void stoking_p::setup_cartTb(){
     if (!model) {
         model = new QStandardItemModel(this);
         ui->cartListTB->setModel(model);
-        model->setHorizontalHeaderLabels({"Name", "Type", "Quantity", "Price", "Subtotal", "Expense", "Subexpense"});
+        model->setHorizontalHeaderLabels({"Name", "Type", "Quantity", "Price", "Subtotal", "Expense", "Subexpense",
+                                          "Discount", "Promotion"});
         ui->cartListTB->setColumnHidden(5, true);
         ui->cartListTB->setColumnHidden(6, true);
+        ui->cartListTB->setColumnHidden(8, true);
     }
 
     ui->cartListTB->installEventFilter(this);
@@ -97,6 +538,7 @@ void stoking_p::showContextMenuCartList(const QPoint &pos){
     if (selectedAction == deleteAction) {
         auto response = QMessageBox::question(this, "Delete Confirmation", "Are you sure you want to delete this item?");
         if (response == QMessageBox::Yes) {
+            sessionRecorder.record("remove", {{"row", index.row()}});
             model->removeRow(index.row());
         }
     } else if (selectedAction == editAction) {
@@ -114,15 +556,8 @@ void stoking_p::showContextMenuCartList(const QPoint &pos){
                                           &ok);
 
         if (ok) {
-            model->setData(model->index(index.row(), quantityColumn), newQty);
-            float price = model->data(model->index(index.row(), 3)).toFloat();
-            float expense = model->data(model->index(index.row(), 5)).toFloat();
-            double total = newQty * price;
-            double totalExpense = newQty * expense;
-            QString totalStr = QString::number(total, 'f', 2);
-            QString totalExpenseStr = QString::number(totalExpense, 'f', 2);
-            model->setData(model->index(index.row(), 4), totalStr);
-            model->setData(model->index(index.row(), 6), totalExpenseStr);
+            sessionRecorder.record("quantity", {{"row", index.row()}, {"quantity", newQty}});
+            set_cart_quantity(index.row(), newQty);
         }
     }
     update_transaction_summary();
@@ -130,17 +565,89 @@ void stoking_p::showContextMenuCartList(const QPoint &pos){
 
 
 void stoking_p::setup_search_autocomplete() {
-    QSqlQuery query("SELECT name FROM products");
-    QStringList nameList;
+    // one pass over products feeds both the scan lookup and the completer
+    productLookup.reload();
 
-    while (query.next()) {
-        nameList << query.value(0).toString();
-    }
+    update_completer();
+}
 
-    QCompleter* completer = new QCompleter(nameList, this);
+void stoking_p::update_completer() {
+    if (QCompleter* completer = ui->searchShop->completer()) {
+        static_cast<QStringListModel*>(completer->model())->setStringList(productLookup.names());
+        return;
+    }
+    QCompleter* completer = new QCompleter(productLookup.names(), this);
+    track_object(completer, "search completer");
     completer->setCaseSensitivity(Qt::CaseInsensitive);
     completer->setFilterMode(Qt::MatchContains);
     ui->searchShop->setCompleter(completer);
+    scanDetector->watch_completer();
+}
+
+void stoking_p::set_cart_quantity(int row, int qty) {
+    QStandardItemModel* model = qobject_cast<QStandardItemModel*>(ui->cartListTB->model());
+
+    float expense = model->data(model->index(row, 5)).toFloat();
+    double totalExpense = qty * expense;
+    QString totalExpenseStr = QString::number(totalExpense, 'f', 2);
+    model->setData(model->index(row, 2), qty);
+    model->setData(model->index(row, 6), totalExpenseStr);
+    reprice_line(row);   // subtotal, after promotions
+}
+
+// only the edited line is priced again; the rules that can touch it are found
+// through the engine's product and category indexes
+void stoking_p::reprice_line(int row) {
+    QStandardItemModel* model = qobject_cast<QStandardItemModel*>(ui->cartListTB->model());
+    const CartProduct* product = productLookup.by_name(model->item(row, 0)->text());
+
+    CartLine line;
+    line.productId = product ? product->id : 0;
+    line.categoryId = product ? product->categoryId : 0;
+    line.quantity = model->item(row, 2)->text().toInt();
+    line.price = model->item(row, 3)->text().toDouble();
+
+    LineDiscount discount = promotions.price_line(line);
+    model->setData(model->index(row, 4), QString::number(line.quantity * line.price - discount.amount, 'f', 2));
+    model->setData(model->index(row, 7), QString::number(discount.amount, 'f', 2));
+    model->setData(model->index(row, 8), discount.promotionId);
+}
+
+void stoking_p::reprice_cart() {
+    QStandardItemModel* model = qobject_cast<QStandardItemModel*>(ui->cartListTB->model());
+    for (int row = 0; row < model->rowCount(); ++row) reprice_line(row);
+    update_transaction_summary();
+}
+
+void stoking_p::add_to_cart(const CartProduct& product) {
+    note_register_activity();
+    QStandardItemModel* model = qobject_cast<QStandardItemModel*>(ui->cartListTB->model());
+
+    // scanning the same item again bumps its line instead of adding a new one
+    for (int row = 0; row < model->rowCount(); ++row) {
+        if (model->item(row, 0)->text() == product.name) {
+            set_cart_quantity(row, model->item(row, 2)->text().toInt() + 1);
+            ui->cartListTB->selectRow(row);
+            update_transaction_summary();
+            return;
+        }
+    }
+
+    int quantity = 1;
+    QList<QStandardItem*> row;
+    row << new QStandardItem(product.name)
+        << new QStandardItem(product.type)
+        << new QStandardItem(QString::number(quantity))
+        << new QStandardItem(QString::number(product.price))
+        << new QStandardItem(QString::number(quantity * product.price))
+        << new QStandardItem(QString::number(product.cost))
+        << new QStandardItem(QString::number(quantity * product.cost))
+        << new QStandardItem(QString::number(0, 'f', 2))
+        << new QStandardItem(QString::number(0));
+    model->appendRow(row);
+    reprice_line(model->rowCount() - 1);
+
+    update_transaction_summary();
 }
 
 bool stoking_p::eventFilter(QObject* obj, QEvent* event) {
@@ -162,25 +669,18 @@ bool stoking_p::eventFilter(QObject* obj, QEvent* event) {
         else if (keyEvent->key() == Qt::Key_Delete) {
             auto response = QMessageBox::question(this, "Delete Confirmation", "Are you sure you want to delete this item?");
             if (response == QMessageBox::Yes) {
+                sessionRecorder.record("remove", {{"row", row}});
                 model->removeRow(row);
                 update_transaction_summary();
-                return true;
             }
+            return true;    // declined: the line stays as it was, nothing to record
         }
         else {
             return false;
         }
 
-        float price = model->data(model->index(row, 3)).toFloat();
-        float expense = model->data(model->index(row, 5)).toFloat();
-        double total = qty * price;
-        double totalExpense = qty * expense;
-        QString totalStr = QString::number(total, 'f', 2);
-        QString totalExpenseStr = QString::number(totalExpense, 'f', 2);
-        model->setData(model->index(row, 2), qty);
-        model->setData(model->index(row, 4), totalStr);
-        model->setData(model->index(row, 6), totalExpenseStr);
-
+        sessionRecorder.record("quantity", {{"row", row}, {"quantity", qty}});
+        set_cart_quantity(row, qty);
         update_transaction_summary();
 
         return true;
@@ -209,7 +709,8 @@ bool stoking_p::validateItems(
     QString item_type,
     QString item_price,
     QString item_bought,
-    int item_count)
+    int item_count,
+    QString item_barcode)
 {
     if (item_name.trimmed().isEmpty() ||
         item_type.trimmed().isEmpty() ||
@@ -221,6 +722,7 @@ bool stoking_p::validateItems(
 
     static const QRegularExpression nameTypeRe("^[A-Za-z0-9 ]{2,}$");
     static const QRegularExpression priceRe("^\\d+(\\.\\d{1,2})?$");
+    static const QRegularExpression barcodeRe("^[A-Za-z0-9-]{4,64}$");
 
     if (!nameTypeRe.match(item_name).hasMatch()) {
         QMessageBox::warning(this, "Input Error", "Name must be at least 2 characters and contain only letters, numbers, or spaces.");
@@ -247,6 +749,11 @@ bool stoking_p::validateItems(
         return false;
     }
 
+    if (!item_barcode.trimmed().isEmpty() && !barcodeRe.match(item_barcode.trimmed()).hasMatch()) {
+        QMessageBox::warning(this, "Input Error", "Barcode must be 4 to 64 letters, digits or dashes.");
+        return false;
+    }
+
     return true;
 }
 
@@ -257,40 +764,24 @@ void stoking_p::clear_form(){
     ui->itemPrice_edit->clear();
     ui->itemBuy_edit->clear();
     ui->itemCount_edit->setValue(0);
+    ui->itemBarcode_edit->clear();
 }
 
 void stoking_p::setupHistoryTable() {
-    // Create a model with custom data columns
-    QStandardItemModel* model = new QStandardItemModel(ui->historyTable);
-    model->setHorizontalHeaderLabels({"ID", "Name", "Time", "Total Sold", "Total Expenss", "Net Profit"});
-
-    QSqlQuery query("SELECT id, name, total, total_expense, date, details FROM transactions ORDER BY date DESC");
-
-    while (query.next()) {
-        int id = query.value(0).toInt();
-        QString name = query.value(1).toString();
-        double totalSold = query.value(2).toDouble();
-        double totalExpense = query.value(3).toDouble();
-        QString date = query.value(4).toString();
-        QString detailsJson = query.value(5).toString();
-
-        double profit = totalSold - totalExpense;
-
-        QList<QStandardItem*> rowItems;
-        rowItems << new QStandardItem(intToString(id))
-                 << new QStandardItem(name)
-                 << new QStandardItem(date)
-                 << new QStandardItem(QString::number(totalSold, 'f', 2))
-                 << new QStandardItem(QString::number(totalExpense, 'f', 2))
-                 << new QStandardItem(QString::number(profit, 'f', 2));
-
-        // Store details JSON as user data on the row for later
-        rowItems[0]->setData(detailsJson, Qt::UserRole + 1);
-
-        model->appendRow(rowItems);
+    // the model pages rows in from sql, so a refresh only reloads the first page
+    HistoryModel* model = qobject_cast<HistoryModel*>(ui->historyTable->model());
+    if (model) {
+        model->reload();
+        return;
     }
 
+    model = new HistoryModel(ui->historyTable);
+    track_object(model, "history model");
+    model->set_query(HistoryQuery::parse(ui->searchHistory->text()));
+
     ui->historyTable->setModel(model);
+    ui->historyTable->setSortingEnabled(true);
+    ui->historyTable->sortByColumn(HistoryModel::DateColumn, Qt::DescendingOrder);
     ui->historyTable->resizeColumnsToContents();
     ui->historyTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui->historyTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
@@ -299,6 +790,68 @@ void stoking_p::setupHistoryTable() {
     ui->historyTable->horizontalHeader()->setMinimumHeight(64);
     ui->historyTable->horizontalHeader()->setMaximumHeight(64);
     ui->historyTable->horizontalHeader()->setMinimumSectionSize(128);
+
+    connect(ui->searchHistory, &QLineEdit::textChanged, model, &HistoryModel::set_query_text);
+
+    // one detail pane for every row: mouse or arrow keys only refill it
+    transactionCache = new TransactionCache(low_memory_mode() ? 1024 * 1024 : 4 * 1024 * 1024, this);
+    register_cache("history rows", [model]() { return model->footprint(); },
+                   [model](qint64 bytes) { return model->trim(bytes); });
+    register_cache("transaction details", [this]() { return transactionCache->footprint(); },
+                   [this](qint64 bytes) { return transactionCache->trim(bytes); });
+    detailPane = new TransactionDetailPane(this);
+    detailPane->hide();
+    ui->historyMainWindow->addWidget(detailPane);
+    connect(detailPane, &TransactionDetailPane::invoiceRequested, this, &stoking_p::print_invoice);
+    connect(detailPane, &TransactionDetailPane::receiptRequested, this, [this](const DecodedTransaction& transaction) {
+        if (!receiptPrinter->enabled()) {
+            QMessageBox::information(this, "Receipt", "No receipt printer is set up (STOCKING_RECEIPT_PRINTER).");
+            return;
+        }
+        Receipt receipt;
+        receipt.transactionId = transaction.id;
+        receipt.client = transaction.client;
+        receipt.date = transaction.date;
+        receipt.items = transaction.items;
+        receipt.total = transaction.total;
+        receiptPrinter->print(receipt);
+    });
+    connect(ui->historyTable->selectionModel(), &QItemSelectionModel::currentRowChanged, this,
+            [this, model](const QModelIndex& current) {
+        if (!current.isValid()) return;
+        touch_cache("history rows");
+        touch_cache("transaction details");
+        sessionRecorder.record("history", {{"id", model->transaction_id(current.row())}});
+        QElapsedTimer timer;
+        timer.start();
+        const DecodedTransaction* transaction = transactionCache->get(model->transaction_id(current.row()));
+        if (!transaction) return;
+        detailPane->show_transaction(*transaction);
+        detailPane->show();
+        record_timing("transaction detail", timer.elapsed());
+
+        // the rows the arrow keys reach next
+        QVector<int> neighbours;
+        for (int row = current.row() - 4; row <= current.row() + 8; ++row) {
+            if (row >= 0 && row < model->rowCount() && row != current.row()) neighbours << model->transaction_id(row);
+        }
+        transactionCache->prefetch(neighbours);
+    });
+}
+
+void stoking_p::setupSalesChart() {
+    salesChart = new SalesChart(&salesSeries, this);
+    ui->historyMainWindow->insertWidget(1, salesChart);
+    showSalesChart("This Month", Granularity::Day, [](QDate today) { return today.addMonths(-1); });
+}
+
+// dates are stored in UTC, so "today" is the UTC day like sqlite's DATE('now')
+void stoking_p::showSalesChart(const QString& title, Granularity granularity, QDate (*start)(QDate)) {
+    QDate today = QDateTime::currentDateTimeUtc().date();
+    sessionRecorder.record("summary", {{"granularity", int(granularity)},
+                                       {"from", start(today).toString(Qt::ISODate)},
+                                       {"to", today.toString(Qt::ISODate)}});
+    salesChart->show_range(title, start(today), today, granularity);
 }
 
 void stoking_p::setup_form(){
@@ -324,25 +877,36 @@ void stoking_p::setup_form(){
         QString item_price = ui->itemPrice_edit->text();
         QString item_bought = ui->itemBuy_edit->text();
         int item_count = ui->itemCount_edit->value();
-        if(validateItems(item_name, item_type, item_price, item_bought, item_count)){
+        QString item_barcode = ui->itemBarcode_edit->text().trimmed();
+        if(validateItems(item_name, item_type, item_price, item_bought, item_count, item_barcode)){
             clear_form();
             insert_item_db(
                 item_name,
                 item_type,
                 item_price.toFloat(),
                 item_bought.toFloat(),
-                item_count);
+                item_count,
+                item_barcode);
         }
-        setup_table();
 
         ui->addTableItem_btn->setDisabled(false);
     });
 }
 
 void stoking_p::setup_table() {
+    // built once; later calls re-select, with the current category
+    if (ProductFilterModel* proxyModel = qobject_cast<ProductFilterModel*>(ui->itemListTB->model())) {
+        QSqlTableModel* model = static_cast<QSqlTableModel*>(proxyModel->sourceModel());
+        model->setFilter(categoryFilter > 0 ? QString("category_id = %1").arg(categoryFilter) : QString());
+        model->select();
+        return;
+    }
 
     QSqlTableModel *model = new QSqlTableModel(ui->itemListTB);
+    track_object(model, "items table model");
     model->setTable("products");
+    // the category facet is applied in sql, on idx_products_category
+    if (categoryFilter > 0) model->setFilter(QString("category_id = %1").arg(categoryFilter));
     model->select();
 
     model->setHeaderData(0, Qt::Horizontal, QObject::tr("ID"));
@@ -351,6 +915,7 @@ void stoking_p::setup_table() {
     model->setHeaderData(3, Qt::Horizontal, QObject::tr("Quantity"));
     model->setHeaderData(4, Qt::Horizontal, QObject::tr("Selling Price"));
     model->setHeaderData(5, Qt::Horizontal, QObject::tr("Bought Price"));
+    model->setHeaderData(6, Qt::Horizontal, QObject::tr("Barcode"));
 
     model->setHeaderData(0, Qt::Horizontal, Qt::AlignLeft, Qt::TextAlignmentRole);
     model->setHeaderData(1, Qt::Horizontal, Qt::AlignLeft, Qt::TextAlignmentRole);
@@ -358,14 +923,17 @@ void stoking_p::setup_table() {
     model->setHeaderData(3, Qt::Horizontal, Qt::AlignLeft, Qt::TextAlignmentRole);
     model->setHeaderData(4, Qt::Horizontal, Qt::AlignLeft, Qt::TextAlignmentRole);
     model->setHeaderData(5, Qt::Horizontal, Qt::AlignLeft, Qt::TextAlignmentRole);
+    model->setHeaderData(6, Qt::Horizontal, Qt::AlignLeft, Qt::TextAlignmentRole);
 
 
-    QSortFilterProxyModel *proxyModel = new QSortFilterProxyModel(ui->itemListTB);
+    ProductFilterModel *proxyModel = new ProductFilterModel(ui->itemListTB);
+    track_object(proxyModel, "items filter model");
     proxyModel->setSourceModel(model);
-    proxyModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
-    proxyModel->setFilterKeyColumn(-1);
+    proxyModel->apply_query(ui->searchItem->text());
 
     ui->itemListTB->setModel(proxyModel);
+    ui->itemListTB->setColumnHidden(model->fieldIndex("category_id"), true);
+    ui->itemListTB->setSortingEnabled(true);
     ui->itemListTB->setEditTriggers(QAbstractItemView::NoEditTriggers);
     ui->itemListTB->resizeColumnsToContents();
     ui->itemListTB->setSelectionBehavior(QAbstractItemView::SelectRows);
@@ -376,9 +944,36 @@ void stoking_p::setup_table() {
     ui->itemListTB->horizontalHeader()->setMinimumSectionSize(128);
 
     disconnect(ui->searchItem, nullptr, nullptr, nullptr);
-    connect(ui->searchItem, &QLineEdit::textChanged, this, [=](const QString &text) {
-        proxyModel->setFilterFixedString(text);
-    });
+    connect(ui->searchItem, &QLineEdit::textChanged, proxyModel, &ProductFilterModel::set_query);
+}
+
+void stoking_p::update_category_facets() {
+    QVector<Category> categories = load_categories();
+    int total = 0;
+    for (const Category& category : categories) total += category.productCount;
+
+    QSignalBlocker blocker(ui->categoryList);
+    ui->categoryList->clear();
+    QListWidgetItem* all = new QListWidgetItem(QString("All (%1)").arg(total), ui->categoryList);
+    all->setData(Qt::UserRole, 0);
+    for (const Category& category : categories) {
+        QListWidgetItem* item = new QListWidgetItem(QString("%1 (%2)").arg(category.name).arg(category.productCount),
+                                                    ui->categoryList);
+        item->setData(Qt::UserRole, category.id);
+    }
+
+    for (int i = 0; i < ui->categoryList->count(); ++i) {
+        if (ui->categoryList->item(i)->data(Qt::UserRole).toInt() == categoryFilter) {
+            ui->categoryList->setCurrentRow(i);
+            return;
+        }
+    }
+    // the selected category lost its last product
+    ui->categoryList->setCurrentRow(0);
+    if (categoryFilter != 0) {
+        categoryFilter = 0;
+        setup_table();
+    }
 }
 
 void stoking_p::showContextMenuItemList(const QPoint &pos) {
@@ -387,6 +982,7 @@ void stoking_p::showContextMenuItemList(const QPoint &pos) {
 
     QMenu contextMenu(this);
     QAction *editAction = contextMenu.addAction("Edit");
+    QAction *adjustAction = contextMenu.addAction("Adjust Stock...");
     QAction *deleteAction = contextMenu.addAction("Delete");
 
     QAction *selectedAction = contextMenu.exec(ui->itemListTB->viewport()->mapToGlobal(pos));
@@ -425,7 +1021,8 @@ void stoking_p::showContextMenuItemList(const QPoint &pos) {
             QString item_price = ui->itemPrice_edit->text();
             QString item_bought = ui->itemBuy_edit->text();
             int item_count = ui->itemCount_edit->value();
-            if(validateItems(item_name, item_type, item_price, item_bought, item_count)){
+            QString item_barcode = ui->itemBarcode_edit->text().trimmed();
+            if(validateItems(item_name, item_type, item_price, item_bought, item_count, item_barcode)){
                 setup_form();
                 update_item_db(
                     id,
@@ -433,9 +1030,9 @@ void stoking_p::showContextMenuItemList(const QPoint &pos) {
                     item_type,
                     item_price.toFloat(),
                     item_bought.toFloat(),
-                    item_count);
+                    item_count,
+                    item_barcode);
             }
-            setup_table();
 
             ui->addTableItem_btn->setDisabled(false);
         });
@@ -445,65 +1042,163 @@ void stoking_p::showContextMenuItemList(const QPoint &pos) {
         int quantity = model->data(model->index(sourceIndex.row(), 3)).toInt();
         float price = model->data(model->index(sourceIndex.row(), 4)).toFloat();
         float bought = model->data(model->index(sourceIndex.row(), 5)).toFloat();
+        QString barcode = model->data(model->index(sourceIndex.row(), 6)).toString();
 
         ui->itemName_edit->setText(name);
         ui->itemType_edit->setText(type);
         ui->itemCount_edit->setValue(quantity);
         ui->itemPrice_edit->setText(QString::number(price));
         ui->itemBuy_edit->setText(QString::number(bought));
+        ui->itemBarcode_edit->setText(barcode);
+    }
+
+    if (selectedAction == adjustAction) {
+        int id = model->data(model->index(sourceIndex.row(), 0)).toInt();
+        QString name = model->data(model->index(sourceIndex.row(), 1)).toString();
+        bool ok = false;
+        int delta = QInputDialog::getInt(this, "Adjust Stock",
+                                         QString("Units to add to %1 (negative to remove):").arg(name),
+                                         0, -1000000, 1000000, 1, &ok);
+        if (!ok || delta == 0) return;
+
+        TxResult tx = productRepository->adjust_quantity(
+            id, delta, delta > 0 ? StockReason::Restock : StockReason::Adjustment);
+        if (tx.outcome != TxOutcome::Committed) {
+            qDebug() << "Stock adjustment failed:" << tx.message;
+            QMessageBox::warning(this, "Stock Error", "Could not adjust stock: " + tx.message);
+        }
     }
 
     if (selectedAction == deleteAction) {
         auto response = QMessageBox::question(this, "Delete Confirmation", "Are you sure you want to delete this item?");
         if (response == QMessageBox::Yes) {
-            model->removeRow(sourceIndex.row());
-            model->submitAll();
-            setup_table();
+            int id = model->data(model->index(sourceIndex.row(), 0)).toInt();
+            TxResult tx = productRepository->remove({id});
+            if (tx.outcome != TxOutcome::Committed) {
+                qDebug() << "Delete failed:" << tx.message;
+                QMessageBox::warning(this, "Delete Error", "Could not delete item.");
+            }
         }
     }
 }
 
+// price changes for a whole category (a supplier's range) are one commit
+void stoking_p::showContextMenuCategoryList(const QPoint &pos) {
+    QListWidgetItem* item = ui->categoryList->itemAt(pos);
+    int categoryId = item ? item->data(Qt::UserRole).toInt() : 0;
+    if (categoryId <= 0) return;
+
+    QMenu contextMenu(this);
+    QAction *priceAction = contextMenu.addAction("Change Prices...");
+    if (contextMenu.exec(ui->categoryList->viewport()->mapToGlobal(pos)) != priceAction) return;
+
+    bool ok = false;
+    double percent = QInputDialog::getDouble(this, "Change Prices",
+                                             QString("Percent to add to every selling price in %1\n"
+                                                     "(negative for a reduction):").arg(item->text()),
+                                             0, -90, 1000, 2, &ok);
+    if (!ok || percent == 0) return;
+
+    TxResult tx = productRepository->scale_prices(categoryId, percent);
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Price update failed:" << tx.message;
+        QMessageBox::warning(this, "Update Error", "Could not update prices: " + tx.message);
+    }
+}
 
-void stoking_p::insert_item_db(QString name, QString type, float price, float bought, int count){
-    QSqlQuery insertQuery;
-    insertQuery.prepare("INSERT INTO products (name, item_type, quantity, price, bought) VALUES (?, ?, ?, ?, ?)");
-    insertQuery.addBindValue(name);
-    insertQuery.addBindValue(type);
-    insertQuery.addBindValue(count);
-    insertQuery.addBindValue(price);
-    insertQuery.addBindValue(bought);
 
-    if (!insertQuery.exec()) {
-        qDebug() << "Insert failed:" << insertQuery.lastError();
-        QMessageBox::warning(this, "Input Error", "product name must be unique.");
+void stoking_p::insert_item_db(QString name, QString type, float price, float bought, int count, QString barcode){
+    ProductRecord product;
+    product.name = name;
+    product.type = type;
+    product.quantity = count;
+    product.price = price;
+    product.bought = bought;
+    product.barcode = barcode;
+
+    TxResult tx = productRepository->insert(product);
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Insert failed:" << tx.message;
+        QMessageBox::warning(this, "Input Error", "product name and barcode must be unique.");
     } else {
         qDebug() << "Insert successful!";
     }
-    setup_search_autocomplete();
 }
 
-void stoking_p::update_item_db(int id, QString name, QString type, float price, float bought, int count) {
-    QSqlQuery query;
-    query.prepare("UPDATE products SET name = ?, item_type = ?, quantity = ?, price = ?, bought = ? WHERE id = ?");
-    query.addBindValue(name);
-    query.addBindValue(type);
-    query.addBindValue(count);
-    query.addBindValue(price);
-    query.addBindValue(bought);
-    query.addBindValue(id);
-
-    if (!query.exec()) {
-        qDebug() << "Update failed:" << query.lastError();
-        QMessageBox::warning(this, "Update Error", "Could not update item. Make sure name is unique.");
+void stoking_p::update_item_db(int id, QString name, QString type, float price, float bought, int count, QString barcode) {
+    ProductRecord product;
+    product.id = id;
+    product.name = name;
+    product.type = type;
+    product.quantity = count;
+    product.price = price;
+    product.bought = bought;
+    product.barcode = barcode;
+
+    TxResult tx = productRepository->upsert(product);
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Update failed:" << tx.message;
+        QMessageBox::warning(this, "Update Error", "Could not update item. Make sure name and barcode are unique.");
     } else {
         qDebug() << "Update successful!";
     }
-    setup_search_autocomplete();
 }
 
 //=====================================================================================================================
 
 
+void stoking_p::print_invoice(const DecodedTransaction& transaction) {
+    sessionRecorder.record("invoice", {{"id", transaction.id}});
+    const QJsonArray& items = transaction.items;
+    const QString transactionName = transaction.client;
+    const QString transactionTime = transaction.date;
+    const QString transactionNumber = QString::number(transaction.id);
+
+    QString companyName, companyAddress, clientAddress;
+
+    if (showInvoiceDialog(transactionName, companyName, companyAddress, clientAddress, this)) {
+        QString invoiceHtml = generateInvoice(items, transactionTime,
+                                              transactionNumber,
+                                              companyName,
+                                              companyAddress,
+                                              transactionName,
+                                              clientAddress);
+
+        // Ask user where to save the PDF
+        QString filePath = QFileDialog::getSaveFileName(
+            this,
+            "Sauvegarder la facture PDF",
+            "facture_" + transactionName + ".pdf",
+            "Fichiers PDF (*.pdf)"
+            );
+        if (filePath.isEmpty())
+            return;
+
+        if (!filePath.endsWith(".pdf", Qt::CaseInsensitive))
+            filePath += ".pdf";
+
+
+        // a reprint with the same details is a copy of the cached pdf
+        QString cachedPdf = invoiceCache.pdf_for(invoiceHtml);
+        if (cachedPdf.isEmpty()) {
+            QMessageBox::warning(this, "Invoice Error", "Could not render the invoice.");
+            return;
+        }
+        if (QFile::exists(filePath)) QFile::remove(filePath);
+        if (!QFile::copy(cachedPdf, filePath)) {
+            qDebug() << "Copying invoice to" << filePath << "failed";
+            QMessageBox::warning(this, "Invoice Error", "Could not save the invoice to " + filePath);
+            return;
+        }
+
+        QMessageBox::information(this, "Facture sauvegardée",
+                                 "La facture PDF a été sauvegardée:\n" + filePath);
+        QDesktopServices::openUrl(QUrl::fromLocalFile(filePath));
+
+
+    }
+}
+
 void stoking_p::showContextMenuHistoryList(const QPoint &pos){
 
 }
@@ -526,171 +1221,50 @@ void stoking_p::setup_connects(){
     });
 
     connect(ui->StoreItems, &QPushButton::clicked, this, [this]() {
+        ensure_items_page();
         ui->windowHolder->setCurrentIndex(ItemPage);
     });
 
     connect(ui->ProductHistory, &QPushButton::clicked, this, [this]() {
+        ensure_history_page();
         ui->windowHolder->setCurrentIndex(HistoryPage);
     });
 
     // TODAY
     connect(ui->income_today, &QPushButton::clicked, this, [=]() {
-        getFinancialSummaryAndShow("DATE(date) = DATE('now')");
+        showSalesChart("Today", Granularity::Day, [](QDate today) { return today; });
     });
 
     // THIS MONTH
     connect(ui->income_month, &QPushButton::clicked, this, [=]() {
-        getFinancialSummaryAndShow("DATE(date) >= DATE('now', '-1 month')");
+        showSalesChart("This Month", Granularity::Day, [](QDate today) { return today.addMonths(-1); });
     });
 
     // PAST 3 MONTHS
     connect(ui->income_3months, &QPushButton::clicked, this, [=]() {
-        getFinancialSummaryAndShow("DATE(date) >= DATE('now', '-3 months')");
+        showSalesChart("Last 3 Months", Granularity::Week, [](QDate today) { return today.addMonths(-3); });
     });
 
     // THIS YEAR
     connect(ui->income_year, &QPushButton::clicked, this, [=]() {
-        getFinancialSummaryAndShow("DATE(date) >= DATE('now', '-1 year')");
+        showSalesChart("This Year", Granularity::Month, [](QDate today) { return today.addYears(-1); });
     });
 
+    connect(ui->income_products, &QPushButton::clicked, this, &stoking_p::showProductAnalyticsWindow);
+
 
     // this connect is to add a small context menu that has the functions Edit and Delete to the product table
     connect(ui->itemListTB, &QTableView::customContextMenuRequested, this, &stoking_p::showContextMenuItemList);
 
     connect(ui->cartListTB, &QTableView::customContextMenuRequested, this, &stoking_p::showContextMenuCartList);
 
-    // this code gets the data based on the clicked row, and shows a table of bought items
-    connect(ui->historyTable, &QTableView::clicked, this, [this](const QModelIndex& index) {
-        int row = index.row();
-        QStandardItemModel* m = qobject_cast<QStandardItemModel*>(ui->historyTable->model());
-        QString detailsJson = m->item(row, 0)->data(Qt::UserRole + 1).toString();
-        QString transactionNumber = m->item(row, 0)->text();
-        QString transactionName = m->item(row, 1)->text();
-        QString transactionTime = m->item(row, 2)->text();
-
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(detailsJson.toUtf8(), &error);
-        if (error.error != QJsonParseError::NoError || !doc.isArray()) {
-            QMessageBox::warning(this, "Error", "Invalid transaction details format.");
-            return;
-        }
-
-        QJsonArray items = doc.array();
-
-        // Create dialog
-        auto* dialog = new QDialog(this);
-        dialog->setWindowTitle("Transaction Items");
-
-        auto* layout = new QVBoxLayout(dialog);
-        auto* table = new QTableView(dialog);
-        auto* detailModel = new QStandardItemModel(items.size(), 7, dialog);
-        detailModel->setHorizontalHeaderLabels(
-            {"Item", "Quantity", "Sell Price", "Total Sold", "Cost Price", "Total Expense", "Profit"});
-
-        for (int i = 0; i < items.size(); ++i) {
-            QJsonObject item = items[i].toObject();
-            QString itemName = item["name"].toString();
-            int quantity = item["quantity"].toInt();
-            double price = item["price"].toDouble();
-            double cost = item["cost"].toDouble();
-            double totalSold = item["subtotal"].toDouble();
-            double totalExpense = item["subexpense"].toDouble();
-            double profit = totalSold - totalExpense;
-
-            detailModel->setItem(i, 0, new QStandardItem(itemName));
-            detailModel->setItem(i, 1, new QStandardItem(QString::number(quantity)));
-            detailModel->setItem(i, 2, new QStandardItem(QString::number(price, 'f', 2)));
-            detailModel->setItem(i, 3, new QStandardItem(QString::number(totalSold, 'f', 2)));
-            detailModel->setItem(i, 4, new QStandardItem(QString::number(cost, 'f', 2)));
-            detailModel->setItem(i, 5, new QStandardItem(QString::number(totalExpense, 'f', 2)));
-            detailModel->setItem(i, 6, new QStandardItem(QString::number(profit, 'f', 2)));
-        }
-
-        table->setModel(detailModel);
-        table->resizeColumnsToContents();
-        table->horizontalHeader()->setStretchLastSection(true);
-        table->verticalHeader()->setVisible(false);
-        table->horizontalHeader()->setMinimumHeight(64);
-        table->horizontalHeader()->setMaximumHeight(64);
-        table->horizontalHeader()->setMinimumSectionSize(128);
-        layout->addWidget(table);
-
-        // Add button to print invoice
-        QPushButton* printButton = new QPushButton("Print Invoice", dialog);
-        layout->addWidget(printButton);
-
-        // Connect button to print functionality
-        connect(printButton, &QPushButton::clicked, this, [this, items, transactionName, transactionTime, transactionNumber]() {
-            QString companyName, companyAddress, clientAddress;
-
-            if (showInvoiceDialog(transactionName, companyName, companyAddress, clientAddress, this)) {
-                QString invoiceHtml = generateInvoice(items, transactionTime,
-                                                      transactionNumber,
-                                                      companyName,
-                                                      companyAddress,
-                                                      transactionName,
-                                                      clientAddress);
-
-                // Ask user where to save the PDF
-                QString filePath = QFileDialog::getSaveFileName(
-                    this,
-                    "Sauvegarder la facture PDF",
-                    "facture_" + transactionName + ".pdf",
-                    "Fichiers PDF (*.pdf)"
-                    );
-                if (filePath.isEmpty())
-                    return;
-
-                if (!filePath.endsWith(".pdf", Qt::CaseInsensitive))
-                    filePath += ".pdf";
-
-
-                QPrinter printer(QPrinter::HighResolution);
-                printer.setOutputFormat(QPrinter::PdfFormat);
-                printer.setResolution(300);
-                printer.setOutputFileName(filePath);
-
-                QPageLayout layout(QPageSize(QPageSize::A4),
-                                   QPageLayout::Portrait,
-                                   QMarginsF(10, 10, 10, 10));
-                printer.setPageLayout(layout);
-
-                QTextDocument doc;
-                doc.setDefaultStyleSheet(
-                    "table{width:100%;border-collapse:collapse;}"
-                    );
-
-                // Feed HTML
-                doc.setHtml(invoiceHtml);
-
-                // Force width in points (A4 = 595 x 842 points @ 72dpi)
-                doc.setPageSize(QSizeF(595, 842));  // width x height in points
-
-                // Add a little padding inside
-                doc.setDocumentMargin(20.0);
-
-                // Print to PDF
-                doc.print(&printer);
-
-
-                QMessageBox::information(this, "Facture sauvegardée",
-                                         "La facture PDF a été sauvegardée:\n" + filePath);
-                QDesktopServices::openUrl(QUrl::fromLocalFile(filePath));
-
-
-            }
-        });
-
-        dialog->setLayout(layout);
-        dialog->resize(600, 400);
-        dialog->exec();
-    });
 
 
     // clears the cart
     connect(ui->clearCart, &QPushButton::clicked, this, [this](){
         auto response = QMessageBox::question(this, "Clear Confirmation", "Are you sure you want to clear the table?");
         if (response == QMessageBox::Yes) {
+            sessionRecorder.record("clear");
             ui->cartListTB->model()->removeRows(0, ui->cartListTB->model()->rowCount());
         }
         update_transaction_summary();
@@ -704,87 +1278,77 @@ void stoking_p::setup_connects(){
             return;
         }
 
-        float totalsold = 0;
-        float totalcost = 0;
-        QJsonArray items;
-
-        QSqlDatabase db = QSqlDatabase::database();
-        QSqlQuery query(db);
-        db.transaction();
-
+        // collect the cart before touching the database, the write lock is only
+        // held while checkout_sale() runs its statements
+        QList<SaleLine> lines;
         for (int i = 0; i < model->rowCount(); ++i) {
-            QString name = model->item(i, 0)->text();
-            int qtyPurchased = model->item(i, 2)->text().toInt();
-            float price = model->item(i, 3)->text().toFloat();
-            float subtotal = model->item(i, 4)->text().toFloat();
-            float cost = model->item(i, 5)->text().toFloat();
-            float subexpense = model->item(i, 6)->text().toFloat();
-            totalsold += subtotal;
-            totalcost += subexpense;
-
-            QJsonObject itemObj;
-            itemObj["name"] = name;
-            itemObj["quantity"] = qtyPurchased;
-            itemObj["price"] = price;
-            itemObj["cost"] = cost;
-            itemObj["subtotal"] = subtotal;
-            itemObj["subexpense"] = subexpense;
-            items.append(itemObj);
-
-            // Step 1: Get current stock
-            query.prepare("SELECT quantity FROM products WHERE name = ?");
-            query.addBindValue(name);
-            if (!query.exec() || !query.next()) {
-                QMessageBox::critical(this, "Error", "Failed to fetch product quantity.");
-                db.rollback();
-                return;
-            }
-
-            int currentQty = query.value(0).toInt();
-            if (currentQty < qtyPurchased) {
-                QMessageBox::critical(this, "Stock Error", QString("%1 has only %2 left.").arg(name).arg(currentQty));
-                db.rollback();
-                return;
-            }
+            SaleLine line;
+            line.name = model->item(i, 0)->text();
+            line.type = model->item(i, 1)->text();
+            line.quantity = model->item(i, 2)->text().toInt();
+            line.price = model->item(i, 3)->text().toFloat();
+            line.subtotal = model->item(i, 4)->text().toFloat();
+            line.cost = model->item(i, 5)->text().toFloat();
+            line.subexpense = model->item(i, 6)->text().toFloat();
+            line.discount = model->item(i, 7)->text().toDouble();
+            line.promotionId = model->item(i, 8)->text().toInt();
+            lines << line;
+        }
 
-            // Step 2: Update stock
-            int newQty = currentQty - qtyPurchased;
-            query.prepare("UPDATE products SET quantity = ? WHERE name = ?");
-            query.addBindValue(newQty);
-            query.addBindValue(name);
-            if (!query.exec()) {
-                QMessageBox::critical(this, "Error", "Failed to update product stock.");
-                db.rollback();
-                return;
+        sessionRecorder.record("checkout", {{"client", ui->transactionNameLineEdit->text()}});
+        QElapsedTimer timer;
+        timer.start();
+        note_register_activity();
+        CheckoutResult result = checkout_sale(ui->transactionNameLineEdit->text(), lines);
+        if (result.tx.outcome == TxOutcome::Busy && index_build_running()) {
+            // an index build holds the write lock until it is done, the sale waits for it instead of failing
+            QProgressDialog wait("Finishing a database update, the sale is saved as soon as it is done...",
+                                 QString(), 0, 0, this);
+            wait.setWindowModality(Qt::WindowModal);
+            wait.setMinimumDuration(0);
+            wait.show();
+            while (result.tx.outcome == TxOutcome::Busy && index_build_running()) {
+                QEventLoop pause;
+                QTimer::singleShot(250, &pause, &QEventLoop::quit);
+                pause.exec();
+                result = checkout_sale(ui->transactionNameLineEdit->text(), lines);
             }
         }
+        // kept apart so the diagnostics show what a running backup costs a checkout
+        record_timing(backup_in_progress() ? "checkout commit (backup running)" : "checkout commit", timer.elapsed());
 
-        // Step 3: Insert into transactions
-        QString transName = ui->transactionNameLineEdit->text();
-        QJsonDocument doc(items);
-        QString details = QString::fromUtf8(doc.toJson(QJsonDocument::Compact));
-
-        query.prepare("INSERT INTO transactions (name, details, total, total_expense) VALUES (?, ?, ?, ?)");
-        query.addBindValue(transName);
-        query.addBindValue(details);
-        query.addBindValue(totalsold);
-        query.addBindValue(totalcost);
-
-        if (!query.exec()) {
+        if (result.tx.outcome == TxOutcome::Aborted) {
+            QMessageBox::critical(this, "Stock Error", result.tx.message);
+            return;
+        }
+        if (result.tx.outcome == TxOutcome::Busy) {
+            QMessageBox::warning(this, "Database Busy",
+                                 "Another register is saving a sale, please try again.");
+            qDebug() << register_metrics_report();
+            return;
+        }
+        if (!result.ok()) {
+            qDebug() << "Checkout failed:" << result.tx.message;
             QMessageBox::critical(this, "Error", "Failed to save transaction.");
-            db.rollback();
             return;
         }
 
-        db.commit();
-
+        // printed from what was committed, before the success popup so the paper is already out;
+        // print() does nothing without STOCKING_RECEIPT_PRINTER
+        Receipt receipt;
+        receipt.transactionId = result.transactionId;
+        receipt.client = ui->transactionNameLineEdit->text();
+        receipt.date = result.date;
+        receipt.items = QJsonDocument::fromJson(result.details.toUtf8()).array();
+        receipt.total = result.total;
+        receiptPrinter->print(receipt);
+
+        sale_committed(receipt.client, result, lines);
         QMessageBox::information(this, "Success", "Transaction saved and stock updated!");
 
         model->removeRows(0, model->rowCount());
         update_transaction_summary();
         ui->transactionNameLineEdit->clear();
-        setup_table();
-        setupHistoryTable();
     });
 
     // adds a new item to the cart
@@ -794,162 +1358,244 @@ void stoking_p::setup_connects(){
 
         QString itemName = ui->searchShop->text();
         if (itemName.isEmpty()) return;
+        sessionRecorder.record("add", {{"text", itemName}});
 
-
-        QSqlQuery query;
-        query.prepare("SELECT * FROM products WHERE name = ?");
-        query.addBindValue(itemName);
-
-        if (query.exec() && query.next()) {
-            QString name = query.value("name").toString();
-            QString type = query.value("item_type").toString();
-            int quantity = 1;
-            float price = query.value("price").toFloat();
-            float cost = query.value("bought").toFloat();
-
-            QStandardItemModel* model = qobject_cast<QStandardItemModel*>(ui->cartListTB->model());
-            if (!model) {
-                model = new QStandardItemModel(this);
-                ui->cartListTB->setModel(model);
-                model->setHorizontalHeaderLabels({"Name", "Type", "Quantity", "Price", "Subtotal", "Expense", "Subexpense"});
-                ui->cartListTB->setColumnHidden(5, true);
-                ui->cartListTB->setColumnHidden(6, true);
-            }
-
-            QList<QStandardItem*> row;
-            row << new QStandardItem(name)
-                << new QStandardItem(type)
-                << new QStandardItem(QString::number(quantity))
-                << new QStandardItem(QString::number(price))
-                << new QStandardItem(QString::number(quantity * price))
-                << new QStandardItem(QString::number(cost))
-                << new QStandardItem(QString::number(quantity * cost));
-            model->appendRow(row);
-
-            update_transaction_summary();
+        const CartProduct* product = productLookup.find(itemName);
+        if (product) {
+            add_to_cart(*product);
             ui->searchShop->clear();
         }
     };
 
-    connect(ui->addCartItem, &QPushButton::clicked, this, triggerAddCartItem);
-    connect(ui->searchShop, &QLineEdit::returnPressed, this, triggerAddCartItem);
-}
-
-void start_db(){
-    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName("store.db");
+    connect(scanDetector, &ScanDetector::scanned, this, [this](const QString& code) {
+        sessionRecorder.record("add", {{"text", code}});
+        QElapsedTimer timer;
+        timer.start();
 
-    if (!db.open()) {
-        qDebug() << "Error: connection with database failed -" << db.lastError();
-    } else {
-        qDebug() << "Database: connection ok";
-
-        QSqlQuery query;
-        QString createTable = R"(
-        CREATE TABLE IF NOT EXISTS products (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            name TEXT UNIQUE NOT NULL,
-            item_type TEXT NOT NULL,
-            quantity INTEGER NOT NULL,
-            price REAL NOT NULL,
-            bought REAL NOT NULL
-        )
-    )";
-
-        if (!query.exec(createTable)) {
-            qDebug() << "Error creating table:" << query.lastError();
-        } else {
-            qDebug() << "Table created or already exists.";
+        const CartProduct* product = productLookup.find(code);
+        if (!product) {
+            QMessageBox::warning(this, "Unknown Barcode", QString("No product has the code %1.").arg(code));
+            return;
         }
+        add_to_cart(*product);
 
-        QString createTransactions = R"(
-        CREATE TABLE IF NOT EXISTS transactions (
-            id INTEGER PRIMARY KEY AUTOINCREMENT,
-            name TEXT,
-            details TEXT, -- JSON or CSV of items
-            total REAL,
-            total_expense,
-            date TIMESTAMP DEFAULT CURRENT_TIMESTAMP
-        )
-    )";
-
-        if (!query.exec(createTransactions)) {
-            qDebug() << "Error creating table:" << query.lastError();
-        } else {
-            qDebug() << "Table created or already exists.";
+        if (timer.elapsed() > 5) {
+            qDebug() << "Slow scan:" << code << timer.elapsed() << "ms";
         }
+    });
 
-    }
+    connect(ui->addCartItem, &QPushButton::clicked, this, triggerAddCartItem);
+    connect(ui->searchShop, &QLineEdit::returnPressed, this, triggerAddCartItem);
 }
 
-void stoking_p::showFinancialSummaryWindow(double revenue, double expenses, double netProfit) {
-    QDialog* dialog = new QDialog;
-    dialog->setWindowTitle("Financial Summary");
-
-    QVBoxLayout* layout = new QVBoxLayout(dialog);
-
-    QLabel* revenueLabel = new QLabel(QString("Total Revenue: %1 DZD").arg(revenue, 0, 'f', 2));
-    QLabel* expensesLabel = new QLabel(QString("Total Expenses: %1 DZD").arg(expenses, 0, 'f', 2));
-    QLabel* profitLabel = new QLabel(QString("Net Profit: %1 DZD").arg(netProfit, 0, 'f', 2));
+void stoking_p::showProductAnalyticsWindow() {
+    QDialog dialog(this);
+    dialog.setWindowTitle("Product Sales");
+
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+    QHBoxLayout* period = new QHBoxLayout;
+    QDate today = QDate::currentDate();
+    QDateEdit* fromEdit = new QDateEdit(QDate(today.year(), today.month(), 1), &dialog);
+    QDateEdit* toEdit = new QDateEdit(today, &dialog);
+    for (QDateEdit* edit : {fromEdit, toEdit}) {
+        edit->setCalendarPopup(true);
+        edit->setDisplayFormat("yyyy-MM-dd");
+    }
+    period->addWidget(new QLabel("From", &dialog));
+    period->addWidget(fromEdit);
+    period->addWidget(new QLabel("To", &dialog));
+    period->addWidget(toEdit);
+    period->addStretch();
+    QComboBox* grouping = new QComboBox(&dialog);
+    grouping->addItems({"By product", "By category"});
+    period->addWidget(grouping);
+    QPushButton* storesButton = new QPushButton("All Stores...", &dialog);
+    period->addWidget(storesButton);
+    connect(storesButton, &QPushButton::clicked, &dialog, [this, fromEdit, toEdit]() {
+        showMultiStoreWindow(fromEdit->date(), toEdit->date());
+    });
+    layout->addLayout(period);
 
+    QLabel* totalsLabel = new QLabel(&dialog);
     QFont font;
     font.setPointSize(12);
     font.setBold(true);
+    totalsLabel->setFont(font);
+    layout->addWidget(totalsLabel);
+
+    QTableView* table = new QTableView(&dialog);
+    QStandardItemModel* model = new QStandardItemModel(&dialog);
+    table->setModel(model);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->verticalHeader()->setVisible(false);
+    table->horizontalHeader()->setStretchLastSection(true);
+    table->horizontalHeader()->setMinimumSectionSize(96);
+    layout->addWidget(table);
+
+    // until the old sales are copied over the report is partial; it redraws once they are
+    QTimer* backfillWatch = new QTimer(&dialog);
+    backfillWatch->setInterval(2000);
+
+    auto refresh = [this, fromEdit, toEdit, grouping, totalsLabel, model, backfillWatch]() {
+        touch_cache("sales analytics");
+        sessionRecorder.record("report", {{"from", fromEdit->date().toString(Qt::ISODate)},
+                                          {"to", toEdit->date().toString(Qt::ISODate)}});
+        SalesReport report = salesAnalytics.report(fromEdit->date(), toEdit->date());
+        record_timing("product analytics", report.elapsedMs);
+
+        double profit = report.revenue - report.cost;
+        totalsLabel->setText(QString("Revenue: %1 DZD   Expenses: %2 DZD   Net Profit: %3 DZD   Units: %4%5")
+                                 .arg(report.revenue, 0, 'f', 2)
+                                 .arg(report.cost, 0, 'f', 2)
+                                 .arg(profit, 0, 'f', 2)
+                                 .arg(report.units)
+                                 .arg(report.partial ? "   (older sales still loading)" : ""));
+        if (report.partial) backfillWatch->start();
+
+        bool byCategory = grouping->currentIndex() == 1;
+        QVector<ProductSales> rows = byCategory ? category_sales(fromEdit->date(), toEdit->date()) : report.products;
+
+        model->clear();
+        model->setHorizontalHeaderLabels({"Rank", byCategory ? "Category" : "Product", "Units", "Units / Day",
+                                          "Revenue", "Cost", "Margin %"});
+        model->setRowCount(rows.size());
+        for (int i = 0; i < rows.size(); ++i) {
+            const ProductSales& sales = rows[i];
+            model->setItem(i, 0, new QStandardItem(QString::number(sales.rank)));
+            model->setItem(i, 1, new QStandardItem(sales.name));
+            model->setItem(i, 2, new QStandardItem(QString::number(sales.units)));
+            model->setItem(i, 3, new QStandardItem(QString::number(sales.perDay, 'f', 2)));
+            model->setItem(i, 4, new QStandardItem(QString::number(sales.revenue, 'f', 2)));
+            model->setItem(i, 5, new QStandardItem(QString::number(sales.cost, 'f', 2)));
+            model->setItem(i, 6, new QStandardItem(QString::number(sales.margin(), 'f', 1)));
+        }
+    };
+    connect(fromEdit, &QDateEdit::dateChanged, &dialog, refresh);
+    connect(toEdit, &QDateEdit::dateChanged, &dialog, refresh);
+    connect(grouping, qOverload<int>(&QComboBox::currentIndexChanged), &dialog, refresh);
+    connect(backfillWatch, &QTimer::timeout, &dialog, [backfillWatch, refresh]() {
+        if (sale_items_backfill_pending()) return;
+        backfillWatch->stop();
+        refresh();
+    });
+    refresh();
+    table->resizeColumnsToContents();
 
-    revenueLabel->setFont(font);
-    expensesLabel->setFont(font);
-    profitLabel->setFont(font);
-
-    layout->addWidget(revenueLabel);
-    layout->addWidget(expensesLabel);
-    layout->addWidget(profitLabel);
-
-    dialog->setLayout(layout);
-    dialog->exec();
+    dialog.resize(900, 600);
+    dialog.exec();
 }
 
-void stoking_p::getFinancialSummaryAndShow(const QString& periodCondition) {
-    QSqlQuery query;
-    QString queryString = "SELECT details FROM transactions";
+// STOCKING_STORES lists the other shops; each is summarized on its own worker
+// and only shops whose database changed since the last report are read again
+void stoking_p::showMultiStoreWindow(const QDate& from, const QDate& to) {
+    QDialog dialog(this);
+    dialog.setWindowTitle(QString("All Stores  %1 .. %2").arg(from.toString("yyyy-MM-dd"), to.toString("yyyy-MM-dd")));
 
-    if (!periodCondition.isEmpty()) {
-        queryString += " WHERE " + periodCondition;
-    }
-
-    if (!query.exec(queryString)) {
-        qDebug() << "Database query failed:" << query.lastError();
-        return;
-    }
-
-    double totalRevenue = 0.0;
-    double totalExpenses = 0.0;
-
-    while (query.next()) {
-        QString detailsJson = query.value(0).toString();
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(detailsJson.toUtf8(), &error);
-
-        if (error.error != QJsonParseError::NoError || !doc.isArray()) {
-            qDebug() << "Invalid JSON in transaction details.";
-            continue;
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+    QLabel* totalsLabel = new QLabel("Reading stores...", &dialog);
+    QFont font;
+    font.setPointSize(12);
+    font.setBold(true);
+    totalsLabel->setFont(font);
+    layout->addWidget(totalsLabel);
+
+    auto make_table = [&dialog, layout](QStandardItemModel* model) {
+        QTableView* table = new QTableView(&dialog);
+        table->setModel(model);
+        table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        table->setSelectionBehavior(QAbstractItemView::SelectRows);
+        table->verticalHeader()->setVisible(false);
+        table->horizontalHeader()->setStretchLastSection(true);
+        table->horizontalHeader()->setMinimumSectionSize(96);
+        layout->addWidget(table);
+        return table;
+    };
+    QStandardItemModel* storeModel = new QStandardItemModel(&dialog);
+    QStandardItemModel* productModel = new QStandardItemModel(&dialog);
+    QTableView* storeTable = make_table(storeModel);
+    QTableView* productTable = make_table(productModel);
+    storeTable->setMaximumHeight(200);
+
+    QPushButton* exportButton = new QPushButton("Export CSV...", &dialog);
+    exportButton->setEnabled(false);
+    layout->addWidget(exportButton);
+
+    QVector<StoreSource> stores = registered_stores(QSqlDatabase::database().databaseName());
+    QElapsedTimer timer;
+    timer.start();
+
+    auto report = std::make_shared<FederatedReport>();
+    // the watcher outlives the dialog: stores still being read after it is
+    // closed finish into the cache in the background
+    QFutureWatcher<StoreSummary>* watcher = new QFutureWatcher<StoreSummary>(this);
+    connect(watcher, &QFutureWatcher<StoreSummary>::finished, watcher, &QObject::deleteLater);
+    connect(watcher, &QFutureWatcher<StoreSummary>::finished, &dialog, [=]() {
+        *report = FederatedReporting::merge(watcher->future().results(), from, to);
+        record_timing("multi-store report", timer.elapsed());
+
+        const StoreSummary& all = report->combined;
+        totalsLabel->setText(QString("%1 stores   Revenue: %2 DZD   Expenses: %3 DZD   Net Profit: %4 DZD   Units: %5")
+                                 .arg(report->stores.size())
+                                 .arg(all.revenue, 0, 'f', 2)
+                                 .arg(all.cost, 0, 'f', 2)
+                                 .arg(all.revenue - all.cost, 0, 'f', 2)
+                                 .arg(all.units));
+
+        storeModel->setHorizontalHeaderLabels({"Store", "Sales", "Units", "Revenue", "Cost", "Profit", "Read"});
+        storeModel->setRowCount(report->stores.size());
+        for (int i = 0; i < report->stores.size(); ++i) {
+            const StoreSummary& store = report->stores[i];
+            QString read = !store.error.isEmpty() ? store.error
+                           : store.cached         ? "cached"
+                                                  : QString("%1 ms").arg(store.elapsedMs);
+            storeModel->setItem(i, 0, new QStandardItem(store.store));
+            storeModel->setItem(i, 1, new QStandardItem(QString::number(store.transactions)));
+            storeModel->setItem(i, 2, new QStandardItem(QString::number(store.units)));
+            storeModel->setItem(i, 3, new QStandardItem(QString::number(store.revenue, 'f', 2)));
+            storeModel->setItem(i, 4, new QStandardItem(QString::number(store.cost, 'f', 2)));
+            storeModel->setItem(i, 5, new QStandardItem(QString::number(store.revenue - store.cost, 'f', 2)));
+            storeModel->setItem(i, 6, new QStandardItem(read));
         }
 
-        QJsonArray items = doc.array();
-
-        for (const QJsonValue& val : items) {
-            QJsonObject item = val.toObject();
-            double subtotal = item["subtotal"].toDouble();
-            double subexpense = item["subexpense"].toDouble();
-
-            totalRevenue += subtotal;
-            totalExpenses += subexpense;
+        productModel->setHorizontalHeaderLabels({"Rank", "Product", "Units", "Units / Day", "Revenue", "Cost", "Margin %"});
+        productModel->setRowCount(all.products.size());
+        for (int i = 0; i < all.products.size(); ++i) {
+            const ProductSales& sales = all.products[i];
+            productModel->setItem(i, 0, new QStandardItem(QString::number(sales.rank)));
+            productModel->setItem(i, 1, new QStandardItem(sales.name));
+            productModel->setItem(i, 2, new QStandardItem(QString::number(sales.units)));
+            productModel->setItem(i, 3, new QStandardItem(QString::number(sales.perDay, 'f', 2)));
+            productModel->setItem(i, 4, new QStandardItem(QString::number(sales.revenue, 'f', 2)));
+            productModel->setItem(i, 5, new QStandardItem(QString::number(sales.cost, 'f', 2)));
+            productModel->setItem(i, 6, new QStandardItem(QString::number(sales.margin(), 'f', 1)));
         }
-    }
-
-    double netProfit = totalRevenue - totalExpenses;
+        storeTable->resizeColumnsToContents();
+        productTable->resizeColumnsToContents();
+        exportButton->setEnabled(true);
+    });
+    touch_cache("store reports");
+    QFuture<StoreSummary> reads = federatedReporting.run(stores, from, to);
+    storeReads.erase(std::remove_if(storeReads.begin(), storeReads.end(),
+                                    [](const QFuture<StoreSummary>& f) { return f.isFinished(); }),
+                     storeReads.end());
+    storeReads.append(reads);
+    watcher->setFuture(reads);
+
+    connect(exportButton, &QPushButton::clicked, &dialog, [this, report, from, to]() {
+        QString file = QFileDialog::getSaveFileName(
+            this, "Export", QString("stores-%1-%2.csv").arg(from.toString("yyyyMMdd"), to.toString("yyyyMMdd")),
+            "CSV (*.csv)");
+        if (file.isEmpty()) return;
+        QString error;
+        if (!export_federated_csv(*report, file, error)) {
+            qDebug() << "Export failed:" << error;
+            QMessageBox::warning(this, "Export Error", "Could not export: " + error);
+        }
+    });
 
-    // Show the popup window
-    showFinancialSummaryWindow(totalRevenue, totalExpenses, netProfit);
+    dialog.resize(900, 700);
+    dialog.exec();
 }
 
 
@@ -1150,15 +1796,6 @@ bool stoking_p::showInvoiceDialog(const QString& clientName, QString& companyNam
 }
 
 
-void close_db() {
-    QSqlDatabase db = QSqlDatabase::database();
-    if (db.isOpen()) {
-        db.close();
-        QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
-        qDebug() << "Database connection closed.";
-    }
-}
-
 QString intToString(int num, int size){
     QString ren;
     int number_of_zeros = size - getIntSize(num);
@@ -1176,6 +1813,15 @@ int getIntSize(int num, int ren){
 
 stoking_p::~stoking_p()
 {
+    delete apiServer;   // before the database and the window it checks out into go
+    for (QFuture<StoreSummary>& reads : storeReads) reads.waitForFinished();   // they write into federatedReporting's cache
+    qDebug() << register_metrics_report();
+    for (const char* name : {"product lookup", "stock watch", "sales series", "sales analytics", "store reports",
+                             "items table", "cart", "history rows", "transaction details"}) {
+        unregister_cache(name);
+    }
+    if (storeOpen) snapshot_valuation(valuationDay);
+    if (productRepository) productRepository->release();
     close_db();
     delete ui;
 }
@@ -2,6 +2,15 @@
 #define STOKING_P_H
 
 #include <QMainWindow>
+#include "product_lookup.h"
+#include "sales_analytics.h"
+#include "sales_series.h"
+#include "stock_watch.h"
+#include "promotions.h"
+#include "multi_store.h"
+#include "invoice_cache.h"
+#include "session_replay.h"
+#include <QDate>
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -9,6 +18,17 @@ class stoking_p;
 }
 QT_END_NAMESPACE
 
+class SyncClient;
+class ScanDetector;
+class SalesChart;
+class ReceiptPrinter;
+class ProductRepository;
+class TransactionCache;
+class TransactionDetailPane;
+class ApiServer;
+struct DecodedTransaction;
+struct CheckoutResult;
+
 class stoking_p : public QMainWindow
 {
     Q_OBJECT
@@ -19,13 +39,56 @@ public:
 
 private:
     Ui::stoking_p *ui;
+    SyncClient *syncClient = nullptr;      // STOCKING_SYNC_SERVER
+    ScanDetector *scanDetector;
+    ReceiptPrinter *receiptPrinter;
+    ProductRepository *productRepository = nullptr;
+    ProductLookup productLookup;
+    SalesAnalytics salesAnalytics;
+    SalesTimeSeries salesSeries;
+    StockWatch stockWatch;
+    PromotionEngine promotions;
+    FederatedReporting federatedReporting;
+    QVector<QFuture<StoreSummary>> storeReads;  // multi-store reports, may outlive their window
+    InvoiceCache invoiceCache;
+    SessionRecorder sessionRecorder;        // STOCKING_SESSION_LOG
+    SalesChart *salesChart = nullptr;
+    TransactionCache *transactionCache = nullptr;
+    TransactionDetailPane *detailPane = nullptr;
+    ApiServer *apiServer = nullptr;         // STOCKING_API
+    bool storeOpen = false;     // open_store() has run
+    bool itemsPageLoaded = false;
+    bool historyPageLoaded = false;
+    int categoryFilter = 0;     // 0 = all categories
+    QDate valuationDay;         // business day the next valuation snapshot closes
+
+    void open_store();
+    void ensure_items_page();
+    void ensure_history_page();
+    void setup_memory_budget();
+    void showDiagnosticsWindow();
+    void refresh_stock_watch();
+    void update_low_stock_panel();
+    void products_updated(const QVector<int>& ids);
+    void products_removed(const QVector<int>& ids);
+    void refresh_item_rows(const QVector<int>& ids);
+    void update_valuation_label();
+    void showValuationWindow();
+    void sale_committed(const QString& client, const CheckoutResult& result, const QList<SaleLine>& lines);
+    void setup_api_server();
 
     void setup_search_autocomplete();
+    void update_completer();
     bool eventFilter(QObject* obj, QEvent* event);
     void update_transaction_summary();
     void clear_cart();
     void setup_cartTb();
     void showContextMenuCartList(const QPoint &pos);
+    void add_to_cart(const CartProduct& product);
+    void set_cart_quantity(int row, int qty);
+    void reprice_line(int row);
+    void reprice_cart();
+    void showPromotionsWindow();
 
 
 //==============================================================
@@ -34,14 +97,16 @@ private:
         QString item_type,
         QString item_price,
         QString item_bought,
-        int item_count);
+        int item_count,
+        QString item_barcode);
 
     void insert_item_db(
         QString name,
         QString type,
         float price,
         float bought,
-        int count);
+        int count,
+        QString barcode);
 
     void update_item_db(
         int id,
@@ -49,19 +114,25 @@ private:
         QString type,
         float price,
         float bought,
-        int count);
+        int count,
+        QString barcode);
 
     void setup_form();
     void setup_table();
+    void update_category_facets();
+    void showContextMenuCategoryList(const QPoint &pos);
     void showContextMenuItemList(const QPoint &pos);
 
     void clear_form();
 
 //==============================================================
     void setupHistoryTable();
-    void getFinancialSummaryAndShow(const QString& periodCondition = "");
-    void showFinancialSummaryWindow(double revenue, double expenses, double netProfit);
+    void setupSalesChart();
+    void showSalesChart(const QString& title, Granularity granularity, QDate (*start)(QDate));
+    void showProductAnalyticsWindow();
+    void showMultiStoreWindow(const QDate& from, const QDate& to);
     void showContextMenuHistoryList(const QPoint &pos);
+    void print_invoice(const DecodedTransaction& transaction);
 //==============================================================
 
     void setup_connects();
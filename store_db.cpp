@@ -0,0 +1,59 @@
+#include "store_db.h"
+#include "db_concurrency.h"
+#include "query_registry.h"
+#include "schema_migrations.h"
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+bool has_column(const QString& table, const QString& column) {
+    QSqlQuery query;
+    query.exec(QString("PRAGMA table_info(%1)").arg(table));
+    while (query.next()) {
+        if (query.value(1).toString() == column) return true;
+    }
+    return false;
+}
+
+bool start_db(const QString& path){
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(path);
+
+    if (!db.open()) {
+        qDebug() << "Error: connection with database failed -" << db.lastError();
+        return false;
+    }
+
+    qDebug() << "Database: connection ok";
+    configure_connection(db);
+
+    // the tables and their upgrades are versioned migrations; index builds
+    // and backfills are left to BackgroundMigrations
+    return run_migrations();
+}
+
+QVariant get_meta(const QString& key, const QVariant& fallback) {
+    QSqlQuery query;
+    query.prepare(registered_sql(Statement::MetaGet));
+    query.addBindValue(key);
+    return query.exec() && query.next() ? query.value(0) : fallback;
+}
+
+bool set_meta(QSqlQuery& query, const QString& key, const QVariant& value) {
+    query.prepare(registered_sql(Statement::MetaSet));
+    query.addBindValue(key);
+    query.addBindValue(value);
+    return query.exec();
+}
+
+void close_db() {
+    {
+        // this handle too has to be gone before the connection is removed
+        QSqlDatabase db = QSqlDatabase::database(QSqlDatabase::defaultConnection, false);
+        if (!db.isOpen()) return;
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+    qDebug() << "Database connection closed.";
+}
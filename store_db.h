@@ -0,0 +1,18 @@
+#ifndef STORE_DB_H
+#define STORE_DB_H
+
+#include <QSqlQuery>
+#include <QString>
+#include <QVariant>
+
+bool start_db(const QString& path = "store.db");
+void close_db();
+
+// for ALTER TABLE ... ADD COLUMN on databases from older versions
+bool has_column(const QString& table, const QString& column);
+
+// small key/value table for bookkeeping like backfill progress
+QVariant get_meta(const QString& key, const QVariant& fallback = QVariant());
+bool set_meta(QSqlQuery& query, const QString& key, const QVariant& value);
+
+#endif // STORE_DB_H
@@ -0,0 +1,232 @@
+#include "transaction_detail.h"
+#include "query_registry.h"
+#include "app_metrics.h"
+#include "memory_budget.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLabel>
+#include <QPushButton>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTableView>
+#include <QThread>
+#include <QVBoxLayout>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+
+const int maxPrefetchBatch = 64;
+
+QVector<DecodedTransaction> load_transactions(QSqlDatabase db, const QVector<int>& ids) {
+    QVector<DecodedTransaction> result;
+    if (ids.isEmpty()) return result;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(registered_sql(Statement::TransactionsByIds, ids.size()));
+    for (int id : ids) query.addBindValue(id);
+    if (!query.exec()) {
+        qDebug() << "Loading transactions failed:" << query.lastError();
+        return result;
+    }
+
+    while (query.next()) {
+        DecodedTransaction transaction;
+        transaction.id = query.value(0).toInt();
+        transaction.client = query.value(1).toString();
+        transaction.date = query.value(2).toString();
+        transaction.total = query.value(3).toDouble();
+
+        QJsonParseError error;
+        const QByteArray details = query.value(4).toString().toUtf8();
+        QJsonDocument doc = QJsonDocument::fromJson(details, &error);
+        transaction.valid = error.error == QJsonParseError::NoError && doc.isArray();
+        if (transaction.valid) transaction.items = doc.array();
+        // parsed json takes about twice its text
+        transaction.bytes = qint64(sizeof(DecodedTransaction)) + string_bytes(transaction.client)
+                            + string_bytes(transaction.date) + 2 * details.size();
+        result.append(transaction);
+    }
+    return result;
+}
+
+}
+
+TransactionCache::TransactionCache(qint64 maxBytes, QObject* parent)
+    : QObject(parent)
+    , cache(int(maxBytes))
+    , dbPath(QSqlDatabase::database().databaseName())
+{
+    connect(&watcher, &QFutureWatcher<QVector<DecodedTransaction>>::finished, this, [this]() {
+        for (const DecodedTransaction& transaction : watcher.result()) {
+            if (!cache.contains(transaction.id)) insert(transaction);
+        }
+        inFlight.clear();
+        if (!queued.isEmpty()) start_prefetch();
+    });
+}
+
+// the pointer is good until the next insert, copy what you keep
+const DecodedTransaction* TransactionCache::get(int id) {
+    if (DecodedTransaction* hit = cache.object(id)) {
+        ++hitCount;
+        return hit;
+    }
+    ++missCount;
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<DecodedTransaction> loaded = load_transactions(QSqlDatabase::database(), {id});
+    record_timing("transaction detail miss", timer.elapsed());
+    if (loaded.isEmpty()) return nullptr;
+
+    insert(loaded.first());
+    return cache.object(id);
+}
+
+void TransactionCache::prefetch(const QVector<int>& ids) {
+    for (int id : ids) {
+        if (!cache.contains(id) && !inFlight.contains(id) && !queued.contains(id)) queued.append(id);
+    }
+    if (!watcher.isRunning()) start_prefetch();
+}
+
+void TransactionCache::insert(const DecodedTransaction& transaction) {
+    // QCache refuses an entry over the whole bound, and get() must still return it
+    cache.insert(transaction.id, new DecodedTransaction(transaction), int(qMin<qint64>(transaction.bytes, cache.maxCost())));
+}
+
+// shrinking the bound makes QCache drop its least recently used entries
+qint64 TransactionCache::trim(qint64 bytes) {
+    const qint64 before = cache.totalCost();
+    const auto maxCost = cache.maxCost();
+    cache.setMaxCost(int(qMax<qint64>(0, before - bytes)));
+    cache.setMaxCost(maxCost);
+    return before - cache.totalCost();
+}
+
+void TransactionCache::clear() {
+    cache.clear();
+    queued.clear();
+}
+
+void TransactionCache::start_prefetch() {
+    // the newest request matters most, older ones may have scrolled away
+    QVector<int> batch = queued.mid(qMax(0, queued.size() - maxPrefetchBatch));
+    queued.clear();
+    if (batch.isEmpty()) return;
+    for (int id : batch) inFlight.insert(id);
+
+    const QString path = dbPath;
+    watcher.setFuture(QtConcurrent::run([path, batch]() {
+        const QString name = QString("transaction_prefetch_%1").arg(quintptr(QThread::currentThreadId()));
+        QVector<DecodedTransaction> result;
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+            db.setDatabaseName(path);
+            db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=2000");
+            if (db.open()) {
+                result = load_transactions(db, batch);
+                db.close();
+            } else {
+                qDebug() << "Prefetch connection failed:" << db.lastError();
+            }
+        }
+        QSqlDatabase::removeDatabase(name);
+        return result;
+    }));
+}
+
+//=====================================================================================================================
+
+void TransactionItemsModel::set_items(const QJsonArray& lines) {
+    beginResetModel();
+    items = lines;
+    endResetModel();
+}
+
+int TransactionItemsModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : items.size();
+}
+
+int TransactionItemsModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : 7;
+}
+
+QVariant TransactionItemsModel::data(const QModelIndex& index, int role) const {
+    if (role != Qt::DisplayRole || !index.isValid()) return QVariant();
+
+    const QJsonObject item = items[index.row()].toObject();
+    switch (index.column()) {
+    case 0: return item["name"].toString();
+    case 1: return QString::number(item["quantity"].toInt());
+    case 2: return QString::number(item["price"].toDouble(), 'f', 2);
+    case 3: return QString::number(item["subtotal"].toDouble(), 'f', 2);
+    case 4: return QString::number(item["cost"].toDouble(), 'f', 2);
+    case 5: return QString::number(item["subexpense"].toDouble(), 'f', 2);
+    case 6: return QString::number(item["subtotal"].toDouble() - item["subexpense"].toDouble(), 'f', 2);
+    }
+    return QVariant();
+}
+
+QVariant TransactionItemsModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    static const QStringList headers = {"Item", "Quantity", "Sell Price", "Total Sold", "Cost Price", "Total Expense",
+                                        "Profit"};
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+    return headers.value(section);
+}
+
+//=====================================================================================================================
+
+TransactionDetailPane::TransactionDetailPane(QWidget* parent)
+    : QWidget(parent)
+    , title(new QLabel(this))
+    , table(new QTableView(this))
+    , model(new TransactionItemsModel(this))
+    , invoiceButton(new QPushButton("Print Invoice", this))
+    , receiptButton(new QPushButton("Print Receipt", this))
+{
+    QFont font = title->font();
+    font.setBold(true);
+    title->setFont(font);
+
+    table->setModel(model);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table->verticalHeader()->setVisible(false);
+    table->horizontalHeader()->setStretchLastSection(true);
+    table->horizontalHeader()->setMinimumSectionSize(128);
+
+    QHBoxLayout* header = new QHBoxLayout;
+    header->addWidget(title, 1);
+    header->addWidget(invoiceButton);
+    // quick reprint on the receipt printer, no pdf
+    header->addWidget(receiptButton);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(header);
+    layout->addWidget(table);
+
+    connect(invoiceButton, &QPushButton::clicked, this, [this]() { emit invoiceRequested(transaction); });
+    connect(receiptButton, &QPushButton::clicked, this, [this]() { emit receiptRequested(transaction); });
+}
+
+void TransactionDetailPane::show_transaction(const DecodedTransaction& shown) {
+    transaction = shown;
+    title->setText(transaction.valid
+                       ? QString("Transaction #%1   %2   %3   %4 DZD")
+                             .arg(transaction.id)
+                             .arg(transaction.client, transaction.date)
+                             .arg(transaction.total, 0, 'f', 2)
+                       : QString("Transaction #%1: invalid transaction details format.").arg(transaction.id));
+    model->set_items(transaction.items);
+    invoiceButton->setEnabled(transaction.valid);
+    receiptButton->setEnabled(transaction.valid);
+}
@@ -0,0 +1,106 @@
+#ifndef TRANSACTION_DETAIL_H
+#define TRANSACTION_DETAIL_H
+
+#include <QAbstractTableModel>
+#include <QCache>
+#include <QFutureWatcher>
+#include <QJsonArray>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <QWidget>
+
+class QLabel;
+class QPushButton;
+class QTableView;
+
+struct DecodedTransaction {
+    int id = 0;
+    QString client;
+    QString date;           // as stored, UTC
+    double total = 0;
+    QJsonArray items;
+    bool valid = false;     // details parsed as a json array
+    qint64 bytes = 0;       // estimated size in memory, the cache cost
+};
+
+// Recently opened sales, already decoded, least recently used out first once
+// their estimated size passes maxBytes.
+// get() loads a miss on the spot; prefetch() decodes ids on the thread pool,
+// on a connection of its own, so the rows around the selection are ready
+// before the arrow keys get there.
+class TransactionCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransactionCache(qint64 maxBytes = 4 * 1024 * 1024, QObject* parent = nullptr);
+
+    const DecodedTransaction* get(int id);
+    void prefetch(const QVector<int>& ids);
+    void clear();
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+    qint64 footprint() const { return cache.totalCost(); }
+    qint64 trim(qint64 bytes);
+
+private:
+    void start_prefetch();
+    void insert(const DecodedTransaction& transaction);
+
+    QCache<int, DecodedTransaction> cache;
+    QFutureWatcher<QVector<DecodedTransaction>> watcher;
+    QVector<int> queued;
+    QSet<int> inFlight;
+    QString dbPath;
+    int hitCount = 0;
+    int missCount = 0;
+};
+
+// Line items of one sale, read straight from the decoded json: no item
+// objects are created per cell.
+class TransactionItemsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    using QAbstractTableModel::QAbstractTableModel;
+
+    void set_items(const QJsonArray& items);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    QJsonArray items;
+};
+
+// The history page's detail pane. One instance lives under the history
+// table and is refilled whenever the current row changes.
+class TransactionDetailPane : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TransactionDetailPane(QWidget* parent = nullptr);
+
+    void show_transaction(const DecodedTransaction& transaction);
+    const DecodedTransaction& current() const { return transaction; }
+
+signals:
+    void invoiceRequested(const DecodedTransaction& transaction);
+    void receiptRequested(const DecodedTransaction& transaction);
+
+private:
+    DecodedTransaction transaction;
+    QLabel* title;
+    QTableView* table;
+    TransactionItemsModel* model;
+    QPushButton* invoiceButton;
+    QPushButton* receiptButton;
+};
+
+#endif // TRANSACTION_DETAIL_H
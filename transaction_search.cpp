@@ -0,0 +1,99 @@
+#include "transaction_search.h"
+#include "db_concurrency.h"
+#include "query_registry.h"
+#include "store_db.h"
+#include <QDebug>
+#include <QRegularExpression>
+#include <QSqlError>
+
+namespace {
+
+bool available = false;
+
+}
+
+bool create_transaction_search(QSqlQuery& query) {
+    // prefix indexes make 2 and 3 letter prefix queries a single lookup
+    available = query.exec(R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS transactions_fts USING fts5(
+            client, items,
+            content = '',
+            tokenize = 'unicode61 remove_diacritics 2',
+            prefix = '2 3'
+        )
+    )");
+    if (!available) {
+        qDebug() << "Full-text search unavailable:" << query.lastError().text();
+        return false;
+    }
+
+    return query.exec("INSERT OR IGNORE INTO app_meta (key, value) "
+                      "SELECT 'search_indexed_until', COALESCE(MAX(id), 0) FROM transactions")
+        && query.exec("INSERT OR IGNORE INTO app_meta (key, value) VALUES ('search_indexed', 0)");
+}
+
+bool detect_transaction_search() {
+    QSqlQuery query;
+    available = query.exec("SELECT rowid FROM transactions_fts LIMIT 0");
+    return available;
+}
+
+bool transaction_search_available() {
+    return available;
+}
+
+bool index_transaction(QSqlQuery& query, int transactionId, const QString& client, const QStringList& items) {
+    if (!available) return true;
+    query.prepare(registered_sql(Statement::SearchIndexInsert));
+    query.addBindValue(transactionId);
+    query.addBindValue(client);
+    query.addBindValue(items.join(' '));
+    return query.exec();
+}
+
+bool index_pending_transactions(int transactionsPerChunk) {
+    if (!available) return true;
+
+    qint64 until = get_meta("search_indexed_until", 0).toLongLong();
+    qint64 done = get_meta("search_indexed", 0).toLongLong();
+    if (done >= until) return true;
+
+    qint64 upTo = qMin(done + transactionsPerChunk, until);
+    TxResult tx = run_write_transaction([&](QSqlQuery& query, QString&) {
+        query.prepare(registered_sql(Statement::SearchIndexRange));
+        query.addBindValue(done);
+        query.addBindValue(upTo);
+        if (!query.exec()) return TxStatus::Error;
+        return set_meta(query, "search_indexed", upTo) ? TxStatus::Ok : TxStatus::Error;
+    });
+
+    if (tx.outcome != TxOutcome::Committed) {
+        qDebug() << "Search indexing failed:" << tx.message;
+        return true;
+    }
+    return upTo >= until;
+}
+
+bool reset_transaction_search() {
+    if (!available) return false;
+
+    TxResult tx = run_write_transaction([](QSqlQuery& query, QString&) {
+        // sales committed after this point index themselves
+        if (!query.exec("INSERT INTO transactions_fts (transactions_fts) VALUES ('delete-all')")) return TxStatus::Error;
+        if (!query.exec("SELECT COALESCE(MAX(id), 0) FROM transactions") || !query.next()) return TxStatus::Error;
+        qint64 until = query.value(0).toLongLong();
+        if (!set_meta(query, "search_indexed_until", until)) return TxStatus::Error;
+        return set_meta(query, "search_indexed", 0) ? TxStatus::Ok : TxStatus::Error;
+    });
+    return tx.outcome == TxOutcome::Committed;
+}
+
+QString fts_match_expression(const QString& text) {
+    static const QRegularExpression separatorRe("[^\\w]+");
+
+    QStringList terms;
+    for (const QString& word : text.split(separatorRe, Qt::SkipEmptyParts)) {
+        terms << QString("\"%1\"*").arg(word);
+    }
+    return terms.join(' ');
+}
@@ -0,0 +1,26 @@
+#ifndef TRANSACTION_SEARCH_H
+#define TRANSACTION_SEARCH_H
+
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+
+// Full-text index over the client name and item names of every sale
+// (fts5 table transactions_fts, rowid = transactions.id, contentless).
+// Checkout indexes its own sale; older sales and rebuilds are indexed in
+// chunks by index_pending_transactions() from the idle timer.
+// When the sqlite build has no fts5 the search falls back to name prefixes.
+
+bool create_transaction_search(QSqlQuery& query);
+// for databases where the migration already ran: is the table usable here
+bool detect_transaction_search();
+bool transaction_search_available();
+
+bool index_transaction(QSqlQuery& query, int transactionId, const QString& client, const QStringList& items);
+bool index_pending_transactions(int transactionsPerChunk = 5000);
+bool reset_transaction_search();
+
+// "red velv" -> "red"* "velv"*, every word as a prefix, all required
+QString fts_match_expression(const QString& text);
+
+#endif // TRANSACTION_SEARCH_H